@@ -25,3 +25,6 @@
 /* Computed gotos available? */
 #undef HAVE_COMPUTED_GOTOS
 
+/* Threads and thread-local storage available? */
+#undef HAVE_THREADS
+
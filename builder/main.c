@@ -162,7 +162,7 @@ void output_interpreter(FILE* dest,
 	      if (op->flags.isstring)
 		{
 		  fprintf(dest, "#ifdef DEBUG\nprintf_debug(\"(String instruction) - decoding the string at #%%x: \", pc+%i);\n#endif\n", pcadd);
-		  fprintf(dest, "      string = zscii_to_unicode(&GetCode(pc+%i), &padding);\n", pcadd);
+		  fprintf(dest, "      string = zscii_decode_at(pc+%i, &padding);\n", pcadd);
 		  fprintf(dest, "#ifdef DEBUG\nprintf_debug(\">%%s<\\n\", string);\n#endif\n");
 		}
 
@@ -709,7 +709,7 @@ void output_interpreter(FILE* dest,
 		}
 	      if (op->flags.isstring)
 		{
-		  fprintf(dest, "    string = zscii_to_unicode(&GetCode(pc+%i), &padding);\n", pcadd);
+		  fprintf(dest, "    string = zscii_decode_at(pc+%i, &padding);\n", pcadd);
 		}
 
 	      if (op->flags.isbranch || op->flags.isstring)
@@ -1062,6 +1062,198 @@ void output_operations(FILE* dest,
     }
 }
 
+/*
+ * The pre-decoder (see interp.c) needs to know the shape of each
+ * instruction without executing it. These tables record the flags of
+ * every opcode byte for a specific version, so the information doesn't
+ * have to be duplicated by hand.
+ */
+static char* predecode_flags(opflags fl)
+{
+  char name[256];
+  char* res;
+
+  strcpy(name, "PD_OP");
+  if (fl.isstore)
+    strcat(name, "|PD_STORE");
+  if (fl.isbranch)
+    strcat(name, "|PD_BRANCH");
+  if (fl.isstring)
+    strcat(name, "|PD_STRING");
+  if (fl.islong)
+    strcat(name, "|PD_LONG");
+
+  res = malloc(strlen(name)+1);
+  strcpy(res, name);
+
+  return res;
+}
+
+void output_predecode_tables(FILE* dest,
+			     int version)
+{
+  int x, y;
+  int vmask;
+
+  char* flag_table[256];
+  char* flag_ext_table[256];
+
+  if (version <= 0)
+    return;
+
+  vmask = 1<<version;
+
+  for (x=0; x<256; x++)
+    {
+      flag_table[x] = flag_ext_table[x] = "0";
+    }
+
+  for (x=0; x<zmachine.numops; x++)
+    {
+      operation* op;
+      char* flags;
+
+      op = zmachine.op[x];
+
+      if (!(op->versions&vmask))
+	continue;
+
+      flags = predecode_flags(op->flags);
+
+      switch (op->type)
+	{
+	case zop:
+	  flag_table[op->value|0xb0] = flags;
+	  break;
+
+	case unop:
+	  for (y=0; y<3; y++)
+	    flag_table[op->value|0x80|(y<<4)] = flags;
+	  break;
+
+	case binop:
+	  for (y=0; y<4; y++)
+	    flag_table[op->value|(y<<5)] = flags;
+	  flag_table[op->value|0xc0] = flags;
+	  break;
+
+	case varop:
+	  flag_table[op->value|0xe0] = flags;
+	  break;
+
+	case extop:
+	  flag_ext_table[op->value] = flags;
+	  flag_table[190] = "PD_OP|PD_EXT";
+	  break;
+	}
+    }
+
+  fprintf(dest, "static const ZByte predecode_v%i[256] = {", version);
+  for (x=0; x<256; x++)
+    {
+      if ((x&0x3) == 0)
+	fprintf(dest, "\n  ");
+      fprintf(dest, "%s,\t", flag_table[x]);
+    }
+  fprintf(dest, "\n};\n");
+
+  fprintf(dest, "static const ZByte predecode_ext_v%i[256] = {", version);
+  for (x=0; x<256; x++)
+    {
+      if ((x&0x3) == 0)
+	fprintf(dest, "\n  ");
+      fprintf(dest, "%s,\t", flag_ext_table[x]);
+    }
+  fprintf(dest, "\n};\n");
+}
+
+#ifndef HAVE_COMPUTED_GOTOS
+/*
+ * Once an instruction has been pre-decoded, all that's left is to jump
+ * to the code for the operation. This is the giant switch statement
+ * without any of the decoding.
+ */
+void output_predecode_exec(FILE* dest,
+			   int version)
+{
+  int x, y;
+  int vmask;
+
+  vmask = 1<<version;
+  fprintf(dest, "  switch (instr)\n    {\n");
+
+  for (x=0; x<zmachine.numops; x++)
+    {
+      operation* op;
+
+      op = zmachine.op[x];
+      if ((op->versions&vmask && op->versions != -1) || (version==-1
+							 && op->versions==-1))
+	{
+	  switch (op->type)
+	    {
+	    case zop:
+	      fprintf(dest, "    case 0x%x:", op->value|0xb0);
+	      break;
+
+	    case unop:
+	      for (y=0; y<3; y++)
+		fprintf(dest, "    case 0x%x:", op->value|0x80|(y<<4));
+	      break;
+
+	    case binop:
+	      for (y=0; y<4; y++)
+		fprintf(dest, "    case 0x%x:", op->value|(y<<5));
+	      fprintf(dest, "    case 0x%x:", op->value|0xc0);
+	      break;
+
+	    case varop:
+	      fprintf(dest, "    case 0x%x:", op->value|0xe0);
+	      break;
+
+	    case extop:
+	      continue;
+	    }
+
+	  fprintf(dest, " /* %s */\n      ", op->name);
+	  output_opname(dest, op->name, op->versions);
+	}
+    }
+
+  if (version != -1)
+    {
+      fprintf(dest, "    case 0x%x: /* Extended ops */\n", 190);
+      fprintf(dest, "      switch (ext_instr)\n");
+      fprintf(dest, "        {\n");
+
+      for (x=0; x<zmachine.numops; x++)
+	{
+	  operation* op;
+
+	  op = zmachine.op[x];
+
+	  if (op->type == extop && op->versions&vmask)
+	    {
+	      fprintf(dest, "        case 0x%x: /* %s */\n          ",
+		      op->value, op->name);
+	      output_opname(dest, op->name, op->versions);
+	    }
+	}
+
+      fprintf(dest, "        default:\n");
+      fprintf(dest, "          zmachine_fatal(\"Unknown extended opcode: %%x\", ext_instr);\n");
+      fprintf(dest, "        }\n");
+    }
+
+  fprintf(dest, "    default:\n");
+  if (version != -1)
+    fprintf(dest, "      zmachine_fatal(\"Unknown opcode: %%x\", instr);\n");
+  else
+    fprintf(dest, "      goto predecoded_version;\n");
+  fprintf(dest, "    }\n");
+}
+#endif
+
 extern FILE* yyin;
 
 int main(int argc, char** argv)
@@ -1092,10 +1284,18 @@ int main(int argc, char** argv)
       
       if ((output = fopen(argv[1], "w")))
 	{
+	  fprintf(output, "#if defined(PREDECODE_TABLES)\n");
+	  output_predecode_tables(output, atoi(argv[2]));
+	  fprintf(output, "#elif defined(PREDECODE_EXEC)\n");
+#ifndef HAVE_COMPUTED_GOTOS
+	  output_predecode_exec(output, atoi(argv[2]));
+#endif
+	  fprintf(output, "#else\n");
 	  output_interpreter(output, atoi(argv[2]));
 	  fprintf(output, "#ifndef TABLES_ONLY\n");
 	  output_operations(output, atoi(argv[2]));
 	  fprintf(output, "#endif\n");
+	  fprintf(output, "#endif\n");
 	  fclose(output);
 	}
       else
@@ -0,0 +1,873 @@
+/*
+ *  A Z-Machine
+ *  Copyright (C) 2000 Andrew Hunter
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Headless display, for running stories from scripts
+ *
+ * The lower window is written to stdout as UTF-8; the upper windows
+ * are kept as a character grid which is written out (whenever it has
+ * changed) before the next line of lower window text. Input is read a
+ * line at a time from a command file or stdin. Styles, colours and
+ * pictures are accepted and ignored.
+ */
+
+#include "../config.h"
+
+#if WINDOW_SYSTEM == 5
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "zmachine.h"
+#include "display.h"
+#include "v6display.h"
+#include "rc.h"
+#include "batchdisplay.h"
+
+#define BATCH_COLUMNS 80
+#define BATCH_LINES   255  /* 255 lines means 'never page' to a game */
+#define GRID_LINES    48   /* Largest upper window we keep */
+
+static ZSTATE int is_v6 = 0;
+
+/* Input */
+static ZSTATE FILE* input       = NULL;
+static ZSTATE int   exit_at_eof = 1;
+static ZSTATE int   echo        = 1;
+
+/* Output */
+static ZSTATE FILE* output = NULL;
+static ZSTATE int   column = 0;
+static ZSTATE int   pix_y  = -1;
+
+static ZSTATE int grid[GRID_LINES][BATCH_COLUMNS];
+static ZSTATE int grid_dirty = 0;
+
+static ZSTATE struct batchwin
+{
+  int top, height;
+  int xpos, ypos;
+  int fore, back;
+  int style;
+} win[3];
+static ZSTATE int cur_win = 0;
+
+/* Where display_exit goes when a story is being run by batch_run */
+static ZSTATE jmp_buf* exit_jmp = NULL;
+static ZSTATE int      exit_code;
+
+#define CURWIN win[cur_win]
+#define OUTPUT (output!=NULL?output:stdout)
+
+/***                           ----// 888 \\----                           ***/
+
+/* Misc functions */
+
+static inline int istrlen(const int* string)
+{
+  int x = 0;
+
+  while (string[x] != 0) x++;
+  return x;
+}
+
+static void put_utf8(int chr)
+{
+  if (chr < 0)
+    chr = '?';
+
+  if (chr < 0x80)
+    {
+      putc(chr, OUTPUT);
+    }
+  else if (chr < 0x800)
+    {
+      putc(0xc0|(chr>>6), OUTPUT);
+      putc(0x80|(chr&0x3f), OUTPUT);
+    }
+  else if (chr < 0x10000)
+    {
+      putc(0xe0|(chr>>12), OUTPUT);
+      putc(0x80|((chr>>6)&0x3f), OUTPUT);
+      putc(0x80|(chr&0x3f), OUTPUT);
+    }
+  else
+    {
+      putc(0xf0|((chr>>18)&0x7), OUTPUT);
+      putc(0x80|((chr>>12)&0x3f), OUTPUT);
+      putc(0x80|((chr>>6)&0x3f), OUTPUT);
+      putc(0x80|(chr&0x3f), OUTPUT);
+    }
+}
+
+/* Decodes up to max characters of UTF-8; stray bytes are taken as Latin-1 */
+static int get_utf8(const unsigned char* src, int* dest, int max)
+{
+  int len = 0;
+
+  while (*src != 0 && len < max)
+    {
+      int chr, extra;
+
+      chr = *(src++);
+      if (chr >= 0xf0 && chr < 0xf8)
+	{ extra = 3; chr &= 0x07; }
+      else if (chr >= 0xe0)
+	{ extra = 2; chr &= 0x0f; }
+      else if (chr >= 0xc0)
+	{ extra = 1; chr &= 0x1f; }
+      else
+	extra = 0;
+
+      if (chr >= 0xf8)
+	extra = 0;
+
+      while (extra > 0 && (*src&0xc0) == 0x80)
+	{
+	  chr = (chr<<6)|(*(src++)&0x3f);
+	  extra--;
+	}
+
+      if (chr >= 32)
+	dest[len++] = chr;
+    }
+
+  return len;
+}
+
+/* Writes out the upper windows, if they've changed since the last time */
+static void flush_grid(void)
+{
+  int x, y, len;
+
+  if (!grid_dirty || column != 0)
+    return;
+  grid_dirty = 0;
+
+  for (y=0; y<win[0].top && y<GRID_LINES; y++)
+    {
+      for (len=BATCH_COLUMNS; len>0 && grid[y][len-1] == ' '; len--);
+
+      for (x=0; x<len; x++)
+	put_utf8(grid[y][x]);
+      putc('\n', OUTPUT);
+    }
+}
+
+static void clear_grid(int top, int bottom)
+{
+  int x, y;
+
+  if (top < 0)
+    top = 0;
+  if (bottom > GRID_LINES)
+    bottom = GRID_LINES;
+
+  for (y=top; y<bottom; y++)
+    for (x=0; x<BATCH_COLUMNS; x++)
+      grid[y][x] = ' ';
+
+  grid_dirty = 1;
+}
+
+/* Gives up when we run out of input */
+static void batch_eof(void)
+{
+  flush_grid();
+  if (column != 0)
+    putc('\n', OUTPUT);
+
+  display_exit(0);
+}
+
+static void batch_readline(int* buf, int buflen)
+{
+  static ZSTATE char line[1024];
+  int len;
+
+  flush_grid();
+  fflush(OUTPUT);
+
+  if (input == NULL)
+    input = stdin;
+
+  while (fgets(line, 1024, input) == NULL)
+    {
+      if (input == stdin || exit_at_eof)
+	batch_eof();
+
+      fclose(input);
+      input = stdin;
+#ifdef HAVE_UNISTD_H
+      echo = !isatty(0);
+#endif
+    }
+
+  len = get_utf8((unsigned char*)line, buf, buflen);
+  buf[len] = 0;
+}
+
+/***                           ----// 888 \\----                           ***/
+
+/* Printing & housekeeping functions */
+
+void printf_debug(char* format, ...)
+{
+  va_list  ap;
+
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+}
+
+void printf_error(char* format, ...)
+{
+  va_list  ap;
+
+  va_start(ap, format);
+  vfprintf(stderr, format, ap);
+  va_end(ap);
+}
+
+void printf_info(char* format, ...)
+{
+  va_list  ap;
+
+  va_start(ap, format);
+  vfprintf(stdout, format, ap);
+  va_end(ap);
+}
+
+void printf_info_done(void) { }
+void printf_error_done(void) { }
+
+void display_exit(int code)
+{
+  fflush(OUTPUT);
+
+  if (exit_jmp != NULL)
+    {
+      exit_code = code;
+      longjmp(*exit_jmp, 1);
+    }
+  exit(code);
+}
+
+void batch_set_input(const char* commands, int eof)
+{
+  exit_at_eof = eof;
+
+  if (input != NULL && input != stdin)
+    fclose(input);
+  input = NULL;
+
+  if (commands != NULL)
+    {
+      input = fopen(commands, "r");
+      if (input == NULL)
+	zmachine_fatal("Unable to open command file '%s'", commands);
+    }
+#ifdef HAVE_UNISTD_H
+  else
+    {
+      echo = !isatty(0);
+    }
+#endif
+}
+
+void batch_set_output(FILE* out)
+{
+  output = out;
+}
+
+int batch_run(void (*run)(void* data), void* data)
+{
+  jmp_buf env;
+
+  exit_jmp = &env;
+  if (setjmp(env) == 0)
+    {
+      run(data);
+      exit_code = 0;
+    }
+  exit_jmp = NULL;
+
+  fflush(OUTPUT);
+  return exit_code;
+}
+
+/***                           ----// 888 \\----                           ***/
+
+/* Output functions */
+
+void display_is_v6(void)
+{
+  is_v6 = 1;
+}
+
+void display_clear(void)
+{
+  int x;
+
+  for (x=0; x<3; x++)
+    {
+      win[x].top    = 0;
+      win[x].height = 0;
+      win[x].xpos   = 0;
+      win[x].ypos   = 0;
+      win[x].fore   = rc_get_foreground();
+      win[x].back   = rc_get_background();
+      win[x].style  = x==0?0:4;
+    }
+  win[0].height = BATCH_LINES;
+
+  clear_grid(0, GRID_LINES);
+  grid_dirty = 0;
+  cur_win = 0;
+}
+
+void display_prints(const int* str)
+{
+  int x;
+
+#ifdef SUPPORT_VERSION_6
+  if (is_v6)
+    {
+      v6_prints(str);
+      return;
+    }
+#endif
+
+  if (cur_win == 0)
+    {
+      for (x=0; str[x] != 0; x++)
+	{
+	  flush_grid();
+
+	  if (str[x] == 10 || str[x] == 13)
+	    {
+	      putc('\n', OUTPUT);
+	      column = 0;
+	    }
+	  else
+	    {
+	      put_utf8(str[x]);
+	      column++;
+	    }
+	}
+    }
+  else
+    {
+      for (x=0; str[x] != 0; x++)
+	{
+	  if (str[x] == 10 || str[x] == 13)
+	    {
+	      CURWIN.xpos = 0;
+	      CURWIN.ypos++;
+	    }
+	  else
+	    {
+	      if (CURWIN.ypos >= 0 && CURWIN.ypos < GRID_LINES &&
+		  CURWIN.xpos >= 0 && CURWIN.xpos < BATCH_COLUMNS)
+		grid[CURWIN.ypos][CURWIN.xpos] = str[x];
+	      CURWIN.xpos++;
+	    }
+	}
+      grid_dirty = 1;
+    }
+}
+
+void display_printc(int ch)
+{
+  int str[2];
+
+  str[0] = ch;
+  str[1] = 0;
+  display_prints(str);
+}
+
+void display_prints_c(const char* str)
+{
+  int* txt;
+  int x, len;
+
+  len = strlen(str);
+
+  txt = malloc((len+1)*sizeof(int));
+  for (x=0; x<len; x++)
+    {
+      txt[x] = (unsigned char)str[x];
+    }
+  txt[len] = 0;
+  display_prints(txt);
+  free(txt);
+}
+
+void display_printf(const char* format, ...)
+{
+  va_list  ap;
+  char     string[512];
+
+  va_start(ap, format);
+  vsnprintf(string, 512, format, ap);
+  va_end(ap);
+
+  display_prints_c(string);
+}
+
+void display_erase_window(void)
+{
+  if (cur_win != 0)
+    clear_grid(CURWIN.top, CURWIN.top+CURWIN.height);
+}
+
+void display_erase_line(int val)
+{
+  int x;
+
+  if (cur_win == 0 || CURWIN.ypos < 0 || CURWIN.ypos >= GRID_LINES)
+    return;
+
+  if (val == 1)
+    val = BATCH_COLUMNS;
+  else
+    val += CURWIN.xpos;
+  if (val > BATCH_COLUMNS)
+    val = BATCH_COLUMNS;
+
+  for (x=CURWIN.xpos; x<val; x++)
+    grid[CURWIN.ypos][x] = ' ';
+  grid_dirty = 1;
+}
+
+/* Debug functions */
+
+static ZSTATE int old_win;
+static ZSTATE int old_fore, old_back;
+static ZSTATE int old_style;
+
+void display_sanitise(void)
+{
+#ifdef SUPPORT_VERSION_6
+  if (is_v6)
+    {
+      v6_reset_windows();
+      return;
+    }
+#endif
+
+  old_win = cur_win;
+
+  display_set_window(0);
+
+  old_fore  = CURWIN.fore;
+  old_back  = CURWIN.back;
+  old_style = CURWIN.style;
+
+  display_set_style(0);
+}
+
+void display_desanitise(void)
+{
+  display_set_colour(old_fore, old_back);
+  display_set_style(old_style);
+  display_set_window(old_win);
+}
+
+void display_has_restarted(void)
+{
+}
+
+/* Style functions */
+
+int display_set_font(int font)
+{
+  switch (font)
+    {
+    case -1:
+      display_set_style(-16);
+      break;
+
+    default:
+      break;
+    }
+
+  return 0;
+}
+
+int display_set_style(int style)
+{
+  int old_style;
+
+#ifdef SUPPORT_VERSION_6
+  if (is_v6)
+    return v6_set_style(style);
+#endif
+
+  old_style = CURWIN.style;
+
+  if (style == 0)
+    CURWIN.style = 0;
+  else if (style > 0)
+    CURWIN.style |= style;
+  else
+    CURWIN.style &= ~(-style);
+
+  return old_style;
+}
+
+void display_set_colour(int fore, int back)
+{
+#ifdef SUPPORT_VERSION_6
+  if (is_v6)
+    {
+      v6_set_colours(fore, back);
+      return;
+    }
+#endif
+
+  if (fore == -1)
+    fore = rc_get_foreground();
+  if (back == -1)
+    back = rc_get_background();
+  if (fore == -2)
+    fore = CURWIN.fore;
+  if (back == -2)
+    back = CURWIN.back;
+
+  CURWIN.fore = fore;
+  CURWIN.back = back;
+}
+
+/* V5 window management functions */
+
+void display_split(int lines, int window)
+{
+  if (CURWIN.top + lines > GRID_LINES)
+    lines = GRID_LINES - CURWIN.top;
+  if (lines < 0)
+    lines = 0;
+
+  win[window].top    = CURWIN.top;
+  win[window].height = lines;
+  win[window].xpos   = 0;
+  win[window].ypos   = CURWIN.top;
+
+  CURWIN.top    += lines;
+  CURWIN.height -= lines;
+  grid_dirty = 1;
+}
+
+void display_join(int window1, int window2)
+{
+  if (win[window1].top != win[window2].top + win[window2].height)
+    return; /* Windows can't be joined */
+
+  win[window1].top     = win[window2].top;
+  win[window1].height += win[window2].height;
+  win[window2].height  = 0;
+}
+
+void display_set_window(int window)
+{
+  win[window].fore  = CURWIN.fore;
+  win[window].back  = CURWIN.back;
+  win[window].style = CURWIN.style;
+  cur_win = window;
+}
+
+int display_get_window(void)
+{
+  return cur_win;
+}
+
+void display_set_cursor(int x, int y)
+{
+  CURWIN.xpos = x;
+  CURWIN.ypos = y;
+}
+
+int display_get_cur_x(void)
+{
+  if (cur_win == 0)
+    return column;
+  return CURWIN.xpos;
+}
+
+int display_get_cur_y(void)
+{
+  if (cur_win == 0)
+    return BATCH_LINES-1;
+  return CURWIN.ypos;
+}
+
+void display_force_fixed(int window, int val)
+{
+}
+
+void display_flush(void)
+{
+  fflush(OUTPUT);
+}
+
+/***                           ----// 888 \\----                           ***/
+
+/* Misc functions */
+
+void display_initialise(void)
+{
+  is_v6  = 0;
+  column = 0;
+  pix_y  = -1;
+
+  display_clear();
+}
+
+void display_reinitialise(void)
+{
+  display_clear();
+}
+
+void display_finalise(void)
+{
+  fflush(OUTPUT);
+}
+
+int display_check_char(int chr)
+{
+  return 1;
+}
+
+/* Input functions */
+
+int display_readline(int* buf, int buflen, long int timeout)
+{
+  int line[256];
+
+  /* 
+   * Any text already in the buffer is what the user would see in the
+   * input line: a blank command accepts it, anything else replaces it
+   */
+  batch_readline(line, buflen<255?buflen:255);
+  if (line[0] != 0)
+    memcpy(buf, line, (istrlen(line)+1)*sizeof(int));
+
+  if (echo)
+    display_prints(buf);
+  else
+    column = 0;
+  display_printc(10);
+
+  return 10;
+}
+
+int display_readchar(long int timeout)
+{
+  int chr[2];
+
+  batch_readline(chr, 1);
+  if (chr[0] == 0)
+    return 13;
+
+  return chr[0];
+}
+
+ZDisplay* display_get_info(void)
+{
+  static ZSTATE ZDisplay dis;
+
+  dis.status_line   = 1;
+  dis.can_split     = 1;
+  dis.variable_font = 0;
+  dis.colours       = 0;
+  dis.boldface      = 0;
+  dis.italic        = 0;
+  dis.fixed_space   = 1;
+  dis.sound_effects = 0;
+  dis.timed_input   = 1;
+  dis.mouse         = 0;
+
+  dis.lines         = BATCH_LINES;
+  dis.columns       = BATCH_COLUMNS;
+  dis.width         = BATCH_COLUMNS;
+  dis.height        = BATCH_LINES;
+  dis.font_width    = 1;
+  dis.font_height   = 1;
+  dis.pictures      = 0;
+  dis.fore          = rc_get_foreground();
+  dis.back          = rc_get_background();
+  dis.fore_true     = 0x0000;
+  dis.back_true     = 0x7fff;
+
+  return &dis;
+}
+
+void display_set_title(const char* title)
+{
+}
+
+void display_update(void)
+{
+  fflush(OUTPUT);
+}
+
+void display_beep(void)
+{
+}
+
+void display_terminating(unsigned char* table)
+{
+}
+
+int display_get_mouse_x(void)
+{
+  return 0;
+}
+
+int display_get_mouse_y(void)
+{
+  return 0;
+}
+
+/***                           ----// 888 \\----                           ***/
+
+/*
+ * Pixmap display: text is written out as it is plotted, a line at a
+ * time, and graphics are dropped
+ */
+
+int display_init_pixmap(int width, int height)
+{
+  pix_y = -1;
+  return 1;
+}
+
+void display_plot_rect(int x, int y, int width, int height)
+{
+}
+
+void display_scroll_region(int x, int y, int width, int height,
+			   int xoff, int yoff)
+{
+}
+
+void display_pixmap_cols(int fg, int bg)
+{
+}
+
+int display_get_pix_colour(int x, int y)
+{
+  return 0;
+}
+
+void display_plot_gtext(const int* text, int len, int style, int x, int y)
+{
+  int pos;
+
+  if (y != pix_y && column != 0)
+    {
+      putc('\n', OUTPUT);
+      column = 0;
+    }
+  pix_y = y;
+
+  for (pos=0; pos<len; pos++)
+    {
+      put_utf8(text[pos]);
+      column++;
+    }
+}
+
+void display_plot_image(BlorbImage* img, int x, int y)
+{
+}
+
+float display_measure_text(const int* text, int len, int style)
+{
+  return len;
+}
+
+float display_get_font_width(int style)
+{
+  return 1;
+}
+
+float display_get_font_height(int style)
+{
+  return 1;
+}
+
+float display_get_font_ascent(int style)
+{
+  return 1;
+}
+
+float display_get_font_descent(int style)
+{
+  return 0;
+}
+
+void display_wait_for_more(void)
+{
+}
+
+void display_read_mouse(void)
+{
+}
+
+int display_get_pix_mouse_b(void)
+{
+  return 0;
+}
+
+int display_get_pix_mouse_x(void)
+{
+  return 0;
+}
+
+int display_get_pix_mouse_y(void)
+{
+  return 0;
+}
+
+void display_set_input_pos(int style, int x, int y, int width)
+{
+}
+
+void display_set_mouse_win(int x, int y, int width, int height)
+{
+}
+
+/***                           ----// 888 \\----                           ***/
+
+extern int zoom_main(int, char**);
+
+int main(int argc, char** argv)
+{
+  return zoom_main(argc, argv);
+}
+
+#endif
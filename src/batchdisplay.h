@@ -0,0 +1,46 @@
+/*
+ *  A Z-Machine
+ *  Copyright (C) 2000 Andrew Hunter
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Headless display, for running stories from scripts
+ */
+
+#ifndef __BATCHDISPLAY_H
+#define __BATCHDISPLAY_H
+
+/*
+ * Sets where input comes from. commands is a file of newline-separated
+ * commands (NULL for stdin); if exit_at_eof is set the interpreter
+ * exits cleanly when it runs out of commands, otherwise it carries on
+ * reading from stdin.
+ */
+extern void batch_set_input(const char* commands, int exit_at_eof);
+
+/*
+ * Sets where the transcript of the story goes (NULL for stdout)
+ */
+extern void batch_set_output(FILE* out);
+
+/*
+ * Calls run(data), trapping display_exit. Returns the exit code the
+ * story finished with (0 if run returned normally)
+ */
+extern int batch_run(void (*run)(void* data), void* data);
+
+#endif
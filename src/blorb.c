@@ -31,7 +31,13 @@
 
 #include "image.h"
 
-#define MAX_IMAGES 32
+/*
+ * Budget (in bytes) for the pictures and scaled renders kept at once.
+ * A decoded picture is charged for its unscaled RGBA data; renders are
+ * charged whatever the display says they use.
+ */
+#define IMAGE_CACHE_SIZE (32*1024*1024)
+#define IMAGE_COST(x) (4*(long)(x)->width*(long)(x)->height)
 
 static inline int cmp_token(const char* data, const char* token)
 {
@@ -482,9 +488,98 @@ BlorbFile* blorb_loadfile(ZFile* file)
   return res;
 }
 
-static int         nloaded = 0;
-static BlorbImage* image_queue[MAX_IMAGES];
-static BlorbImage* last_img = NULL; /* Last non-adaptive image */
+/*
+ * The picture cache holds the decoded pictures and the scaled copies
+ * the display renders from them, in most-recently-used order. Entries
+ * are dropped from the far end once they use more than IMAGE_CACHE_SIZE
+ * bytes. The last non-adaptive picture is kept regardless, as adaptive
+ * pictures take their palette from it: when it changes, everything made
+ * from an adaptive picture goes, so a render is only ever found for the
+ * palette it was made with.
+ */
+typedef struct cache_entry
+{
+  BlorbImage* img;
+  void*       render;   /* NULL for the decoded picture itself */
+  int         n, d;     /* Scale and filter the render was made with */
+  int         filter;
+  long        cost;     /* Bytes charged to the cache */
+  void      (*destroy)(void* render);
+} cache_entry;
+
+static ZSTATE int          nloaded    = 0;
+static ZSTATE int          queue_size = 0;
+static ZSTATE long         cache_used = 0;
+static ZSTATE cache_entry* image_queue = NULL;
+static ZSTATE BlorbImage*  last_img = NULL; /* Last non-adaptive image */
+
+/* Drops a reference to an image, unloading it if it was the last */
+static void release_image(BlorbImage* img)
+{
+  img->usage_count--;
+  if (img->usage_count <= 0)
+    {
+      image_unload(img->loaded);
+      img->loaded      = NULL;
+      img->usage_count = 0;
+    }
+}
+
+/* Removes entry x from the queue */
+static void dequeue_image(int x)
+{
+  cache_entry entry;
+
+  entry = image_queue[x];
+
+  nloaded--;
+  memmove(image_queue + x,
+	  image_queue + x + 1,
+	  sizeof(cache_entry)*(nloaded-x));
+
+  cache_used -= entry.cost;
+  if (entry.render != NULL)
+    (entry.destroy)(entry.render);
+  else
+    release_image(entry.img);
+}
+
+/* Moves entry x to the front of the queue */
+static void touch_entry(int x)
+{
+  cache_entry entry;
+
+  entry = image_queue[x];
+  memmove(image_queue+1, image_queue,
+	  sizeof(cache_entry)*x);
+  image_queue[0] = entry;
+}
+
+/* Adds an entry at the front of the queue */
+static void push_entry(cache_entry* entry)
+{
+  if (nloaded >= queue_size)
+    {
+      queue_size += 32;
+      image_queue = realloc(image_queue, sizeof(cache_entry)*queue_size);
+    }
+
+  memmove(image_queue+1, image_queue,
+	  sizeof(cache_entry)*nloaded);
+  nloaded++;
+
+  image_queue[0] = *entry;
+  cache_used += entry->cost;
+}
+
+/* Frees anything that has dropped off the end of the queue */
+static void trim_cache(void)
+{
+  while (nloaded > 1 && cache_used > IMAGE_CACHE_SIZE)
+    {
+      dequeue_image(nloaded-1);
+    }
+}
 
 BlorbImage* blorb_findimage(BlorbFile* blb, int number)
 {
@@ -526,7 +621,6 @@ BlorbImage* blorb_findimage(BlorbFile* blb, int number)
 
       res->loaded = image_load(blb->source, res->file_offset, res->file_len,
 			       plte);
-      res->usage_count++;
 
       if (res->loaded == NULL)
 	return res;
@@ -534,68 +628,101 @@ BlorbImage* blorb_findimage(BlorbFile* blb, int number)
       res->height = image_height(res->loaded);
     }
 
-  if (!res->is_adaptive)
+  if (!res->is_adaptive && res != last_img)
     {
       if (last_img != NULL)
 	{
-	  if (image_cmp_palette(last_img->loaded, res->loaded) == 0)
+	  if (last_img->loaded == NULL ||
+	      image_cmp_palette(last_img->loaded, res->loaded) == 0)
 	    {
-	      int x;
-
-	      /* Unload any adaptive images that are currently loaded */
-	      for (x=0; x<blb->index.npictures; x++)
+	      /* Adaptive images (and renders) made with the old palette are now wrong */
+	      x = 0;
+	      while (x<nloaded)
 		{
-		  if (blb->index.picture[x].loaded != NULL &&
-		      blb->index.picture[x].is_adaptive)
-		    {
-		      image_unload(blb->index.picture[x].loaded);
-
-		      blb->index.picture[x].loaded = NULL;
-		    }
+		  if (image_queue[x].img->is_adaptive)
+		    dequeue_image(x);
+		  else
+		    x++;
 		}
 	    }
 
 	  /* Last non-adaptive image is no longer in use... */
-	  last_img->usage_count--;
-	  if (last_img->usage_count <= 0)
-	    image_unload(last_img->loaded);
+	  release_image(last_img);
 	}
       /* Store this as the new non-adaptive image */
       last_img = res;
       last_img->usage_count++;
     }
 
-  /* Delete any old entry for this image in the queue */
+  /* Move this image to the front of the queue */
   for (x=0; x<nloaded; x++)
     {
-      if (image_queue[x] == res)
-	{
-	  nloaded--;
-	  memmove(image_queue + x,
-		  image_queue + x + 1,
-		  sizeof(BlorbImage*)*(nloaded-x));
-	  break;
-	}
+      if (image_queue[x].img == res && image_queue[x].render == NULL)
+	break;
     }
 
-  /* Free any images that have dropped off the end of the queue */
-  if (nloaded >= MAX_IMAGES)
+  if (x < nloaded)
     {
-      nloaded--;
-      image_queue[nloaded]->usage_count--;
-      if (image_queue[nloaded]->usage_count <= 0)
-	image_unload(image_queue[nloaded]->loaded);
-      image_queue[nloaded]->loaded = NULL;
+      touch_entry(x);
     }
+  else
+    {
+      cache_entry entry;
 
-  memmove(image_queue+1, image_queue,
-	  sizeof(BlorbImage*)*nloaded);
-  nloaded++;
-  image_queue[0] = res;
+      entry.img     = res;
+      entry.render  = NULL;
+      entry.n       = entry.d = 1;
+      entry.filter  = -1;
+      entry.cost    = IMAGE_COST(res);
+      entry.destroy = NULL;
+
+      res->usage_count++;
+      push_entry(&entry);
+    }
+
+  trim_cache();
 
   return res;
 }
 
+void* blorb_findrender(BlorbImage* img, int n, int d, int filter)
+{
+  int x;
+
+  for (x=0; x<nloaded; x++)
+    {
+      if (image_queue[x].img    == img &&
+	  image_queue[x].render != NULL &&
+	  image_queue[x].n      == n &&
+	  image_queue[x].d      == d &&
+	  image_queue[x].filter == filter)
+	{
+	  touch_entry(x);
+	  return image_queue[0].render;
+	}
+    }
+
+  return NULL;
+}
+
+void blorb_storerender(BlorbImage* img, int n, int d, int filter,
+		       void* render, long bytes,
+		       void (*destroy)(void* render))
+{
+  cache_entry entry;
+
+  entry.img     = img;
+  entry.render  = render;
+  entry.n       = n;
+  entry.d       = d;
+  entry.filter  = filter;
+  entry.cost    = bytes;
+  entry.destroy = destroy;
+
+  push_entry(&entry);
+  trim_cache();
+}
+
 BlorbSound* blorb_findsound(BlorbFile* blorb, int num)
 {
   int x;
@@ -625,6 +752,16 @@ void blorb_closefile(BlorbFile* blorb)
 	}
 
       free(blorb->index.picture);
+
+      /* Nothing in the queue is loaded any more */
+      for (x=0; x<nloaded; x++)
+	{
+	  if (image_queue[x].render != NULL)
+	    (image_queue[x].destroy)(image_queue[x].render);
+	}
+      nloaded    = 0;
+      cache_used = 0;
+      last_img   = NULL;
     }
 
   if (blorb->index.sound != NULL)
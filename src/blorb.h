@@ -160,4 +160,15 @@ void        blorb_closefile   (BlorbFile* file);
 BlorbImage* blorb_findimage   (BlorbFile* blorb, int num);
 BlorbSound* blorb_findsound   (BlorbFile* blorb, int num);
 
+/*
+ * Scaled renderings of a picture, made by the display. These share the
+ * picture cache with the decoded pictures: a render is charged bytes,
+ * and destroy is called when it drops out (which may happen on any
+ * later call to blorb_findimage or blorb_storerender).
+ */
+void*       blorb_findrender  (BlorbImage* img, int n, int d, int filter);
+void        blorb_storerender (BlorbImage* img, int n, int d, int filter,
+			       void* render, long bytes,
+			       void (*destroy)(void* render));
+
 #endif
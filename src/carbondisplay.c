@@ -489,6 +489,7 @@ static void resize_window()
 	}
 
       CURWIN.line = CURWIN.lastline = NULL;
+      CURWIN.n_lines = 0;
 
       if (CURWIN.text != NULL)
 	{
@@ -1412,47 +1413,6 @@ static void draw_window(int   win,
 
       line = text_win[win].line;
 
-      /* Free any lines that scrolled off ages ago */
-      if (line != NULL)
-	{
-	  while (line->baseline < -32768)
-	    {
-	      struct line* n;
-	      
-	      n = line->next;
-	      if (n == NULL)
-		break;
-	      
-	      if (text_win[win].topline == line)
-		text_win[win].topline = NULL;
-	      
-	      if (n->start != line->start)
-		{
-		  struct text* nt;
-		  
-		  if (line->start != text_win[win].text)
-		    zmachine_fatal("Programmer is a spoon");
-		  text_win[win].text = n->start;
-		  
-		  text = line->start;
-		  while (text != n->start)
-		    {
-		      if (text == NULL)
-			zmachine_fatal("Programmer is a spoon");
-		      nt = text->next;
-		      free(text);
-		      text = nt;
-		    }
-		}
-	      
-	      
-	      free(line);
-	      text_win[win].line = n;
-
-	      line = n;
-	    }
-	}
-
       /* Skip to the first visible line */
       if (line != NULL)
 	{
@@ -3523,7 +3483,8 @@ void display_plot_image(BlorbImage* img, int x, int y)
       if (!LockPixels(GetGWorldPixMap(pixmap)))
 	zmachine_fatal("Unable to lock pixmap");
       SetGWorld(pixmap, nil);
-      image_draw_carbon(img->loaded, pixmap, x, y, sc_n, sc_d);
+      image_draw_carbon(img->loaded, pixmap, x, y, sc_n, sc_d,
+			rc_get_resample());
 
       UnlockPixels(GetGWorldPixMap(pixmap));
 
@@ -121,7 +121,8 @@ extern enum carbon_file_type carbon_type_fsref(FSRef* file);
 extern void image_draw_carbon(image_data* img, 
 			      CGrafPtr port, 
 			      int x, int y,
-			      int n, int d);
+			      int n, int d,
+			      int filter);
 
 /* Font information */
 typedef struct carbon_font
@@ -197,6 +197,18 @@ static void pref_write_block(FILE*    f,
     {
       fprintf(f, "  antialias %s\n", game->antialias?"yes":"no");
     }
+
+  if (game->scrollback != -1)
+    {
+      fprintf(f, "  scrollback %i\n", game->scrollback);
+    }
+
+  if (game->resample != -1)
+    {
+      static const char* filters[] = { "box", "bilinear", "lanczos" };
+
+      fprintf(f, "  resample %s\n", filters[game->resample]);
+    }
   fprintf(f, "}\n\n");
 }
 
@@ -1649,6 +1661,8 @@ void carbon_prefs_set_resources(char* path)
 	  game->xsize       = -1;
 	  game->ysize       = -1;
 	  game->antialias   = -1;
+	  game->scrollback  = -1;
+	  game->resample    = -1;
 	}
       else
 	{
@@ -1778,6 +1792,8 @@ static void pref_setup(void)
 	  game->xsize       = -1;
 	  game->ysize       = -1;
 	  game->antialias   = -1;
+	  game->scrollback  = -1;
+	  game->resample    = -1;
 	}
       else
 	{
@@ -27,6 +27,7 @@
 
 #include "debug.h"
 #include "zscii.h"
+#include "interp.h"
 
 #include <signal.h>
 
@@ -465,6 +466,7 @@ int debug_set_breakpoint(int address,
 {
   debug_breakpoint* bp;
   int pos;
+  int top, middle, bottom;
 
   bp = debug_get_breakpoint(address);
   if (bp != NULL)
@@ -481,12 +483,20 @@ int debug_set_breakpoint(int address,
   printf_debug("Setting BP @ %04x\n", address);
 #endif
   
-  pos = 0;
-  
   /* Find the breakpoint we should insert this new one before */
-  while (pos < debug_nbps && debug_bplist[pos].address < address) {
-    pos++;
+  top    = debug_nbps-1;
+  bottom = 0;
+  
+  while (top >= bottom) {
+    middle = (top + bottom) >> 1;
+
+    if (debug_bplist[middle].address < address) {
+      bottom = middle + 1;
+    } else {
+      top = middle - 1;
+    }
   }
+  pos = bottom;
 
   /* Add a new breakpoint */
   debug_bplist = realloc(debug_bplist,
@@ -507,6 +517,9 @@ int debug_set_breakpoint(int address,
 
   /* Add a breakpoint instruction (we use status_nop, as it's just one byte) */
   machine.memory[address] = 0xbc; /* status_nop, our breakpoint */
+#ifdef PREDECODE
+  zmachine_predecode_invalidate(address);
+#endif
 
   debug_nbps++;
   
@@ -564,6 +577,9 @@ int debug_clear_breakpoint(debug_breakpoint* bp)
   if (bp->usage <= 0)
     {
       machine.memory[bp->address] = bp->original;
+#ifdef PREDECODE
+      zmachine_predecode_invalidate(bp->address);
+#endif
       debug_nbps--;
       memmove(debug_bplist + x, debug_bplist + x + 1,
 	      sizeof(debug_breakpoint)*(debug_nbps-x));
@@ -579,9 +595,11 @@ int debug_clear_breakpoint(debug_breakpoint* bp)
 
 debug_symbols debug_syms = { 
   0, NULL, NULL, NULL, NULL, 0, NULL, 0,
-  0
+  0, 0, 0, NULL
 };
 
+static int routine_size = 0; /* Space allocated in debug_syms.routine */
+
 static void debug_add_symbol(char* name,
 			     debug_symbol* sym)
 {
@@ -615,6 +633,50 @@ static void debug_add_symbol(char* name,
   free(storename);
 }
 
+/* Sorts the lines of a routine by address (they usually already are) */
+static void sort_lines(debug_routine* r)
+{
+  int x, y;
+
+  for (x=1; x<r->nlines; x++)
+    {
+      debug_line l;
+
+      if (r->line[x].address >= r->line[x-1].address)
+	continue;
+
+      l = r->line[x];
+      for (y=x; y>0 && r->line[y-1].address > l.address; y--)
+	r->line[y] = r->line[y-1];
+      r->line[y] = l;
+    }
+}
+
+static int cmp_routine_start(const void* a, const void* b)
+{
+  const debug_routine* ra = debug_syms.routine + *(const int*)a;
+  const debug_routine* rb = debug_syms.routine + *(const int*)b;
+
+  if (ra->start < rb->start)
+    return -1;
+  if (ra->start > rb->start)
+    return 1;
+  return *(const int*)a - *(const int*)b;
+}
+
+/* Builds the index used to find routines by address */
+static void index_routines(void)
+{
+  int x;
+
+  debug_syms.by_address = realloc(debug_syms.by_address,
+				  sizeof(int)*(debug_syms.nroutines+1));
+  for (x=0; x<debug_syms.nroutines; x++)
+    debug_syms.by_address[x] = x;
+  qsort(debug_syms.by_address, debug_syms.nroutines, sizeof(int),
+	cmp_routine_start);
+}
+
 #ifdef REMOTE_BREAKPOINT
 static void debug_sigusr1(int sig) {
 	machine.force_breakpoint = 1;
@@ -1079,9 +1141,13 @@ void debug_load_symbols(char* filename,
 		display_printf("=! Out of order routines\n");
 	      }
 	    
-	    debug_syms.routine = realloc(debug_syms.routine,
-					 sizeof(debug_routine)*
-					 (debug_syms.nroutines+1));
+	    if (debug_syms.nroutines >= routine_size)
+	      {
+		routine_size = routine_size*2 + 64;
+		debug_syms.routine = realloc(debug_syms.routine,
+					     sizeof(debug_routine)*
+					     routine_size);
+	      }
 
 	    debug_syms.routine[debug_syms.nroutines] = r;
 	    this_routine = debug_syms.routine + debug_syms.nroutines;
@@ -1169,12 +1235,17 @@ void debug_load_symbols(char* filename,
 	{
 	  debug_syms.routine[x].line[y].address += debug_syms.codearea;
 	}
+
+      sort_lines(debug_syms.routine + x);
     }
 
+  index_routines();
+
   free(db_file);
   return;
 
  failed:
+  index_routines();
   free(db_file);
 }
 
@@ -1185,34 +1256,60 @@ void debug_load_symbols(char* filename,
 debug_address debug_find_address(int address)
 {
   debug_address res;
-  int x;
+  int top, middle, bottom;
+  debug_routine* r;
 
   res.routine = NULL;
   res.line    = NULL;
   res.line_no = -1;
 
-  for (x=0; x<debug_syms.nroutines; x++)
+  /* Find the last routine starting before the address */
+  r      = NULL;
+  top    = debug_syms.nroutines-1;
+  bottom = 0;
+
+  while (top >= bottom)
     {
-      if (address > debug_syms.routine[x].start &&
-	  address < debug_syms.routine[x].end)
+      middle = (top + bottom)>>1;
+
+      if (debug_syms.routine[debug_syms.by_address[middle]].start < address)
 	{
-	  res.routine = debug_syms.routine + x;
-	  break;
+	  r      = debug_syms.routine + debug_syms.by_address[middle];
+	  bottom = middle+1;
+	}
+      else
+	{
+	  top = middle-1;
 	}
     }
 
-  if (res.routine == NULL)
+  if (r == NULL || address >= r->end)
     return res;
 
-  for (x=0; x<res.routine->nlines; x++)
+  res.routine = r;
+
+  /* Find the last line starting at or before the address */
+  top    = r->nlines-1;
+  bottom = 0;
+
+  while (top >= bottom)
     {
-      if (res.routine->line[x].address > address)
-	break;
+      middle = (top + bottom)>>1;
 
-      res.line_no = x;
-      res.line = res.routine->line + x;
+      if (r->line[middle].address <= address)
+	{
+	  res.line_no = middle;
+	  bottom      = middle+1;
+	}
+      else
+	{
+	  top = middle-1;
+	}
     }
 
+  if (res.line_no >= 0)
+    res.line = r->line + res.line_no;
+
   return res;
 }
 
@@ -205,6 +205,8 @@ struct debug_symbols
   ZDWord         codearea;
   ZDWord		 stringarea;
   ZDWord		 largest_object;
+
+  int*           by_address; /* Routine numbers, sorted by start address */
 };
 
 struct debug_address
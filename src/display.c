@@ -32,6 +32,8 @@
 
 #include "v6display.h"
 
+#if WINDOW_SYSTEM != 5
+
 static int is_v6 = 0;
 
 #if defined(V6ASSERT) && defined(SUPPORT_VERSION_6)
@@ -189,8 +191,7 @@ void display_erase_window(void)
       while (text != NULL)
 	{
 	  nexttext = text->next;
-	  free(text->text);
-	  free(text);
+	  format_free_text(text);
 	  text = nexttext;
 	}
       CURWIN.text = CURWIN.lasttext = NULL;
@@ -204,6 +205,7 @@ void display_erase_window(void)
 	  line = nextline;
 	}
       CURWIN.line = CURWIN.topline = CURWIN.lastline = NULL;
+      CURWIN.n_lines = 0;
       
       for (y=(CURWIN.winsy/xfont_y); y<size_y; y++)
 	{
@@ -336,7 +338,7 @@ void display_prints(const int* str)
       if (str[0] == 0)
 	return;
 
-      text = malloc(sizeof(struct text));
+      text = format_new_text(istrlen(str));
 
       if (CURWIN.style&1)
 	{
@@ -348,13 +350,7 @@ void display_prints(const int* str)
 	  text->fg   = CURWIN.fore;
 	  text->bg   = CURWIN.back;
 	}
-      text->spacer = 0;
       text->font   = style_font[(CURSTYLE>>1)&15];
-      text->len    = istrlen(str);
-      text->text   = malloc(sizeof(int)*text->len);
-      text->next   = NULL;
-      text->word   = NULL;
-      text->spoken = 0;
       memcpy(text->text, str, sizeof(int)*text->len);
 
       if (CURWIN.lasttext == NULL)
@@ -583,17 +579,12 @@ void display_split       (int lines, int window)
 	start_y = CURWIN.winsy;
       else
 	{
-	  CURWIN.lasttext->next   = malloc(sizeof(struct text));
+	  CURWIN.lasttext->next   = format_new_text(0);
 	  CURWIN.lasttext         = CURWIN.lasttext->next;
-	  CURWIN.lasttext->next   = NULL;
 	  CURWIN.lasttext->spacer = 1;
 	  CURWIN.lasttext->space  = CURWIN.winsy -
 	    (CURWIN.lastline->baseline + CURWIN.lastline->descent);
-	  CURWIN.lasttext->len    = 0;
-	  CURWIN.lasttext->text   = NULL;
 	  CURWIN.lasttext->font   = style_font[(CURSTYLE>>1)&15];
-	  CURWIN.lasttext->word   = NULL;
-	  CURWIN.lasttext->spoken = 0;
 
 	  if (CURWIN.style&1)
 	    {
@@ -706,3 +697,5 @@ void display_flush(void)
 {
   /* Do nothing at the moment: placeholder function */
 }
+
+#endif
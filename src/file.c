@@ -29,6 +29,15 @@
 #include <stdarg.h>
 #include <sys/stat.h>
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# include <unistd.h>
+# include <sys/mman.h>
+# define CAN_MAP
+# ifndef MAP_ANONYMOUS
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+#endif
+
 #include "file.h"
 #include "zmachine.h"
 
@@ -110,6 +119,71 @@ ZByte* read_block(ZFile* file, int start_pos, int end_pos)
   return block;
 }
 
+#ifdef CAN_MAP
+/* Only needed when a story is mapped, so it isn't worth caching */
+static size_t page_size(void)
+{
+  return sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Size of the address space reserved for a mapping: the whole of the
+ * first 64k is always there, so stray reads past the end of a short
+ * story see zeros rather than a fault
+ */
+static size_t map_length(size_t len)
+{
+  if (len < 0x10000)
+    len = 0x10000;
+  return (len + page_size() - 1) & ~(page_size() - 1);
+}
+#endif
+
+/*
+ * Maps start_pos..end_pos of a file into memory as a private
+ * copy-on-write mapping. Pages that are never written stay shared with
+ * the page cache. Returns NULL if the file can't be mapped.
+ */
+ZByte* map_block(ZFile* file, int start_pos, int end_pos)
+{
+#ifdef CAN_MAP
+  ZByte* base;
+  off_t  offset;
+  size_t skip, len;
+  int    fd;
+
+  fd     = fileno(file->handle);
+  skip   = start_pos % page_size();
+  offset = start_pos - skip;
+  len    = end_pos - start_pos + skip;
+
+  base = mmap(NULL, map_length(len), PROT_READ|PROT_WRITE,
+	      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+  if (mmap(base, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED,
+	   fd, offset) == MAP_FAILED)
+    {
+      munmap(base, map_length(len));
+      return NULL;
+    }
+
+  return base + skip;
+#else
+  return NULL;
+#endif
+}
+
+void unmap_block(ZByte* block, int start_pos, int end_pos)
+{
+#ifdef CAN_MAP
+  size_t skip;
+
+  skip = start_pos % page_size();
+  munmap(block - skip, map_length(end_pos - start_pos + skip));
+#endif
+}
+
 ZByte inline read_byte(ZFile* file)
 {
   return fgetc(file->handle);
@@ -233,6 +307,15 @@ void close_file(ZFile* file)
   free(file);
 }
 
+ZByte* map_block(ZFile* file, int start_pos, int end_pos)
+{
+  return NULL;
+}
+
+void unmap_block(ZByte* block, int start_pos, int end_pos)
+{
+}
+
 ZByte read_byte(ZFile* file)
 {
   ZByte block[1];
@@ -582,6 +665,15 @@ ZByte* read_block(ZFile* file, int start_pos, int end_pos)
   return block;
 }
 
+ZByte* map_block(ZFile* file, int start_pos, int end_pos)
+{
+  return NULL;
+}
+
+void unmap_block(ZByte* block, int start_pos, int end_pos)
+{
+}
+
 ZByte inline read_byte(ZFile* file)
 {
   char byte;
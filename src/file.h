@@ -44,6 +44,8 @@ extern ZUWord read_rword     (ZFile* file);
 extern ZByte* read_page      (ZFile* file, int page_no);
 extern ZByte* read_block     (ZFile* file, int start_pos, int end_pos);
 extern void   read_block2    (ZByte*, ZFile*, int start_pos, int end_pos);
+extern ZByte* map_block      (ZFile* file, int start_pos, int end_pos);
+extern void   unmap_block    (ZByte* block, int start_pos, int end_pos);
 extern void   write_block    (ZFile* file, ZByte* block, int length);
 extern void   write_byte     (ZFile* file, ZByte byte);
 extern void   write_word     (ZFile* file, ZWord word);
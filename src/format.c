@@ -34,6 +34,8 @@
 #include "xfont.h"
 #include "format.h"
 
+#if WINDOW_SYSTEM != 5
+
 /* Fonts */
 xfont** font = NULL;
 int     n_fonts = 0;
@@ -46,9 +48,9 @@ char*         lastspeech = NULL;
 /* Window data structures themselves */
 int cur_win;
 struct window text_win[3] = 
-  { { 0,0, 0,0,0,0, 0,0,0,0, 0,7,0, 7, NULL, NULL, NULL, NULL, NULL, NULL }, 
-    { 0,0, 0,0,0,0, 0,0,0,0, 0,7,0, 7, NULL, NULL, NULL, NULL, NULL, NULL }, 
-    { 0,0, 0,0,0,0, 0,0,0,0, 0,7,0, 7, NULL, NULL, NULL, NULL, NULL, NULL } };
+  { { 0,0, 0,0,0,0, 0,0,0,0, 0,7,0, 7, NULL, NULL, NULL, NULL, NULL, 0, NULL }, 
+    { 0,0, 0,0,0,0, 0,0,0,0, 0,7,0, 7, NULL, NULL, NULL, NULL, NULL, 0, NULL }, 
+    { 0,0, 0,0,0,0, 0,0,0,0, 0,7,0, 7, NULL, NULL, NULL, NULL, NULL, 0, NULL } };
 
 #define CURWIN text_win[cur_win]
 #define CURSTYLE (text_win[cur_win].style|(text_win[cur_win].force_fixed<<3))
@@ -93,6 +95,85 @@ int   read_key   = -1;
 history_item* last_string = NULL;
 history_item* history_pos = NULL;
 
+/*
+ * Text fragments are allocated in one block with their characters, as
+ * there's one of these for every string printed in the main window
+ */
+struct text* format_new_text(int len)
+{
+  struct text* text;
+
+  text = malloc(sizeof(struct text) + sizeof(int)*len);
+
+  text->len    = len;
+  text->text   = (int*)(text+1);
+  text->next   = NULL;
+  text->nwords = 0;
+  text->word   = NULL;
+  text->spacer = 0;
+  text->space  = 0;
+  text->spoken = 0;
+
+  return text;
+}
+
+void format_free_text(struct text* text)
+{
+  free(text->word);
+  free(text);
+}
+
+/*
+ * Throws away lines that have scrolled off the top of the window, once
+ * there are more than the scrollback limit given in .zoomrc, along with
+ * any text that no longer appears on a line. This keeps the memory (and
+ * the time taken to reformat the window) bounded for long sessions.
+ */
+static void trim_scrollback(void)
+{
+  int max_lines;
+  struct line* line;
+  struct text* start;
+  struct text* text;
+  struct text* next;
+
+  max_lines = rc_get_scrollback();
+  if (max_lines <= 0 || CURWIN.n_lines <= max_lines)
+    return;
+
+  while (CURWIN.n_lines > max_lines &&
+	 CURWIN.line != CURWIN.lastline &&
+	 CURWIN.line->baseline + CURWIN.line->descent < CURWIN.winsy)
+    {
+      line = CURWIN.line;
+      CURWIN.line = line->next;
+
+      if (CURWIN.topline == line)
+	CURWIN.topline = NULL;
+
+      free(line);
+      CURWIN.n_lines--;
+    }
+
+  /* Blank lines don't have a start, so find the first one that does */
+  start = NULL;
+  for (line = CURWIN.line; line != NULL && start == NULL; line = line->next)
+    start = line->start;
+  if (start == NULL)
+    return;
+
+  text = CURWIN.text;
+  while (text != start)
+    {
+      if (text == NULL)
+	zmachine_fatal("Programmer is a spoon");
+      next = text->next;
+      format_free_text(text);
+      text = next;
+    }
+  CURWIN.text = start;
+}
+
 static void new_line(int more,
 		     int fnum)
 {
@@ -122,6 +203,7 @@ static void new_line(int more,
       CURWIN.line->descent  = xfont_get_descent(font[fnum]);
       CURWIN.line->height   = xfont_get_height(font[fnum]);
       CURWIN.line->next     = NULL;
+      CURWIN.n_lines        = 1;
 
       displayed_text = CURWIN.lastline->ascent + CURWIN.lastline->descent;
       
@@ -163,6 +245,7 @@ static void new_line(int more,
 
   CURWIN.lastline->next = line;
   CURWIN.lastline = line;
+  CURWIN.n_lines++;
 
   CURWIN.xpos = 0;
   CURWIN.ypos = line->baseline - line->ascent;
@@ -211,6 +294,8 @@ static void new_line(int more,
       display_update();
     }
 
+  trim_scrollback();
+
   reformatting = 1;
 }
 
@@ -264,6 +349,8 @@ void format_last_text(int more)
       text_start = xpos;
       line       = CURWIN.lastline;
 
+#if WINDOW_SYSTEM == 3
+      /* Only the Mac port speaks text (and so empties nextspeech) */
       if (text->spoken == 0)
 	{
 	  int len,x;
@@ -294,6 +381,7 @@ void format_last_text(int more)
 	  nextspeech[len+x] = '\0';
 	  text->spoken = 1;
 	}
+#endif
       
       /*
        * Move the other lines to make room if this font is bigger than
@@ -495,3 +583,5 @@ void format_last_text(int more)
 
   reformatting = 1;
 }
+
+#endif
@@ -120,6 +120,7 @@ struct window
   struct line* line;
   struct line* topline;
   struct line* lastline;
+  int          n_lines;
 
   struct cellline* cline;
 };
@@ -185,7 +186,9 @@ extern history_item* history_pos;
 
 /* Functions */
 
-extern void format_last_text(int more);
+extern struct text* format_new_text (int len);
+extern void         format_free_text(struct text* text);
+extern void         format_last_text(int more);
 
 /* External functions */
 extern void display_update_region      (XFONT_MEASURE left,
@@ -19,6 +19,11 @@
 
 /*
  * Hash table
+ *
+ * Open addressing with linear probing. Short keys (which is nearly all
+ * of them: dictionary words are 4 or 6 bytes) are stored in the slot
+ * itself, so a lookup usually touches a single cache line and storing
+ * a new key needs no allocation at all.
  */
 
 #include <stdio.h>
@@ -30,120 +35,150 @@
 /* #define DEBUG */
 
 /* Power of 2 */
-#define NUM_BUCKETS       8
+#define NUM_SLOTS   8
 
-/* Number of collisions before a hash becomes 'unhappy' */
-#define UNHAPPY_THRESHOLD 4
+/* Keys this long or shorter are kept in the slot */
+#define INLINE_KEY  12
 
-struct bucket
+struct hash_slot
 {
-  char *key;
-  int   keylen;
-  void *data;
-
-  int count;
-  
-  struct bucket *next;
+  unsigned int value;     /* Full hash value of the key */
+  int          keylen;    /* -1 if the slot is empty */
+  void*        data;
+
+  union
+  {
+    unsigned char  bytes[INLINE_KEY];
+    unsigned char* ptr;
+  } key;
 };
 
+#define SlotKey(s) ((s)->keylen<=INLINE_KEY?(s)->key.bytes:(s)->key.ptr)
+
+/* A table is grown once it's more than 3/4 full */
+#define MaxUsed(n) (((n)>>1) + ((n)>>2))
+
+static struct hash_slot* new_slots(int n_slots)
+{
+  struct hash_slot* slot;
+  int x;
+
+  slot = malloc(sizeof(struct hash_slot)*n_slots);
+  for (x=0; x<n_slots; x++)
+    slot[x].keylen = -1;
+
+  return slot;
+}
+
 hash hash_create(void)
 {
   struct hash *hash;
-  int x;
 
   hash = malloc(sizeof(struct hash));
-  hash->n_buckets    = NUM_BUCKETS;
-  hash->bucket       = malloc(sizeof(struct bucket *)*NUM_BUCKETS);
-  hash->unhappy      = 0;
-
-  for (x=0; x<NUM_BUCKETS; x++)
-    {
-      hash->bucket[x] = NULL;
-    }
+  hash->n_slots = NUM_SLOTS;
+  hash->n_used  = 0;
+  hash->slot    = new_slots(NUM_SLOTS);
 
 #ifdef DEBUG
-  printf_debug("*** Hash - created new hash (%i elements)\n", hash->n_buckets);
+  printf_debug("*** Hash - created new hash (%i slots)\n", hash->n_slots);
 #endif
   
   return hash;
 }
 
-/* Blantantly nicked from the comp.compression FAQ... */
-static unsigned long crc32_table[256] = { 0, 0, 0, 0 };
+/* FNV-1a */
+unsigned int hash_hash(unsigned char *buf,
+		       int            len)
+{
+  unsigned int value = 2166136261u;
 
-#define CRC32_POLY 0x04c11db7     /* AUTODIN II, Ethernet, & FDDI */
+  while (len-- > 0)
+    {
+      value ^= *(buf++);
+      value *= 16777619u;
+    }
 
-static void init_crc32()
-{
-        int i, j;
-        unsigned long c;
-
-        for (i = 0; i < 256; ++i) {
-                for (c = i << 24, j = 8; j > 0; --j)
-                        c = c & 0x80000000 ? (c << 1) ^ CRC32_POLY : (c << 1);
-                crc32_table[i] = c & 0xffffffff;
-        }
+  return value;
 }
 
-unsigned long hash_hash(unsigned char *buf,
-			int            len)
+/* Finds the slot where key is (or where it would go) */
+static struct hash_slot* hash_lookup(hash           hash,
+				     unsigned char* key,
+				     int            keylen,
+				     unsigned int   value)
 {
-  unsigned char *p;
-  unsigned long  crc;
-  
-  if (!crc32_table[1])    /* if not already done, */
-    init_crc32();   /* build table */
-  crc = 0xffffffff;       /* preload shift register, per CRC-32 spec */
-  for (p = buf; len > 0; ++p, --len)
-    crc = ((crc << 8) ^ crc32_table[(crc >> 24) ^ *p]) & 0xffffffff;
-  return ~crc & 0xffffffff;     /* transmit complement, per CRC-32 spec */  
+  unsigned int mask = hash->n_slots-1;
+  unsigned int pos  = value&mask;
+
+  for (;;)
+    {
+      struct hash_slot* slot = hash->slot + pos;
+
+      if (slot->keylen < 0)
+	return slot;
+      if (slot->value == value &&
+	  slot->keylen == keylen &&
+	  memcmp(SlotKey(slot), key, keylen) == 0)
+	return slot;
+
+      pos = (pos+1)&mask;
+    }
 }
 
-static struct bucket *hash_lookup(hash           hash,
-				  unsigned char* key,
-				  int            keylen,
-				  unsigned long  value)
+/* Moves the contents of the table into n_slots slots */
+static void hash_rehash(hash hash,
+			int  n_slots)
 {
-  struct bucket *next;
-  struct bucket *match;
+  struct hash_slot* old;
+  int n_old;
+  int x;
 
-  next = hash->bucket[value];
-  match = NULL;
+#ifdef DEBUG
+  printf_debug("*** Hash - resizing to %i\n", n_slots);
+#endif
 
-  while (next != NULL && match == NULL)
+  old   = hash->slot;
+  n_old = hash->n_slots;
+
+  hash->n_slots = n_slots;
+  hash->slot    = new_slots(n_slots);
+
+  for (x=0; x<n_old; x++)
     {
-      if (next->keylen == keylen)
-	{
-	  if (memcmp(next->key, key, keylen) == 0)
-	    match = next;
-	}
-      next = next->next;
+      struct hash_slot* slot;
+      unsigned int pos;
+
+      if (old[x].keylen < 0)
+	continue;
+
+      /* Keys are all different, so the first free slot is the right one */
+      pos = old[x].value&(n_slots-1);
+      while (hash->slot[pos].keylen >= 0)
+	pos = (pos+1)&(n_slots-1);
+
+      slot  = hash->slot + pos;
+      *slot = old[x];
     }
 
-  return match;
+  free(old);
 }
 
-void hash_store_happy(hash  hash,
-		      unsigned char *key,
-		      int   keylen,
-		      void *data)
+void hash_reserve(hash hash,
+		  int  n_entries)
 {
-  hash_store(hash, key, keylen, data);
+  int n_slots;
 
-  if (hash->unhappy)
-    {
-      int new_size;
+  n_slots = hash->n_slots;
+  while (MaxUsed(n_slots) < n_entries)
+    n_slots <<= 1;
 
-      new_size = hash->n_buckets*2;
-      if (new_size<64)
-	new_size *= 2;
- 
-#ifdef DEBUG
-      printf_debug("*** Hash - unhappy hash, resizing to %i\n", new_size);
-#endif
-     
-      hash_resize(hash, new_size);
-    }
+  if (n_slots != hash->n_slots)
+    hash_rehash(hash, n_slots);
+}
+
+int hash_capacity(hash hash)
+{
+  return MaxUsed(hash->n_slots);
 }
 
 void hash_store(hash  hash,
@@ -151,69 +186,64 @@ void hash_store(hash  hash,
 		int         len,
 		void       *data)
 {
-  unsigned long  value;
-  struct bucket *bucket;
+  unsigned int      value;
+  struct hash_slot* slot;
 
-  value = hash_hash(key,
-		    len)&(hash->n_buckets-1);
+  value = hash_hash(key, len);
+  slot  = hash_lookup(hash, key, len, value);
 
-  bucket = hash_lookup(hash, key, len, value);
-
-  if (bucket == NULL)
+  if (slot->keylen < 0)
     {
-      bucket = malloc(sizeof(struct bucket));
+      if (hash->n_used+1 > MaxUsed(hash->n_slots))
+	{
+	  hash_reserve(hash, hash->n_used+1);
+	  slot = hash_lookup(hash, key, len, value);
+	}
 
 #ifdef DEBUG
-      printf_debug("*** Hash - storing new value in bucket 0x%x\n", value);
+      printf_debug("*** Hash - storing new value in slot 0x%x\n",
+		   slot - hash->slot);
 #endif
 
-      bucket->key = malloc(len+1);
-      bucket->keylen = len;
-      memcpy(bucket->key, key, len);
-      bucket->next = hash->bucket[value];
-      hash->bucket[value] = bucket;
+      slot->value  = value;
+      slot->keylen = len;
+      if (len > INLINE_KEY)
+	slot->key.ptr = malloc(len);
+      memcpy(SlotKey(slot), key, len);
 
-      if (bucket->next != NULL)
-	{
-	  bucket->count = bucket->next->count + 1;
-
-	  if (bucket->count > UNHAPPY_THRESHOLD)
-	    hash->unhappy = 1;
-	}
-      else
-	bucket->count = 0;
+      hash->n_used++;
     }
 #ifdef DEBUG
   else
     {
-      printf_debug("*** Hash - replacing value in bucket 0x%x\n", key, value);
+      printf_debug("*** Hash - replacing value in slot 0x%x\n",
+		   slot - hash->slot);
     }
 #endif
 
-  bucket->data = data;
+  slot->data = data;
+}
+
+/* The table grows by itself now: this is the same as hash_store */
+void hash_store_happy(hash  hash,
+		      unsigned char *key,
+		      int   keylen,
+		      void *data)
+{
+  hash_store(hash, key, keylen, data);
 }
 
 void hash_free(hash hash)
 {
   int x;
 
-  for (x=0; x<hash->n_buckets; x++)
+  for (x=0; x<hash->n_slots; x++)
     {
-      struct bucket *next;
-
-      next = hash->bucket[x];
-
-      while (next != NULL)
-	{
-	  struct bucket *last;
-
-	  last = next;
-	  next = next->next;
-
-	  free(last);
-	}
+      if (hash->slot[x].keylen > INLINE_KEY)
+	free(hash->slot[x].key.ptr);
     }
 
+  free(hash->slot);
   free(hash);
 }
 
@@ -229,21 +259,15 @@ void hash_iterate(hash hash,
 
   res = 0;
   
-  for (x=0; x<hash->n_buckets && res == 0; x++)
+  for (x=0; x<hash->n_slots && res == 0; x++)
     {
-      struct bucket *next;
-      
-      next = hash->bucket[x];
-      
-      while (next != NULL && res == 0)
-	{
-	  res = (func)(next->key,
-		       next->keylen,
-		       next->data,
-		       arg);
-	  
-	  next = next->next;
-	}
+      struct hash_slot* slot = hash->slot + x;
+
+      if (slot->keylen >= 0)
+	res = (func)(SlotKey(slot),
+		     slot->keylen,
+		     slot->data,
+		     arg);
     }
 }
 
@@ -251,59 +275,18 @@ void *hash_get(hash  hash,
 	       unsigned char* key,
 	       int   len)
 {
-  unsigned long  value;
-  struct bucket *bucket;
-
-  
-  value = hash_hash(key,
-		    len)&(hash->n_buckets-1);
+  struct hash_slot* slot;
 
-  bucket = hash_lookup(hash, key, len, value);
+  slot = hash_lookup(hash, key, len, hash_hash(key, len));
 
-  if (bucket != NULL)
-    return bucket->data;
+  if (slot->keylen >= 0)
+    return slot->data;
 
   return NULL;
 }
 
-static int resize_func(unsigned char *key,
-		       int   keylen,
-		       void *data,
-		       void *new_hash)
-{
-  if (data != NULL)
-    hash_store((hash) new_hash, key, keylen, data);
-
-  return 0;
-}
-
 void hash_resize(hash hsh,
 		 int  n_buckets)
 {
-  hash new_hash;
-  
-  if (n_buckets > 32768)
-    {
-      /* We'll max out here for the time being */
-      return;
-    }
-
-  new_hash = hash_create();
-
-#ifdef DEBUG
-  printf_debug("*** Hash - resizing to %i\n", n_buckets);
-#endif
-
-  free(new_hash->bucket);
-
-  *new_hash = *hsh;
-
-  hsh->n_buckets = n_buckets;
-  hsh->bucket    = calloc(n_buckets,
-			  sizeof(struct bucket *));
-  hsh->unhappy   = 0;
-
-  hash_iterate(new_hash, resize_func, hsh);
-  
-  hash_free(new_hash);
+  hash_reserve(hsh, MaxUsed(n_buckets));
 }
@@ -26,10 +26,10 @@
 
 typedef struct hash
 {
-  int n_buckets;
-  int unhappy;
-  
-  void **bucket;
+  int n_slots;   /* Power of 2 */
+  int n_used;
+
+  struct hash_slot *slot;
 } *hash;
 
 extern hash  hash_create     (void);
@@ -54,4 +54,14 @@ extern void *hash_get        (hash  hash,
 extern void  hash_resize     (hash hash,
 			      int  n_buckets);
 
+/* Makes room for n_entries keys without the table having to grow */
+extern void  hash_reserve    (hash hash,
+			      int  n_entries);
+/* Number of keys the table can hold before it next grows */
+extern int   hash_capacity   (hash hash);
+
+/* The hash function used for keys */
+extern unsigned int hash_hash(unsigned char *buf,
+			      int            len);
+
 #endif
@@ -0,0 +1,433 @@
+/*
+ * Benchmark for the hash table, using the dictionaries of real story files
+ *
+ * Compares hash.c with the chained table it replaced (reproduced below) on
+ * the work tokenise.c does with them: building the dictionary cache, then
+ * looking up words, some of which aren't in the dictionary.
+ *
+ *   gcc -O2 -o hashbench hashbench.c hash.c
+ *   ./hashbench story.z5 [story.z8 ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "hash.h"
+
+#define ROUNDS 200
+
+/***                           ----// 888 \\----                           ***/
+
+/*
+ * The old hash table: chained buckets, a CRC32 hash and a malloc per
+ * key, growing when a chain gets too long
+ */
+
+#define OLD_BUCKETS   8
+#define OLD_UNHAPPY   4
+
+struct old_bucket
+{
+  unsigned char *key;
+  int   keylen;
+  void *data;
+  int   count;
+
+  struct old_bucket *next;
+};
+
+typedef struct old_hash
+{
+  int n_buckets;
+  int unhappy;
+
+  struct old_bucket **bucket;
+} *old_hash;
+
+static unsigned long old_crc32_table[256];
+
+static void old_init_crc32(void)
+{
+  int i, j;
+  unsigned long c;
+
+  for (i = 0; i < 256; ++i)
+    {
+      for (c = i << 24, j = 8; j > 0; --j)
+	c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
+      old_crc32_table[i] = c & 0xffffffff;
+    }
+}
+
+static unsigned long old_hash_hash(unsigned char *buf, int len)
+{
+  unsigned long crc;
+
+  if (!old_crc32_table[1])
+    old_init_crc32();
+  crc = 0xffffffff;
+  for (; len > 0; ++buf, --len)
+    crc = ((crc << 8) ^ old_crc32_table[(crc >> 24) ^ *buf]) & 0xffffffff;
+  return ~crc & 0xffffffff;
+}
+
+static old_hash old_hash_create(int n_buckets)
+{
+  old_hash hash;
+
+  hash = malloc(sizeof(struct old_hash));
+  hash->n_buckets = n_buckets;
+  hash->unhappy   = 0;
+  hash->bucket    = calloc(n_buckets, sizeof(struct old_bucket *));
+
+  return hash;
+}
+
+static struct old_bucket* old_hash_lookup(old_hash hash,
+					  unsigned char *key,
+					  int keylen)
+{
+  struct old_bucket *next;
+
+  next = hash->bucket[old_hash_hash(key, keylen)&(hash->n_buckets-1)];
+  for (; next != NULL; next = next->next)
+    {
+      if (next->keylen == keylen && memcmp(next->key, key, keylen) == 0)
+	return next;
+    }
+
+  return NULL;
+}
+
+static void old_hash_store(old_hash hash,
+			   unsigned char *key,
+			   int len,
+			   void *data)
+{
+  unsigned long      value;
+  struct old_bucket *bucket;
+
+  bucket = old_hash_lookup(hash, key, len);
+
+  if (bucket == NULL)
+    {
+      value = old_hash_hash(key, len)&(hash->n_buckets-1);
+
+      bucket = malloc(sizeof(struct old_bucket));
+      bucket->key = malloc(len+1);
+      bucket->keylen = len;
+      memcpy(bucket->key, key, len);
+      bucket->next = hash->bucket[value];
+      hash->bucket[value] = bucket;
+
+      if (bucket->next != NULL)
+	{
+	  bucket->count = bucket->next->count + 1;
+	  if (bucket->count > OLD_UNHAPPY)
+	    hash->unhappy = 1;
+	}
+      else
+	bucket->count = 0;
+    }
+
+  bucket->data = data;
+}
+
+static void old_hash_free(old_hash hash)
+{
+  int x;
+
+  for (x=0; x<hash->n_buckets; x++)
+    {
+      struct old_bucket *next, *last;
+
+      next = hash->bucket[x];
+      while (next != NULL)
+	{
+	  last = next;
+	  next = next->next;
+	  free(last->key);
+	  free(last);
+	}
+    }
+
+  free(hash->bucket);
+  free(hash);
+}
+
+static void old_hash_resize(old_hash hash, int n_buckets)
+{
+  struct old_bucket **old;
+  int old_size, x;
+
+  if (n_buckets > 32768)
+    return;
+
+  old      = hash->bucket;
+  old_size = hash->n_buckets;
+
+  hash->n_buckets = n_buckets;
+  hash->bucket    = calloc(n_buckets, sizeof(struct old_bucket *));
+  hash->unhappy   = 0;
+
+  for (x=0; x<old_size; x++)
+    {
+      struct old_bucket *next, *last;
+
+      next = old[x];
+      while (next != NULL)
+	{
+	  last = next;
+	  next = next->next;
+	  if (last->data != NULL)
+	    old_hash_store(hash, last->key, last->keylen, last->data);
+	  free(last->key);
+	  free(last);
+	}
+    }
+
+  free(old);
+}
+
+static void old_hash_store_happy(old_hash hash,
+				 unsigned char *key,
+				 int len,
+				 void *data)
+{
+  old_hash_store(hash, key, len, data);
+
+  if (hash->unhappy)
+    {
+      int new_size;
+
+      new_size = hash->n_buckets*2;
+      if (new_size<64)
+	new_size *= 2;
+
+      old_hash_resize(hash, new_size);
+    }
+}
+
+static void* old_hash_get(old_hash hash,
+			  unsigned char *key,
+			  int len)
+{
+  struct old_bucket *bucket;
+
+  bucket = old_hash_lookup(hash, key, len);
+  return bucket!=NULL?bucket->data:NULL;
+}
+
+/***                           ----// 888 \\----                           ***/
+
+/* A story file's dictionary */
+typedef struct dictionary
+{
+  int            n_words;
+  int            text_len;
+  unsigned char *words;    /* n_words keys of text_len bytes */
+  unsigned char *queries;  /* 2*n_words keys: every word, and a miss for each */
+} dictionary;
+
+static unsigned char* load_file(const char *filename, long *size)
+{
+  FILE          *f;
+  unsigned char *data;
+
+  f = fopen(filename, "rb");
+  if (f == NULL)
+    return NULL;
+
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  data = malloc(*size);
+  if (fread(data, 1, *size, f) != (size_t)*size)
+    {
+      free(data);
+      data = NULL;
+    }
+
+  fclose(f);
+  return data;
+}
+
+static int load_dictionary(const char *filename, dictionary *dict)
+{
+  unsigned char *story, *dct;
+  long size, dpos;
+  int  entry_length, x;
+
+  story = load_file(filename, &size);
+  if (story == NULL || size < 64 || story[0] < 1 || story[0] > 8)
+    {
+      free(story);
+      return 0;
+    }
+
+  dpos = (story[0x8]<<8)|story[0x9];
+  if (dpos + 4 > size)
+    {
+      free(story);
+      return 0;
+    }
+
+  dct = story + dpos;
+  dct += 1+dct[0];
+
+  dict->text_len = story[0]<=3?4:6;
+  entry_length   = dct[0];
+  dict->n_words  = (short)((dct[1]<<8)|dct[2]);
+  if (dict->n_words < 0)
+    dict->n_words = -dict->n_words;
+
+  if (dict->n_words == 0 || entry_length < dict->text_len ||
+      (dct - story) + 3 + (long)entry_length*dict->n_words > size)
+    {
+      free(story);
+      return 0;
+    }
+
+  dict->words   = malloc(dict->n_words*dict->text_len+1);
+  dict->queries = malloc(2*dict->n_words*dict->text_len+1);
+
+  for (x=0; x<dict->n_words; x++)
+    {
+      unsigned char *word, *miss;
+
+      word = dict->words + x*dict->text_len;
+      memcpy(word, dct + 3 + entry_length*x, dict->text_len);
+
+      /* Misses look like words the player might type that aren't there */
+      miss = dict->queries + (2*x+1)*dict->text_len;
+      memcpy(dict->queries + 2*x*dict->text_len, word, dict->text_len);
+      memcpy(miss, word, dict->text_len);
+      miss[1] ^= 0x21;
+    }
+
+  free(story);
+  return 1;
+}
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+/* Times building and searching the dictionary with each table */
+static void bench(const char *filename, dictionary *dict,
+		  double *old_total, double *new_total)
+{
+  double  start, old_build, new_build, old_find, new_find;
+  int     round, x, found_old, found_new;
+  int     len;
+
+  len = dict->text_len;
+
+  /* Building: tokenise.c does this once per dictionary */
+  start = now();
+  for (round=0; round<ROUNDS; round++)
+    {
+      old_hash h = old_hash_create(OLD_BUCKETS);
+
+      for (x=0; x<dict->n_words; x++)
+	old_hash_store_happy(h, dict->words + x*len, len, dict->words + x*len);
+      old_hash_free(h);
+    }
+  old_build = (now() - start)/ROUNDS;
+
+  start = now();
+  for (round=0; round<ROUNDS; round++)
+    {
+      hash h = hash_create();
+
+      hash_reserve(h, dict->n_words);
+      for (x=0; x<dict->n_words; x++)
+	hash_store_happy(h, dict->words + x*len, len, dict->words + x*len);
+      hash_free(h);
+    }
+  new_build = (now() - start)/ROUNDS;
+
+  /* Searching: tokenise_string does this once per word typed */
+  {
+    old_hash oh = old_hash_create(OLD_BUCKETS);
+    hash     nh = hash_create();
+
+    for (x=0; x<dict->n_words; x++)
+      {
+	old_hash_store_happy(oh, dict->words + x*len, len, dict->words + x*len);
+	hash_store_happy(nh, dict->words + x*len, len, dict->words + x*len);
+      }
+
+    found_old = 0;
+    start = now();
+    for (round=0; round<ROUNDS; round++)
+      for (x=0; x<2*dict->n_words; x++)
+	found_old += old_hash_get(oh, dict->queries + x*len, len) != NULL;
+    old_find = (now() - start)/(ROUNDS*2.0*dict->n_words);
+
+    found_new = 0;
+    start = now();
+    for (round=0; round<ROUNDS; round++)
+      for (x=0; x<2*dict->n_words; x++)
+	found_new += hash_get(nh, dict->queries + x*len, len) != NULL;
+    new_find = (now() - start)/(ROUNDS*2.0*dict->n_words);
+
+    old_hash_free(oh);
+    hash_free(nh);
+  }
+
+  if (found_old != found_new)
+    printf("%s: tables disagree (%i found by the old one, %i by the new)\n",
+	   filename, found_old/ROUNDS, found_new/ROUNDS);
+
+  printf("%-24s %6i words  build %8.1fus -> %8.1fus  lookup %6.1fns -> %6.1fns\n",
+	 filename, dict->n_words,
+	 old_build*1e6, new_build*1e6,
+	 old_find*1e9, new_find*1e9);
+
+  *old_total += old_build + old_find*2*dict->n_words;
+  *new_total += new_build + new_find*2*dict->n_words;
+}
+
+int main(int argc, char **argv)
+{
+  double old_total, new_total;
+  int x;
+
+  if (argc < 2)
+    {
+      fprintf(stderr, "Usage: %s story-file ...\n", argv[0]);
+      return 1;
+    }
+
+  old_total = new_total = 0;
+
+  for (x=1; x<argc; x++)
+    {
+      dictionary dict;
+
+      if (!load_dictionary(argv[x], &dict))
+	{
+	  printf("%s: not a Z-Code story with a dictionary\n", argv[x]);
+	  continue;
+	}
+
+      bench(argv[x], &dict, &old_total, &new_total);
+
+      free(dict.words);
+      free(dict.queries);
+    }
+
+  if (new_total > 0)
+    printf("\nBuilding and searching each dictionary once: %.1fus -> %.1fus (%.2fx)\n",
+	   old_total*1e6, new_total*1e6, old_total/new_total);
+
+  return 0;
+}
@@ -3,10 +3,107 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ifmetabase.h"
 #include "ifmetaxml.h"
 
+static int failures = 0;
+
+static void Check(const char* name, int ok) {
+	printf("%s ........ %s\n", name, ok?"OK":"Failed");
+	if (!ok) failures++;
+}
+
+/* Converts an ASCII string to UTF-16 (in a static buffer) */
+static IFChar* U(const char* ascii) {
+	static IFChar buf[2][256];
+	static int which = 0;
+	int x;
+	
+	which ^= 1;
+	for (x=0; ascii[x] != 0 && x < 255; x++) buf[which][x] = (unsigned char)ascii[x];
+	buf[which][x] = 0;
+	
+	return buf[which];
+}
+
+static int SameString(IFChar* value, const char* ascii) {
+	return value != NULL && IFMB_StrCmp(value, U(ascii)) == 0;
+}
+
+/* Collects output from the writer functions */
+typedef struct TestBuffer {
+	char* data;
+	int length;
+} TestBuffer;
+
+static int WriteToBuffer(const char* bytes, int length, void* userData) {
+	TestBuffer* buf = userData;
+	
+	buf->data = realloc(buf->data, buf->length + length);
+	memcpy(buf->data + buf->length, bytes, length);
+	buf->length += length;
+	
+	return 0;
+}
+
+static TestBuffer SaveIfiction(IFMetabase meta) {
+	TestBuffer buf = { NULL, 0 };
+	
+	IF_WriteIfiction(meta, WriteToBuffer, &buf);
+	return buf;
+}
+
+/* Saves a copy of a metabase that has never been saved before, so none of its stories are cached */
+static TestBuffer SaveUncached(IFMetabase meta) {
+	IFMetabase copy = IFMB_Create();
+	IFStoryIterator iter = IFMB_GetStoryIterator(meta);
+	IFStory story;
+	TestBuffer buf;
+	
+	while ((story = IFMB_NextStory(iter)) != NULL) IFMB_CopyStory(copy, story, NULL);
+	IFMB_FreeStoryIterator(iter);
+	
+	buf = SaveIfiction(copy);
+	IFMB_Free(copy);
+	return buf;
+}
+
+static int SameBuffer(TestBuffer a, TestBuffer b) {
+	return a.length == b.length && memcmp(a.data, b.data, a.length) == 0;
+}
+
+/* Checks that saving meta again gives the same iFiction as saving it from scratch */
+static void CheckSave(const char* name, IFMetabase meta) {
+	TestBuffer incremental = SaveIfiction(meta);
+	TestBuffer fresh = SaveUncached(meta);
+	
+	Check(name, SameBuffer(incremental, fresh));
+	
+	free(incremental.data);
+	free(fresh.data);
+}
+
+static int CountStories(IFMetabase meta) {
+	IFStoryIterator iter = IFMB_GetStoryIterator(meta);
+	int count = 0;
+	
+	while (IFMB_NextStory(iter) != NULL) count++;
+	IFMB_FreeStoryIterator(iter);
+	
+	return count;
+}
+
+static IFStory StoryWithId(IFMetabase meta, const char* idString) {
+	IFID id = IFMB_IdFromString(idString);
+	IFStory story = IFMB_GetStoryWithId(meta, id);
+	
+	IFMB_FreeId(id);
+	return story;
+}
+
 int main() {
 	int x;
 	
@@ -128,8 +225,167 @@ int main() {
 	}
 	printf("\n");
 	
+	/* Snapshot tests */
+	printf("\nSnapshots...\n\n");
+	
+	{
+		TestBuffer snapshot = { NULL, 0 };
+		TestBuffer original, restored;
+		IFMetabase fromSnapshot;
+		
+		IFMB_WriteSnapshot(mb, "test-stamp", WriteToBuffer, &snapshot);
+		
+		fromSnapshot = IFMB_Create();
+		Check("Read snapshot", IFMB_ReadSnapshot(fromSnapshot, "test-stamp", (unsigned char*)snapshot.data, snapshot.length));
+		
+		original = SaveUncached(mb);
+		restored = SaveIfiction(fromSnapshot);
+		Check("Round trip", SameBuffer(original, restored));
+		Check("Same story count", CountStories(mb) == CountStories(fromSnapshot));
+		Check("Index works", SameString(IFMB_GetValue(StoryWithId(fromSnapshot, "ZCODE-76-840509"), "bibliographic.title"), "Zork I"));
+		free(original.data);
+		free(restored.data);
+		IFMB_Free(fromSnapshot);
+		
+		fromSnapshot = IFMB_Create();
+		Check("Rejects stale stamp", !IFMB_ReadSnapshot(fromSnapshot, "other-stamp", (unsigned char*)snapshot.data, snapshot.length)
+			  && CountStories(fromSnapshot) == 0);
+		Check("Rejects truncated snapshot", !IFMB_ReadSnapshot(fromSnapshot, "test-stamp", (unsigned char*)snapshot.data, snapshot.length/2)
+			  && CountStories(fromSnapshot) == 0);
+		IFMB_Free(fromSnapshot);
+		
+		free(snapshot.data);
+	}
+	
+	/* Bulk load tests */
+	printf("\nBulk loading...\n\n");
+	
+	{
+		IFMetabase bulk = IFMB_Create();
+		IFMetabase oneAtATime = IFMB_Create();
+		IFMetabase incoming = IFMB_Create();
+		IFStoryIterator iter;
+		IFStory story;
+		TestBuffer a, b;
+		IFID id;
+		
+		IFMB_SetValue(StoryWithId(bulk, "ZCODE-1-000001"), "bibliographic.title", U("Old title"));
+		IFMB_SetValue(StoryWithId(bulk, "ZCODE-2-000002"), "bibliographic.title", U("Untouched"));
+		IFMB_SetValue(StoryWithId(oneAtATime, "ZCODE-1-000001"), "bibliographic.title", U("Old title"));
+		IFMB_SetValue(StoryWithId(oneAtATime, "ZCODE-2-000002"), "bibliographic.title", U("Untouched"));
+		
+		IFMB_SetValue(StoryWithId(incoming, "ZCODE-3-000003"), "bibliographic.title", U("Third"));
+		IFMB_SetValue(StoryWithId(incoming, "ZCODE-1-000001"), "bibliographic.title", U("New title"));
+		IFMB_SetValue(StoryWithId(incoming, "GLULX-4-000004-abcd1010"), "bibliographic.title", U("Fourth"));
+		
+		IFMB_BeginBulkLoad(bulk);
+		iter = IFMB_GetStoryIterator(incoming);
+		while ((story = IFMB_NextStory(iter)) != NULL) {
+			IFMB_CopyStory(bulk, story, NULL);
+			IFMB_CopyStory(oneAtATime, story, NULL);
+		}
+		IFMB_FreeStoryIterator(iter);
+		
+		id = IFMB_IdFromString("ZCODE-3-000003");
+		Check("Search during load", IFMB_ContainsStoryWithId(bulk, id));
+		IFMB_FreeId(id);
+		IFMB_EndBulkLoad(bulk);
+		
+		Check("Story count", CountStories(bulk) == 4);
+		Check("Later copy replaces earlier", SameString(IFMB_GetValue(StoryWithId(bulk, "ZCODE-1-000001"), "bibliographic.title"), "New title"));
+		Check("Existing story kept", SameString(IFMB_GetValue(StoryWithId(bulk, "ZCODE-2-000002"), "bibliographic.title"), "Untouched"));
+		
+		a = SaveIfiction(bulk);
+		b = SaveIfiction(oneAtATime);
+		Check("Same as copying one at a time", SameBuffer(a, b));
+		free(a.data);
+		free(b.data);
+		
+		IFMB_Free(bulk);
+		IFMB_Free(oneAtATime);
+		IFMB_Free(incoming);
+	}
+	
+	/* Compiled key path tests */
+	printf("\nKey paths...\n\n");
+	
+	{
+		IFKeyPath title = IFMB_CompileKeyPath("Bibliographic.TITLE");
+		IFKeyPath cover = IFMB_CompileKeyPath("zoom.cover@href");
+		IFKeyPath missing = IFMB_CompileKeyPath("bibliographic.nothing");
+		IFMetabase other = IFMB_Create();
+		IFStory story = StoryWithId(other, "ZCODE-5-000005");
+		
+		Check("Get by path", SameString(IFMB_GetValueForPath(zork1, title), "Zork I"));
+		Check("Missing value", IFMB_GetValueForPath(zork1, missing) == NULL);
+		
+		IFMB_SetValueForPath(story, title, U("Path title"));
+		Check("Set by path", SameString(IFMB_GetValue(story, "bibliographic.title"), "Path title"));
+		
+		IFMB_SetValue(story, "zoom.cover@href", U("cover.png"));
+		Check("Attribute path", SameString(IFMB_GetValueForPath(story, cover), "cover.png"));
+		
+		/* The same path, used on another metabase */
+		Check("Shared path", SameString(IFMB_GetValueForPath(zork1, title), "Zork I")
+			  && SameString(IFMB_GetValueForPath(story, title), "Path title"));
+		
+		IFMB_FreeKeyPath(title);
+		IFMB_FreeKeyPath(cover);
+		IFMB_FreeKeyPath(missing);
+		IFMB_Free(other);
+	}
+	
+	/* Incremental iFiction writer tests */
+	printf("\nSaving changes...\n\n");
+	
+	{
+		TestBuffer first = SaveIfiction(mb);
+		IFValueIterator iter;
+		IFStory story;
+		unsigned char md5[16];
+		IFID id, newId;
+		
+		free(first.data);
+		CheckSave("Unchanged", mb);
+		
+		IFMB_SetValue(zork1, "bibliographic.title", U("Zork I (edited)"));
+		CheckSave("Edited value", mb);
+		
+		iter = IFMB_GetValueIteratorForKey(zork1, "bibliographic.title");
+		if (iter != NULL && IFMB_NextValue(iter)) IFMB_SetIteratorValue(iter, U("Zork I (iterator)"));
+		if (iter != NULL) IFMB_FreeValueIterator(iter);
+		CheckSave("Edited through an iterator", mb);
+		
+		IFMB_SetValue(StoryWithId(mb, "ZCODE-99-990101"), "bibliographic.title", U("Added"));
+		CheckSave("Added story", mb);
+		
+		id = IFMB_IdFromString("ZCODE-99-990101");
+		IFMB_RemoveStoryWithId(mb, id);
+		IFMB_FreeId(id);
+		CheckSave("Deleted story", mb);
+		
+		newId = IFMB_IdFromString("ZCODE-98-980101");
+		IFMB_CopyStory(mb, zork1, newId);
+		IFMB_FreeId(newId);
+		CheckSave("Re-identified story", mb);
+		
+		/* Looking up an MD5 ID with a system fills in the system of a story saved without one */
+		for (x=0; x<16; x++) md5[x] = x*17;
+		id = IFMB_IdFromString("00112233445566778899aabbccddeeff");
+		story = IFMB_GetStoryWithId(mb, id);
+		IFMB_SetValue(story, "bibliographic.title", U("MD5 story"));
+		IFMB_FreeId(id);
+		CheckSave("MD5 story without a system", mb);
+		
+		id = IFMB_Md5Id(md5, "TADS");
+		Check("MD5 story found with a system", IFMB_GetStoryWithId(mb, id) == story);
+		IFMB_FreeId(id);
+		CheckSave("MD5 story given a system", mb);
+	}
+	
 	IFMB_FreeId(zork1Id);
 	IFMB_Free(mb);
 	
-	return 0;
+	printf("\n%i failures\n", failures);
+	return failures != 0;
 }
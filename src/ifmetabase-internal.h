@@ -39,14 +39,26 @@ struct IFValue {
 	IFValue parent;
 };
 
+/* Compiled key path structure */
+
+struct IFKeyPath {
+	int numSegments;
+	char** segments;					/* Lowercased keys for each part of the path */
+};
+
 /* The IFMetabase structure */
 
 struct IFMetabase {
 	int numStories;
+	int storiesSize;					/* Allocated size of the stories array */
 	IFStory* stories;
 	
 	int numIndexEntries;
+	int indexSize;						/* Allocated size of the index array */
+	int numUnsorted;					/* Number of entries at the end of the index that have yet to be sorted in */
 	IFIndexEntry* index;
+	
+	int bulkLoad;						/* Greater than 0 while stories are being bulk loaded */
 };
 
 /* The IFStory structure */
@@ -58,6 +70,9 @@ struct IFStory {
 	IFID id;
 	
 	IFValue root;
+	
+	char* xml;							/* This story as it was last written as iFiction (NULL if it has changed since) */
+	int xmlLength;
 };
 
 /* IFID structure */
@@ -121,6 +136,7 @@ struct IFStoryIterator {
 };
 
 struct IFValueIterator {
+	IFStory story;
 	IFValue root;
 	int count;
 	
@@ -129,4 +145,9 @@ struct IFValueIterator {
 	char* pathBuf;
 };
 
+/* Functions */
+
+/* Discards the cached iFiction for a story that has been changed */
+extern void IFMB_StoryChanged(IFStory story);
+
 #endif
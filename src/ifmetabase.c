@@ -65,17 +65,30 @@ static IFValue CopyValue(IFValue value) {
 static void FreeStory(IFStory story) {
 	FreeValue(story->root);
 	IFMB_FreeId(story->id);
+	if (story->xml != NULL) free(story->xml);
 	free(story);
 }
 
+/* Discards the cached iFiction for a story that has been changed */
+void IFMB_StoryChanged(IFStory story) {
+	if (story->xml != NULL) free(story->xml);
+	
+	story->xml = NULL;
+	story->xmlLength = 0;
+}
+
 /* Constructs a new, empty metabase */
 IFMetabase IFMB_Create() {
 	IFMetabase result = malloc(sizeof(struct IFMetabase));
 	
 	result->numStories = 0;
+	result->storiesSize = 0;
 	result->numIndexEntries = 0;
+	result->indexSize = 0;
+	result->numUnsorted = 0;
 	result->stories = NULL;
 	result->index = NULL;
+	result->bulkLoad = 0;
 	
 	return result;
 }
@@ -732,7 +745,7 @@ int IFMB_CompareIds(IFID a, IFID b) {
 			if (a->data.glulx.checksum < b->data.glulx.checksum) return -1;
 				
 			if (a->data.glulx.release > b->data.glulx.release) return 1;
-			if (b->data.glulx.release < b->data.glulx.release) return -1;
+			if (a->data.glulx.release < b->data.glulx.release) return -1;
 						
 			for (x=0; x<6; x++) {
 				if (a->data.glulx.serial[x] > b->data.glulx.serial[x]) return 1;
@@ -750,7 +763,7 @@ int IFMB_CompareIds(IFID a, IFID b) {
 			
 		case ID_COMPOUND:
 			if (a->data.compound.count > b->data.compound.count) return 1;
-			if (b->data.compound.count < b->data.compound.count) return -1;
+			if (a->data.compound.count < b->data.compound.count) return -1;
 			
 			for (x=0; x<a->data.compound.count; x++) {
 				int comparison;
@@ -822,10 +835,15 @@ IFID IFMB_CopyId(IFID ident) {
 
 /* Functions - stories */
 
+static void SortIndex(IFMetabase meta);
+
 /* Perform a binary search in the given metabase for a story with an ID 'close to' the specified identifier - returns the number of the index entry */
 static int NearestIndexNumber(IFMetabase meta, IFID ident) {
 	int top, bottom, compare;
 	
+	/* Sort in any stories that have been bulk loaded */
+	if (meta->numUnsorted > 0) SortIndex(meta);
+	
 	bottom = 0;
 	top = meta->numIndexEntries-1;
 	
@@ -912,6 +930,14 @@ static IFStory ExistingStoryWithId(IFMetabase meta, IFID ident) {
 	}
 }
 
+/* Makes room in the index for count more entries */
+static void ReserveIndex(IFMetabase meta, int count) {
+	if (meta->numIndexEntries + count <= meta->indexSize) return;
+	
+	meta->indexSize = (meta->numIndexEntries + count)*2;
+	meta->index = realloc(meta->index, sizeof(IFIndexEntry)*meta->indexSize);
+}
+
 /* Indexes the specified story number using the specified identifier */
 /* If a compound ID, any IDs that could not be indexed (due to them already existing in the metabase) are set to ID_NULL as a side-effect */
 static int IndexStory(IFMetabase meta, int storyNum, IFID ident) {
@@ -954,8 +980,8 @@ static int IndexStory(IFMetabase meta, int storyNum, IFID ident) {
 		index++;
 		
 		/* Expand the index array */
+		ReserveIndex(meta, 1);
 		meta->numIndexEntries++;
-		meta->index = realloc(meta->index, sizeof(IFIndexEntry)*meta->numIndexEntries);
 		
 		if (index < meta->numIndexEntries-1)
 			memmove(meta->index + index + 1, meta->index + index, sizeof(IFIndexEntry)*(meta->numIndexEntries-1-index));
@@ -973,20 +999,109 @@ static int IndexStory(IFMetabase meta, int storyNum, IFID ident) {
 	}
 }
 
-/* Retrieves the story in the metabase with the given ID (the story is created if it does not already exist) */
-IFStory IFMB_GetStoryWithId(IFMetabase meta, IFID ident) {
-	IFStory story;
+/* Adds the story with the specified number to the end of the index, to be sorted in later */
+static void AppendIndex(IFMetabase meta, int storyNum, IFID ident) {
+	if (ident->type == ID_NULL) {
+		return;
+	} else if (ident->type == ID_COMPOUND) {
+		int x;
+		
+		for (x=0; x<ident->data.compound.count; x++) {
+			AppendIndex(meta, storyNum, ident->data.compound.ids[x]);
+		}
+	} else {
+		ReserveIndex(meta, 1);
+		
+		meta->index[meta->numIndexEntries].id = ident;
+		meta->index[meta->numIndexEntries].storyNumber = storyNum;
+		meta->numIndexEntries++;
+		meta->numUnsorted++;
+	}
+}
 
-	/* Return the existing story if there's already an entry for this ID in the metabase */
-	story = ExistingStoryWithId(meta, ident);
-	if (story != NULL) return story;
+/* Orders index entries by ID (highest first, as NearestIndexNumber expects), and then by the order the stories were added in */
+static int CompareIndexEntries(const void* a, const void* b) {
+	const IFIndexEntry* entryA = a;
+	const IFIndexEntry* entryB = b;
+	int compare;
+	
+	compare = IFMB_CompareIds(entryB->id, entryA->id);
+	if (compare != 0) return compare;
+	
+	return entryA->storyNumber - entryB->storyNumber;
+}
+
+/* Sorts any bulk loaded entries into the index */
+/* Where stories share an ID, the most recently added one wins and the others are removed from the metabase */
+static void SortIndex(IFMetabase meta) {
+	char* removed;
+	int x, y, start;
+	
+	if (meta->numUnsorted <= 0) return;
+	meta->numUnsorted = 0;
+	
+	qsort(meta->index, meta->numIndexEntries, sizeof(IFIndexEntry), CompareIndexEntries);
+	
+	/* Mark the stories that have been replaced by later ones */
+	removed = calloc(meta->numStories+1, sizeof(char));
+	
+	for (start=0; start<meta->numIndexEntries; start=x) {
+		int newest;
+		
+		for (x=start+1; x<meta->numIndexEntries && IFMB_CompareIds(meta->index[start].id, meta->index[x].id) == 0; x++);
+		
+		newest = meta->index[x-1].storyNumber;
+		for (y=start; y<x-1; y++) {
+			if (meta->index[y].storyNumber != newest) removed[meta->index[y].storyNumber] = 1;
+		}
+	}
+	
+	/* Remove their entries from the index */
+	y = 0;
+	for (x=0; x<meta->numIndexEntries; x++) {
+		IFIndexEntry entry = meta->index[x];
+		
+		if (removed[entry.storyNumber]) continue;
+		
+		if (y > 0 && meta->index[y-1].storyNumber == entry.storyNumber && IFMB_CompareIds(meta->index[y-1].id, entry.id) == 0) {
+			/* The same ID appears twice in one compound ID: as with IndexStory, the duplicate becomes ID_NULL */
+			IFID storyId = meta->stories[entry.storyNumber]->id;
+			
+			entry.id->type = ID_NULL;
+			if (storyId->type == ID_COMPOUND && storyId->data.compound.idsNotNull) {
+				free(storyId->data.compound.idsNotNull);
+				storyId->data.compound.idsNotNull = NULL;
+			}
+			continue;
+		}
+		
+		meta->index[y++] = entry;
+	}
+	meta->numIndexEntries = y;
+	
+	/* Destroy the stories themselves */
+	for (x=0; x<meta->numStories; x++) {
+		if (removed[x]) {
+			FreeStory(meta->stories[x]);
+			meta->stories[x] = NULL;
+		}
+	}
+	
+	free(removed);
+}
+
+/* Creates a new, empty story with the given ID (which is copied), without indexing it */
+static IFStory NewStory(IFMetabase meta, IFID ident) {
+	IFStory story;
 	
-	/* Otherwise, create a new story entry */
 	story = malloc(sizeof(struct IFStory));
 	story->metabase = meta;
 	story->id = IFMB_CopyId(ident);
 	story->number = meta->numStories;
 	
+	story->xml = NULL;
+	story->xmlLength = 0;
+	
 	story->root = malloc(sizeof(struct IFValue));
 	story->root->key = NULL;
 	story->root->value = NULL;
@@ -994,16 +1109,46 @@ IFStory IFMB_GetStoryWithId(IFMetabase meta, IFID ident) {
 	story->root->children = NULL;
 	story->root->parent = NULL;
 	
-	/* Add this story to the index */
+	/* Add this story to the list of stories */
+	if (meta->numStories >= meta->storiesSize) {
+		meta->storiesSize = meta->storiesSize*2 + 16;
+		meta->stories = realloc(meta->stories, sizeof(IFStory)*meta->storiesSize);
+	}
+	
 	meta->numStories++;
-	meta->stories = realloc(meta->stories, sizeof(IFStory)*meta->numStories);
 	meta->stories[meta->numStories-1] = story;
 	
-	IndexStory(meta, meta->numStories-1, story->id);
+	return story;
+}
+
+/* Retrieves the story in the metabase with the given ID (the story is created if it does not already exist) */
+IFStory IFMB_GetStoryWithId(IFMetabase meta, IFID ident) {
+	IFStory story;
+
+	/* Return the existing story if there's already an entry for this ID in the metabase */
+	story = ExistingStoryWithId(meta, ident);
+	if (story != NULL) return story;
+	
+	/* Otherwise, create a new story entry */
+	story = NewStory(meta, ident);
+	
+	/* Add this story to the index */
+	IndexStory(meta, story->number, story->id);
 	
 	return story;
 }
 
+/* Starts a bulk load */
+void IFMB_BeginBulkLoad(IFMetabase meta) {
+	meta->bulkLoad++;
+}
+
+/* Finishes a bulk load, sorting the new stories into the index */
+void IFMB_EndBulkLoad(IFMetabase meta) {
+	if (meta->bulkLoad > 0) meta->bulkLoad--;
+	if (meta->bulkLoad == 0) SortIndex(meta);
+}
+
 /* Retrieves the ID associated with a given story object */
 IFID IFMB_IdForStory(IFStory story) {
 	return story->id;
@@ -1064,6 +1209,17 @@ void IFMB_CopyStory(IFMetabase meta, IFStory story, IFID id) {
 	if (meta == NULL) meta = story->metabase;
 	if (story == NULL) return;							/* Error! */
 	if (story->id == NULL) return;
+	
+	if (meta->bulkLoad > 0 && story->metabase != meta) {
+		/* Bulk loading: add the new story now, and deal with any stories it replaces when the index is sorted */
+		newStory = NewStory(meta, id!=NULL?id:story->id);
+		AppendIndex(meta, newStory->number, newStory->id);
+		
+		FreeValue(newStory->root);
+		newStory->root = CopyValue(story->root);
+		return;
+	}
+	
 	if (id == NULL && IFMB_GetStoryWithId(meta, story->id) == story) return;
 	if (id == NULL) id = story->id;
 	
@@ -1076,6 +1232,7 @@ void IFMB_CopyStory(IFMetabase meta, IFStory story, IFID id) {
 			
 			IFMB_FreeId(oldStory->id);
 			oldStory->id = IFMB_CopyId(id);
+			IFMB_StoryChanged(oldStory);
 			
 			IndexStory(meta, oldStory->number, oldStory->id);
 			
@@ -1095,6 +1252,7 @@ void IFMB_CopyStory(IFMetabase meta, IFStory story, IFID id) {
 	/* Copy the values */
 	FreeValue(newStory->root);
 	newStory->root = CopyValue(story->root);
+	IFMB_StoryChanged(newStory);
 }
 
 /* Returns non-zero if the metabase contains a story with a given ID */
@@ -1102,109 +1260,139 @@ int IFMB_ContainsStoryWithId(IFMetabase meta, IFID ident) {
 	return ExistingStoryWithId(meta, ident)!=NULL;
 }
 
-/* Finds the index of a value with the specified key */
-static int IndexForKey(IFValue parent, const char* key) {
-	int top, bottom, compare;
+/* Compares a (not yet lowercased) segment of a key path against a key */
+static int CompareSegment(const char* segment, int len, const char* key) {
+	int x;
 	
-	/* Binary search for the key */
-	top = parent->childCount;
+	for (x=0; x<len; x++) {
+		int a = (unsigned char)tolower((unsigned char)segment[x]);
+		int b = (unsigned char)key[x];
+		
+		if (a != b) return a - b;
+	}
+	
+	return key[len]==0?0:-1;
+}
+
+/* Finds the index of a value with the specified key (children are sorted with the highest key first) */
+/* Returns the last value with that key if there is one, or otherwise the last value with a higher key (-1 if none) */
+static int IndexForSegment(IFValue parent, const char* segment, int len) {
+	int top, bottom;
+	
+	/* Binary search for the number of children with keys that are higher than or equal to this one */
 	bottom = 0;
+	top = parent->childCount;
 	
 	while (top > bottom) {
 		int middle;
-		int compare;
 		
 		middle = (top+bottom)>>1;
 		
-		compare = strcmp(key, parent->children[middle]->key);
-		
-		if (compare == 0) {
-			/* Have found the value: if there is more than one with the same key, then return the very last one */
-			while (middle+1 < parent->childCount && strcmp(key, parent->children[middle+1]->key) == 0)
-				middle++;
-			
-			return middle;
-		}
-		
-		if (compare < 0) bottom = middle + 1;
-		if (compare > 0) top = middle - 1;
-	}
-	
-	/* Find the first value that's less than the key */
-	if (top >= 0 && top < parent->childCount) {
-		compare = strcmp(key, parent->children[top]->key);
-		
-		while (top >= 0 && compare > 0) {
-			top--;
-			
-			if (top >= 0) compare = strcmp(key, parent->children[top]->key);
+		if (CompareSegment(segment, len, parent->children[middle]->key) <= 0) {
+			bottom = middle + 1;
+		} else {
+			top = middle;
 		}
 	}
 	
-	if (top >= parent->childCount) top--;
-	
-	return top;
+	return bottom - 1;
 }
 
-/* Finds a value using the specified path, from the specified value, optionally creating a new entry */
-static IFValue FindValue(IFValue root, const char* path, int createEntry) {
-	char* key;
-	int x, dividerPos;
+static int IndexForKey(IFValue parent, const char* key) {
+	return IndexForSegment(parent, key, strlen(key));
+}
+
+/* Creates a new child value with the specified key, placing it after the child at index */
+static IFValue AddChild(IFValue parent, int index, const char* segment, int len) {
 	IFValue childValue;
-	int index;
-	int found;
+	int x;
 	
-	/* Base case: no path */
-	if (path == NULL || path[0] == 0) return root;
+	childValue = malloc(sizeof(struct IFValue));
 	
-	/* Get the key for this stage of the path */
-	for (x=0; path[x] != '.' && path[x] != '@' && path[x] != 0; x++);
-	dividerPos = x;
+	childValue->key = malloc(sizeof(char)*(len+1));
+	for (x=0; x<len; x++) childValue->key[x] = tolower((unsigned char)segment[x]);
+	childValue->key[len] = 0;
 	
-	key = malloc(sizeof(char)*dividerPos+1);
-	for (x=0; x<dividerPos; x++) key[x] = tolower(path[x]);
-	key[x] = 0;
+	childValue->value = NULL;
+	childValue->childCount = 0;
+	childValue->children = NULL;
+	childValue->parent = parent;
 	
-	/* Set childValue to the value for this part of the key */
-	index = IndexForKey(root, key);
+	/* Add it to the list of entries for this node */
+	parent->childCount++;
+	parent->children = realloc(parent->children, sizeof(IFValue)*parent->childCount);
 	
-	found = 1;
-	if (index < 0 || strcmp(key, root->children[index]->key) != 0) found = 0;
+	index++;
+	memmove(parent->children + index + 1, parent->children + index,  sizeof(IFValue)*(parent->childCount - 1 - index));
 	
-	/* Return NULL if the key is not found and we're not creating a new entry */
-	if (!found && createEntry == 0) {
-		free(key);
-		return NULL;
-	}
+	parent->children[index] = childValue;
+	
+	return childValue;
+}
+
+/* Returns the length of the first segment of a key path ('@' begins a new segment for an attribute) */
+static int SegmentLength(const char* path) {
+	int x;
 	
-	if (!found || (createEntry == 2 && path[dividerPos] == 0)) {
-		/* If createEntry is true, and the entry is not found (or this is the last entry and createEntry is 2), create a new entry */
-		childValue = malloc(sizeof(struct IFValue));
+	for (x=(path[0]=='@'); path[x] != '.' && path[x] != '@' && path[x] != 0; x++);
+	
+	return x;
+}
+
+/* Finds a value using the specified path, from the specified value, optionally creating a new entry */
+/* If createEntry is 2, a new value is always created for the last part of the path */
+static IFValue FindValue(IFValue root, const char* path, int createEntry) {
+	if (path == NULL) return root;
+	
+	while (path[0] != 0) {
+		int len, index, found;
 		
-		childValue->key = malloc(sizeof(char)*(strlen(key)+1));
-		strcpy(childValue->key, key);
-		childValue->value = NULL;
-		childValue->childCount = 0;
-		childValue->children = NULL;
-		childValue->parent = root;
+		/* Find the value for this stage of the path */
+		len = SegmentLength(path);
+		index = IndexForSegment(root, path, len);
 		
-		/* Add it to the list of entries for this node */
-		root->childCount++;
-		root->children = realloc(root->children, sizeof(IFValue)*root->childCount);
+		found = index >= 0 && CompareSegment(path, len, root->children[index]->key) == 0;
 		
-		index++;
-		memmove(root->children + index + 1, root->children + index,  sizeof(IFValue)*(root->childCount - 1 - index));
+		/* Return NULL if the key is not found and we're not creating a new entry */
+		if (!found && createEntry == 0) return NULL;
 		
-		root->children[index] = childValue;
-	} else {
-		childValue = root->children[index];
+		if (!found || (createEntry == 2 && path[len] == 0)) {
+			root = AddChild(root, index, path, len);
+		} else {
+			root = root->children[index];
+		}
+		
+		/* Continue to the next branch */
+		path += len;
+		if (path[0] == '.') path++;
 	}
 	
-	/* Continue to the next branch */
-	if (path[dividerPos] == '.') dividerPos++;
+	return root;
+}
+
+/* As for FindValue, but using a compiled key path */
+static IFValue FindValueForPath(IFValue root, IFKeyPath path, int createEntry) {
+	int x;
 	
-	free(key);
-	return FindValue(childValue, path + dividerPos, createEntry);
+	for (x=0; x<path->numSegments; x++) {
+		const char* key;
+		int index, found;
+		
+		key = path->segments[x];
+		
+		index = IndexForKey(root, key);
+		found = index >= 0 && strcmp(key, root->children[index]->key) == 0;
+		
+		if (!found && createEntry == 0) return NULL;
+		
+		if (!found || (createEntry == 2 && x == path->numSegments-1)) {
+			root = AddChild(root, index, key, strlen(key));
+		} else {
+			root = root->children[index];
+		}
+	}
+	
+	return root;
 }
 
 /* Returns a UTF-16 string for a given parameter in a story, or NULL if none was found */
@@ -1226,6 +1414,81 @@ void IFMB_SetValue(IFStory story, const char* valueKey, IFChar* utf16value) {
 	IFValue value;
 	
 	value = FindValue(story->root, valueKey, 1);
+	IFMB_StoryChanged(story);
+	
+	if (value->value != NULL) free(value->value);
+	
+	if (utf16value == NULL) {
+		value->value = NULL;
+	} else {
+		value->value = malloc(sizeof(IFChar)*(IFMB_StrLen(utf16value)+1));
+		IFMB_StrCpy(value->value, utf16value);
+	}
+}
+
+/* Functions - key paths */
+
+/* Splits up a value key ready for looking up in many stories */
+IFKeyPath IFMB_CompileKeyPath(const char* valueKey) {
+	IFKeyPath result;
+	const char* path;
+	
+	result = malloc(sizeof(struct IFKeyPath));
+	result->numSegments = 0;
+	result->segments = NULL;
+	
+	path = valueKey;
+	while (path != NULL && path[0] != 0) {
+		int len, x;
+		char* segment;
+		
+		len = SegmentLength(path);
+		
+		segment = malloc(sizeof(char)*(len+1));
+		for (x=0; x<len; x++) segment[x] = tolower((unsigned char)path[x]);
+		segment[len] = 0;
+		
+		result->numSegments++;
+		result->segments = realloc(result->segments, sizeof(char*)*result->numSegments);
+		
+		result->segments[result->numSegments-1] = segment;
+		
+		path += len;
+		if (path[0] == '.') path++;
+	}
+	
+	return result;
+}
+
+/* Frees a compiled key path */
+void IFMB_FreeKeyPath(IFKeyPath path) {
+	int x;
+	
+	for (x=0; x<path->numSegments; x++) free(path->segments[x]);
+	
+	if (path->segments) free(path->segments);
+	free(path);
+}
+
+/* As for IFMB_GetValue, but using a compiled key path */
+IFChar* IFMB_GetValueForPath(IFStory story, IFKeyPath path) {
+	IFValue value;
+	
+	value = FindValueForPath(story->root, path, 0);
+	
+	if (value != NULL) {
+		return value->value;
+	} else {
+		return NULL;
+	}
+}
+
+/* As for IFMB_SetValue, but using a compiled key path */
+void IFMB_SetValueForPath(IFStory story, IFKeyPath path, IFChar* utf16value) {
+	IFValue value;
+	
+	value = FindValueForPath(story->root, path, 1);
+	IFMB_StoryChanged(story);
 	
 	if (value->value != NULL) free(value->value);
 	
@@ -1241,6 +1504,7 @@ void IFMB_SetValue(IFStory story, const char* valueKey, IFChar* utf16value) {
 /* Use this before calling IFMB_SetValue to set multiple values for the same key */
 void IFMB_AddValue(IFStory story, const char* valueKey) {
 	FindValue(story->root, valueKey, 2);
+	IFMB_StoryChanged(story);
 }
 
 /* Functions - iterating */
@@ -1249,6 +1513,9 @@ void IFMB_AddValue(IFStory story, const char* valueKey) {
 IFStoryIterator IFMB_GetStoryIterator(IFMetabase meta) {
 	IFStoryIterator result = malloc(sizeof(struct IFStoryIterator));
 	
+	/* Bulk loaded stories may replace others: find out which before iterating */
+	SortIndex(meta);
+	
 	result->metabase = meta;
 	result->count = -1;
 	
@@ -1261,6 +1528,7 @@ IFValueIterator IFMB_GetValueIterator(IFStory story) {
 	
 	result = malloc(sizeof(struct IFValueIterator));
 	
+	result->story = story;
 	result->root = story->root;
 	result->count = -1;
 	
@@ -1345,6 +1613,7 @@ IFValueIterator IFMB_ChildrenFromIterator(IFValueIterator iter) {
 	/* Construct a new value iterator for the children of this iterator */
 	result = malloc(sizeof(struct IFValueIterator));
 	
+	result->story = iter->story;
 	result->root = newRoot;
 	result->count = -1;
 	
@@ -1427,6 +1696,7 @@ IFValueIterator IFMB_GetValueIteratorForKey(IFStory story, const char* valueKey)
 	/* Create the iterator */
 	result = malloc(sizeof(struct IFValueIterator));
 	
+	result->story = story;
 	result->root = root;
 	result->count = keyIndex;
 	
@@ -1442,12 +1712,14 @@ void IFMB_DeleteIteratorValue(IFValueIterator iter) {
 	IFValue root;
 	IFValue oldValue;
 	
+	IFMB_StoryChanged(iter->story);
+	
 	/* Remember the value that we're going to delete */
 	root = iter->root;
 	oldValue = root->children[iter->count];
 	
 	/* Remove it from the list of values */
-	memmove(root->children + iter->count, root->children + iter->count + 1, root->childCount - iter->count - 1);
+	memmove(root->children + iter->count, root->children + iter->count + 1, sizeof(IFValue)*(root->childCount - iter->count - 1));
 	root->childCount--;
 	
 	FreeValue(oldValue);
@@ -1458,6 +1730,8 @@ void IFMB_DeleteIteratorValue(IFValueIterator iter) {
 
 /* Sets the value for an iterator */
 void IFMB_SetIteratorValue(IFValueIterator iter, IFChar* utf16value) {
+	IFMB_StoryChanged(iter->story);
+	
 	/* Free the old value for the key pointed to by the iterator */
 	if (iter->root->children[iter->count]->value != NULL) {
 		free(iter->root->children[iter->count]->value);
@@ -1484,6 +1758,523 @@ void IFMB_FreeValueIterator(IFValueIterator iter) {
 	free(iter);
 }
 	
+/* Functions - snapshots */
+
+/*
+ * Snapshots are a series of big-endian 32-bit words. Strings are stored as a length word followed
+ * by their bytes padded out to a word boundary, with a length of 0xffffffff for NULL. UTF-16
+ * strings are stored the same way, with 2 bytes per character.
+ *
+ *   'IFMB' <version> <stamp> <story count> <stories...> <index count> <index entries...>
+ *
+ * A story is its ID followed by its root value; a value is its key, its string value, its child
+ * count and then its children. Index entries are stored in index order as a story number and the
+ * position of the ID within that story's compound ID, so the index is rebuilt without sorting.
+ */
+
+#define SnapshotMagic 0x49464d42ul
+#define SnapshotVersion 1
+#define SnapshotNull 0xfffffffful
+
+typedef struct SnapshotWriter {
+	int(*writeFunction)(const char* bytes, int length, void* userData);
+	void* userData;
+	
+	int pos;
+	unsigned char buf[8192];
+} SnapshotWriter;
+
+static void SnapByte(SnapshotWriter* w, int byte) {
+	if (w->pos >= (int)sizeof(w->buf)) {
+		w->writeFunction((const char*)w->buf, w->pos, w->userData);
+		w->pos = 0;
+	}
+	
+	w->buf[w->pos++] = byte;
+}
+
+static void SnapWord(SnapshotWriter* w, unsigned long word) {
+	SnapByte(w, (word>>24)&0xff);
+	SnapByte(w, (word>>16)&0xff);
+	SnapByte(w, (word>>8)&0xff);
+	SnapByte(w, word&0xff);
+}
+
+static void SnapBytes(SnapshotWriter* w, const unsigned char* bytes, int length) {
+	int x;
+	
+	for (x=0; x<length; x++) SnapByte(w, bytes[x]);
+	for (; (x&3) != 0; x++) SnapByte(w, 0);
+}
+
+static void SnapString(SnapshotWriter* w, const char* string) {
+	int len;
+	
+	if (string == NULL) {
+		SnapWord(w, SnapshotNull);
+		return;
+	}
+	
+	len = strlen(string);
+	SnapWord(w, len);
+	SnapBytes(w, (const unsigned char*)string, len);
+}
+
+static void SnapUtf16(SnapshotWriter* w, const IFChar* string) {
+	int x, len;
+	
+	if (string == NULL) {
+		SnapWord(w, SnapshotNull);
+		return;
+	}
+	
+	len = IFMB_StrLen(string);
+	SnapWord(w, len);
+	
+	for (x=0; x<len; x++) {
+		SnapByte(w, (string[x]>>8)&0xff);
+		SnapByte(w, string[x]&0xff);
+	}
+	if (len&1) {
+		SnapByte(w, 0);
+		SnapByte(w, 0);
+	}
+}
+
+static void SnapId(SnapshotWriter* w, IFID ident) {
+	int x;
+	
+	SnapWord(w, ident->type);
+	
+	switch (ident->type) {
+		case ID_UUID:
+			SnapBytes(w, ident->data.uuid, 16);
+			break;
+			
+		case ID_ZCODE:
+			SnapWord(w, (unsigned long)ident->data.zcode.release);
+			SnapBytes(w, (const unsigned char*)ident->data.zcode.serial, 6);
+			SnapWord(w, (unsigned long)ident->data.zcode.checksum);
+			break;
+			
+		case ID_GLULX:
+			SnapWord(w, (unsigned long)ident->data.glulx.release);
+			SnapBytes(w, (const unsigned char*)ident->data.glulx.serial, 6);
+			SnapWord(w, ident->data.glulx.checksum);
+			break;
+			
+		case ID_GLULXNOTINFORM:
+			SnapWord(w, ident->data.glulxNotInform.memsize);
+			SnapWord(w, ident->data.glulxNotInform.checksum);
+			break;
+			
+		case ID_MD5:
+			SnapBytes(w, ident->data.md5.md5, 16);
+			SnapString(w, (const char*)ident->data.md5.systemId);
+			break;
+			
+		case ID_GENERIC:
+			SnapString(w, ident->data.generic.idString);
+			break;
+			
+		case ID_COMPOUND:
+			SnapWord(w, ident->data.compound.count);
+			for (x=0; x<ident->data.compound.count; x++) {
+				SnapId(w, ident->data.compound.ids[x]);
+			}
+			break;
+			
+		default:
+			break;
+	}
+}
+
+static void SnapValue(SnapshotWriter* w, IFValue value) {
+	int x;
+	
+	SnapString(w, value->key);
+	SnapUtf16(w, value->value);
+	SnapWord(w, value->childCount);
+	
+	for (x=0; x<value->childCount; x++) {
+		SnapValue(w, value->children[x]);
+	}
+}
+
+/* Writes a snapshot of the metabase using the specified function */
+void IFMB_WriteSnapshot(IFMetabase meta, const char* stamp, int(*writeFunction)(const char* bytes, int length, void* userData), void* userData) {
+	SnapshotWriter* w;
+	int* storyNumbers;
+	int x, count;
+	
+	SortIndex(meta);
+	
+	w = malloc(sizeof(SnapshotWriter));
+	w->writeFunction = writeFunction;
+	w->userData = userData;
+	w->pos = 0;
+	
+	/* Header */
+	SnapWord(w, SnapshotMagic);
+	SnapWord(w, SnapshotVersion);
+	SnapString(w, stamp);
+	
+	/* Removed stories leave gaps in the story list, which are closed up in the snapshot */
+	storyNumbers = malloc(sizeof(int)*(meta->numStories+1));
+	count = 0;
+	for (x=0; x<meta->numStories; x++) {
+		storyNumbers[x] = count;
+		if (meta->stories[x] != NULL) count++;
+	}
+	
+	/* The stories */
+	SnapWord(w, count);
+	for (x=0; x<meta->numStories; x++) {
+		if (meta->stories[x] == NULL) continue;
+		
+		SnapId(w, meta->stories[x]->id);
+		SnapValue(w, meta->stories[x]->root);
+	}
+	
+	/* The index */
+	SnapWord(w, meta->numIndexEntries);
+	for (x=0; x<meta->numIndexEntries; x++) {
+		IFID storyId;
+		int component;
+		
+		storyId = meta->stories[meta->index[x].storyNumber]->id;
+		component = 0;
+		
+		if (storyId->type == ID_COMPOUND) {
+			while (storyId->data.compound.ids[component] != meta->index[x].id) component++;
+		}
+		
+		SnapWord(w, storyNumbers[meta->index[x].storyNumber]);
+		SnapWord(w, component);
+	}
+	
+	/* Finish up */
+	if (w->pos > 0) writeFunction((const char*)w->buf, w->pos, userData);
+	
+	free(storyNumbers);
+	free(w);
+}
+
+typedef struct SnapshotReader {
+	const unsigned char* data;
+	size_t size;
+	size_t pos;
+	
+	int failed;
+} SnapshotReader;
+
+static unsigned long ReadWord(SnapshotReader* r) {
+	const unsigned char* word;
+	
+	if (r->failed || r->size - r->pos < 4) {
+		r->failed = 1;
+		return 0;
+	}
+	
+	word = r->data + r->pos;
+	r->pos += 4;
+	
+	return ((unsigned long)word[0]<<24)|((unsigned long)word[1]<<16)|((unsigned long)word[2]<<8)|(unsigned long)word[3];
+}
+
+/* Reads a signed value written by SnapWord */
+static long ReadSigned(SnapshotReader* r) {
+	unsigned long word = ReadWord(r);
+	
+	if (word & 0x80000000ul) return -(long)(0xfffffffful - word) - 1;
+	return (long)word;
+}
+
+/* Reads a count of items, each at least minSize bytes long (fails if there can't be that many) */
+static int ReadCount(SnapshotReader* r, int minSize) {
+	unsigned long count = ReadWord(r);
+	
+	if (r->failed || count > (r->size - r->pos)/minSize) {
+		r->failed = 1;
+		return 0;
+	}
+	
+	return (int)count;
+}
+
+/* Returns a pointer to the next length bytes (and skips any padding after them) */
+static const unsigned char* ReadBytes(SnapshotReader* r, unsigned long length) {
+	const unsigned char* bytes;
+	unsigned long padded = (length+3)&~3ul;
+	
+	if (r->failed || padded < length || r->size - r->pos < padded) {
+		r->failed = 1;
+		return NULL;
+	}
+	
+	bytes = r->data + r->pos;
+	r->pos += padded;
+	
+	return bytes;
+}
+
+static char* ReadString(SnapshotReader* r) {
+	unsigned long len;
+	const unsigned char* bytes;
+	char* result;
+	
+	len = ReadWord(r);
+	if (len == SnapshotNull) return NULL;
+	
+	bytes = ReadBytes(r, len);
+	if (bytes == NULL) return NULL;
+	
+	result = malloc(sizeof(char)*(len+1));
+	memcpy(result, bytes, len);
+	result[len] = 0;
+	
+	return result;
+}
+
+static IFChar* ReadUtf16(SnapshotReader* r) {
+	unsigned long x, len;
+	const unsigned char* bytes;
+	IFChar* result;
+	
+	len = ReadWord(r);
+	if (len == SnapshotNull) return NULL;
+	if (len > r->size) {
+		r->failed = 1;
+		return NULL;
+	}
+	
+	bytes = ReadBytes(r, len*2);
+	if (bytes == NULL) return NULL;
+	
+	result = malloc(sizeof(IFChar)*(len+1));
+	for (x=0; x<len; x++) {
+		result[x] = (bytes[x*2]<<8)|bytes[x*2+1];
+	}
+	result[len] = 0;
+	
+	return result;
+}
+
+static IFID ReadId(SnapshotReader* r) {
+	IFID result;
+	const unsigned char* bytes;
+	unsigned long type;
+	
+	type = ReadWord(r);
+	if (r->failed || type > ID_COMPOUND) {
+		r->failed = 1;
+		return NULL;
+	}
+	
+	result = malloc(sizeof(struct IFID));
+	result->type = type;
+	
+	switch (type) {
+		case ID_UUID:
+			bytes = ReadBytes(r, 16);
+			if (bytes) memcpy(result->data.uuid, bytes, 16);
+			break;
+			
+		case ID_ZCODE:
+			result->data.zcode.release = ReadSigned(r);
+			bytes = ReadBytes(r, 6);
+			if (bytes) memcpy(result->data.zcode.serial, bytes, 6);
+			result->data.zcode.checksum = ReadSigned(r);
+			break;
+			
+		case ID_GLULX:
+			result->data.glulx.release = ReadSigned(r);
+			bytes = ReadBytes(r, 6);
+			if (bytes) memcpy(result->data.glulx.serial, bytes, 6);
+			result->data.glulx.checksum = ReadWord(r);
+			break;
+			
+		case ID_GLULXNOTINFORM:
+			result->data.glulxNotInform.memsize = ReadWord(r);
+			result->data.glulxNotInform.checksum = ReadWord(r);
+			break;
+			
+		case ID_MD5:
+			bytes = ReadBytes(r, 16);
+			if (bytes) memcpy(result->data.md5.md5, bytes, 16);
+			result->data.md5.systemId = (unsigned char*)ReadString(r);
+			break;
+			
+		case ID_GENERIC:
+			result->data.generic.idString = ReadString(r);
+			if (result->data.generic.idString == NULL) {
+				/* Generic IDs must have a string */
+				r->failed = 1;
+				result->type = ID_NULL;
+			}
+			break;
+			
+		case ID_COMPOUND:
+		{
+			int x, count;
+			
+			count = ReadCount(r, 4);
+			
+			result->data.compound.count = 0;
+			result->data.compound.ids = malloc(sizeof(IFID)*(count+1));
+			result->data.compound.idsNotNull = NULL;
+			
+			for (x=0; x<count && !r->failed; x++) {
+				IFID component = ReadId(r);
+				if (component == NULL) break;
+				
+				result->data.compound.ids[result->data.compound.count++] = component;
+			}
+			break;
+		}
+			
+		default:
+			break;
+	}
+	
+	if (r->failed) {
+		IFMB_FreeId(result);
+		return NULL;
+	}
+	
+	return result;
+}
+
+static IFValue ReadValue(SnapshotReader* r, IFValue parent) {
+	IFValue result;
+	int x, count;
+	
+	result = malloc(sizeof(struct IFValue));
+	result->key = ReadString(r);
+	result->value = ReadUtf16(r);
+	result->childCount = 0;
+	result->children = NULL;
+	result->parent = parent;
+	
+	/* Every value other than the root has a key */
+	if (parent != NULL && result->key == NULL) r->failed = 1;
+	
+	count = ReadCount(r, 12);
+	if (count > 0) result->children = malloc(sizeof(IFValue)*count);
+	
+	for (x=0; x<count && !r->failed; x++) {
+		IFValue child = ReadValue(r, result);
+		if (child == NULL) break;
+		
+		result->children[result->childCount++] = child;
+	}
+	
+	if (r->failed) {
+		FreeValue(result);
+		return NULL;
+	}
+	
+	return result;
+}
+
+/* Loads a snapshot into an empty metabase. Returns 0 if the snapshot is stale or damaged, in which case the metabase is left empty */
+int IFMB_ReadSnapshot(IFMetabase meta, const char* stamp, const unsigned char* data, size_t size) {
+	SnapshotReader r;
+	char* snapshotStamp;
+	int x, count;
+	
+	if (meta->numStories != 0) return 0;
+	
+	r.data = data;
+	r.size = size;
+	r.pos = 0;
+	r.failed = 0;
+	
+	/* Check the header */
+	if (ReadWord(&r) != SnapshotMagic) return 0;
+	if (ReadWord(&r) != SnapshotVersion) return 0;
+	
+	snapshotStamp = ReadString(&r);
+	if (snapshotStamp == NULL || stamp == NULL || strcmp(snapshotStamp, stamp) != 0) {
+		if (snapshotStamp) free(snapshotStamp);
+		return 0;
+	}
+	free(snapshotStamp);
+	
+	/* Read the stories */
+	count = ReadCount(&r, 16);
+	
+	meta->storiesSize = count;
+	meta->stories = realloc(meta->stories, sizeof(IFStory)*(count+1));
+	
+	for (x=0; x<count && !r.failed; x++) {
+		IFStory story;
+		IFID ident;
+		IFValue root;
+		
+		ident = ReadId(&r);
+		if (ident == NULL) break;
+		
+		root = ReadValue(&r, NULL);
+		if (root == NULL) {
+			IFMB_FreeId(ident);
+			break;
+		}
+		
+		story = malloc(sizeof(struct IFStory));
+		story->metabase = meta;
+		story->number = meta->numStories;
+		story->id = ident;
+		story->root = root;
+		story->xml = NULL;
+		story->xmlLength = 0;
+		
+		meta->stories[meta->numStories++] = story;
+	}
+	
+	/* Rebuild the index */
+	count = ReadCount(&r, 8);
+	
+	meta->indexSize = count;
+	meta->index = realloc(meta->index, sizeof(IFIndexEntry)*(count+1));
+	
+	for (x=0; x<count && !r.failed; x++) {
+		unsigned long storyNumber, component;
+		IFID storyId;
+		
+		storyNumber = ReadWord(&r);
+		component = ReadWord(&r);
+		if (r.failed || storyNumber >= (unsigned long)meta->numStories) break;
+		
+		storyId = meta->stories[storyNumber]->id;
+		if (storyId->type == ID_COMPOUND) {
+			if (component >= (unsigned long)storyId->data.compound.count) break;
+			storyId = storyId->data.compound.ids[component];
+		} else if (component != 0) {
+			break;
+		}
+		
+		/* A damaged index would make searches go wrong, so check the order */
+		if (storyId->type == ID_NULL || storyId->type == ID_COMPOUND) break;
+		if (x > 0 && IFMB_CompareIds(meta->index[x-1].id, storyId) <= 0) break;
+		
+		meta->index[x].id = storyId;
+		meta->index[x].storyNumber = storyNumber;
+		meta->numIndexEntries++;
+	}
+	
+	if (r.failed || meta->numIndexEntries != count) {
+		/* Throw away anything that was loaded */
+		for (x=0; x<meta->numStories; x++) FreeStory(meta->stories[x]);
+		
+		meta->numStories = 0;
+		meta->numIndexEntries = 0;
+		return 0;
+	}
+	
+	return 1;
+}
+
 /* Functions - basic UTF-16 string manipulation */
 
 int IFMB_StrLen(const IFChar* a) {
@@ -9,6 +9,8 @@
 #ifndef __IFMETABASE_H
 #define __IFMETABASE_H
 
+#include <stdlib.h>
+
 /*
  * The metabase is a set of functions designed for creating and manipulating metadata in the
  * 'iFiction' format. It deals with the metadata in an abstract sense: this library does not
@@ -40,6 +42,8 @@ typedef struct IFMetabase* IFMetabase;				/* A metabase */
 typedef struct IFID* IFID;							/* A story identifier */
 typedef struct IFStory* IFStory;					/* A story entry in the metabase */
 
+typedef struct IFKeyPath* IFKeyPath;				/* A value key that has been split up in advance */
+
 typedef struct IFStoryIterator* IFStoryIterator;	/* An iterator that covers all stories */
 typedef struct IFValueIterator* IFValueIterator;	/* An iterator that covers the values set for a story */
 
@@ -51,6 +55,30 @@ extern IFMetabase IFMB_Create();
 /* Frees up all the memory associated with a metabase */
 extern void IFMB_Free(IFMetabase meta);
 
+/* 
+ * Starts/finishes a bulk load. While a bulk load is in progress, stories copied in from another
+ * metabase with IFMB_CopyStory are added without updating the index: the index is sorted once
+ * when the load finishes (or when something needs to search it). The results are the same as
+ * copying the stories one at a time: a story replaces any earlier story that shares an ID.
+ */
+extern void IFMB_BeginBulkLoad(IFMetabase meta);
+extern void IFMB_EndBulkLoad(IFMetabase meta);
+
+/* Functions - snapshots */
+
+/*
+ * A snapshot is a compact binary copy of a metabase (index included), which can be loaded much
+ * more quickly than the iFiction file it was made from, and straight from a memory-mapped file.
+ * The stamp is a string identifying the source of the snapshot (the size and date of the original
+ * file, say): a snapshot is only loaded if its stamp and format version match.
+ */
+
+/* Writes a snapshot of the metabase using the specified function */
+extern void IFMB_WriteSnapshot(IFMetabase meta, const char* stamp, int(*writeFunction)(const char* bytes, int length, void* userData), void* userData);
+
+/* Loads a snapshot into an empty metabase. Returns 0 if the snapshot is stale or damaged, in which case the metabase is left empty */
+extern int IFMB_ReadSnapshot(IFMetabase meta, const char* stamp, const unsigned char* data, size_t size);
+
 /* Functions - IFIDs */
 
 /* Takes an ID string and produces a corresponding IFID structure, or NULL if the string is invalid */
@@ -117,6 +145,24 @@ extern void IFMB_SetValue(IFStory story, const char* valueKey, IFChar* utf16valu
 /* Use this before calling IFMB_SetValue to set multiple values for the same key */
 extern void IFMB_AddValue(IFStory story, const char* valueKey);
 
+/* Functions - key paths */
+
+/* 
+ * Looking up a value by a compiled key path avoids splitting up and lowercasing the key on every
+ * call. Use these when reading the same value from many stories (when sorting, say). A key path
+ * isn't changed after it's compiled, so one can be shared between threads.
+ */
+
+/* Compiles a value key (like "bibliographic.title") into a key path */
+extern IFKeyPath IFMB_CompileKeyPath(const char* valueKey);
+
+/* Frees a compiled key path */
+extern void IFMB_FreeKeyPath(IFKeyPath path);
+
+/* As for IFMB_GetValue and IFMB_SetValue, but using a compiled key path */
+extern IFChar* IFMB_GetValueForPath(IFStory story, IFKeyPath path);
+extern void IFMB_SetValueForPath(IFStory story, IFKeyPath path, IFChar* utf16value);
+
 /* Functions - iterating */
 
 /* Gets an iterator covering all the stories in the given metabase */
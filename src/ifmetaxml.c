@@ -15,6 +15,7 @@
 #include <expat.h>
 
 #include "ifmetaxml.h"
+#include "ifmetabase-internal.h"
 
 /* == Reading ifiction records == */
 
@@ -36,6 +37,8 @@ static XMLCALL void CharData    (void *userData,
 /* The parser state structure */
 typedef struct IFXmlTag {
 	IFChar* value;
+	int valueLen;				/* Length of the value so far */
+	int valueSize;				/* Allocated size of the value */
 	XML_Char* name;
 	int failed;
 	
@@ -94,7 +97,9 @@ void IF_ReadIfiction(IFMetabase meta, const unsigned char* xml, size_t size) {
 	XML_SetUserData(theParser, currentState);
 	
 	/* Ready? Go! */
+	IFMB_BeginBulkLoad(meta);
 	XML_Parse(theParser, (const char*)xml, size, 1);
+	IFMB_EndBulkLoad(meta);
 	
 	/* Clear up any temp stuff we may have created */
 	if (currentState->storyId) IFMB_FreeId(currentState->storyId);
@@ -216,6 +221,14 @@ static IFChar* Xmdchar(const XML_Char* s, int len) {
 	return res;
 }
 
+/* Makes room for extra more characters (plus a terminator) in the value of a tag */
+static void GrowTagValue(IFXmlTag* tag, int extra) {
+	if (tag->valueLen + extra + 1 <= tag->valueSize) return;
+	
+	tag->valueSize = (tag->valueLen + extra + 1)*2;
+	tag->value = realloc(tag->value, sizeof(IFChar)*tag->valueSize);
+}
+
 /* Error handling/reporting */
 
 char* IF_StringForError(IFXmlError errorCode) {
@@ -268,6 +281,8 @@ static XMLCALL void StartElement(void *userData,
 
 	tag->value = malloc(sizeof(IFChar));
 	tag->value[0] = 0;
+	tag->valueLen = 0;
+	tag->valueSize = 1;
 	tag->name = malloc(sizeof(char)*(strlen(name)+1));
 	tag->path = NULL;
 	strcpy(tag->name, name);
@@ -312,12 +327,12 @@ static XMLCALL void StartElement(void *userData,
 	} else if (XCstrcmp(name, "br") == 0) {
 		/* 'br' tags are allowed anywhere and just add a newline to the tag value */
 		if (state->tag->parent) {
-			int valueLen = IFMB_StrLen(state->tag->parent->value);
+			IFXmlTag* parentTag = state->tag->parent;
 			
-			state->tag->parent->value = realloc(state->tag->parent->value, sizeof(IFChar)*(valueLen+2));
+			GrowTagValue(parentTag, 1);
 			
-			state->tag->parent->value[valueLen] = '\n';
-			state->tag->parent->value[valueLen+1] = 0;
+			parentTag->value[parentTag->valueLen++] = '\n';
+			parentTag->value[parentTag->valueLen] = 0;
 		}
 	} else if (state->version == 90) {
 		
@@ -501,6 +516,7 @@ static XMLCALL void EndElement(void *userData,
 	
 	if (pos > 0 && state->tag->value[pos-1] == ' ') pos--;
 	state->tag->value[pos] = 0;
+	state->tag->valueLen = pos;
 	
 	value = state->tag->value;
 
@@ -766,6 +782,7 @@ static XMLCALL void CharData(void *userData,
 	IFXmlState* state;
 	int valueLen, charDataLen, x;
 	IFChar* charData;
+	IFXmlTag* tag;
 	
 	/* Get the state */
 	state = (IFXmlState*)userData;
@@ -776,22 +793,24 @@ static XMLCALL void CharData(void *userData,
 	/* Append the character data for the current tag */
 	charData = Xmdchar(s, len);
 	charDataLen = IFMB_StrLen(charData);
-	valueLen = IFMB_StrLen(state->tag->value);
+	tag = state->tag;
+	valueLen = tag->valueLen;
 	
-	state->tag->value = realloc(state->tag->value, sizeof(IFChar)*(valueLen+charDataLen+1));
+	GrowTagValue(tag, charDataLen);
 	
 	for (x=0; x<charDataLen; x++) {
 		IFChar c = charData[x];
 		
 		/* All whitespace characters become spaces */
 		if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
-			state->tag->value[valueLen+x] = ' ';
+			tag->value[valueLen+x] = ' ';
 		} else {
-			state->tag->value[valueLen+x] = charData[x];
+			tag->value[valueLen+x] = charData[x];
 		}
 	}
 	
-	state->tag->value[valueLen+charDataLen] = 0;
+	tag->valueLen = valueLen+charDataLen;
+	tag->value[tag->valueLen] = 0;
 	
 	/* Tidy up after ourselves */
 	free(charData);
@@ -799,69 +818,118 @@ static XMLCALL void CharData(void *userData,
 
 /* == Writing ifiction records == */
 
-static unsigned char* MakeUtf8Xml(IFChar* string, int allowNewlines) {
-	unsigned char* res = NULL;
-	int len = 0;
-	int pos = 0;
-	int x;
+/* 
+ * Output goes through a buffer: either a fixed-size chunk that's passed to the write function
+ * whenever it fills up, or (with no write function) one that grows to hold everything written.
+ */
+typedef struct IFXmlBuffer {
+	unsigned char* data;
+	int length;
+	int size;
+	
+	int(*writeFunction)(const char* bytes, int length, void* userData);
+	void* userData;
+} IFXmlBuffer;
+
+#define IFXmlChunkSize 65536
+
+/* Returns a pointer to somewhere with space for at least bytes more bytes in the buffer */
+static unsigned char* BufferReserve(IFXmlBuffer* buf, int bytes) {
+	if (buf->length + bytes <= buf->size) return buf->data + buf->length;
+	
+	if (buf->writeFunction != NULL && buf->length > 0) {
+		/* Pass on what we've got so far */
+		buf->writeFunction((const char*)buf->data, buf->length, buf->userData);
+		buf->length = 0;
+		
+		if (bytes <= buf->size) return buf->data;
+	}
+	
+	buf->size = (buf->length + bytes)*2;
+	buf->data = realloc(buf->data, sizeof(unsigned char)*buf->size);
+	
+	return buf->data + buf->length;
+}
+
+static void BufferBytes(IFXmlBuffer* buf, const unsigned char* bytes, int length) {
+	if (buf->writeFunction != NULL && length >= buf->size) {
+		/* Large blocks can go straight to the write function */
+		if (buf->length > 0) buf->writeFunction((const char*)buf->data, buf->length, buf->userData);
+		buf->length = 0;
+		
+		buf->writeFunction((const char*)bytes, length, buf->userData);
+		return;
+	}
+	
+	memcpy(BufferReserve(buf, length), bytes, length);
+	buf->length += length;
+}
+
+static void BufferString(IFXmlBuffer* buf, const char* string) {
+	BufferBytes(buf, (const unsigned char*)string, strlen(string));
+}
+
+/* How each ASCII character is written: 0 = as itself, 1 = escaped, 2 = newline, 3 = dropped */
+static const unsigned char xmlCharClass[128] = {
+	3,3,3,3,3,3,3,3,3,3,2,3,3,3,3,3, 3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,
+	0,0,1,0,0,0,1,1,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,1,0,1,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+	0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+
+/* Writes a string as UTF-8, escaped for XML. Newlines become <br/> tags if allowed, or are dropped otherwise */
+static void BufferXml(IFXmlBuffer* buf, const IFChar* string, int allowNewlines) {
+	unsigned char* out;
+	int x, len;
 	
-#define add(c) if (len <= pos) { len += 256; res = realloc(res, sizeof(unsigned char)*len); } res[pos++] = c
+	/* No character takes more than 6 bytes to write, so reserve enough space for the whole string up front */
+	len = IFMB_StrLen(string);
+	out = BufferReserve(buf, len*6);
 	
-	for (x=0; string[x] != 0; x++) {
+	for (x=0; x<len; x++) {
 		IFChar chr = string[x];
 		
-		switch (chr) {
-			case '<':
-				add('&'); add('l'); add('t'); add(';');
-				break;
-			case '>':
-				add('&'); add('g'); add('t'); add(';');
-				break;
-			case '&':
-				add('&'); add('a'); add('m'); add('p'); add(';');
-				break;
-			case '\'':
-				add('&'); add('a'); add('p'); add('o'); add('s'); add(';');
-				break;
-			case '\"':
-				add('&'); add('q'); add('u'); add('o'); add('t'); add(';');
-				break;
-			case '\n':
-				if (allowNewlines) {
-					add('<'); add('b'); add('r'); add('/'); add('>');
-				}
-				break;
-				
-			default:
-                if (chr < 0x20) {
-                    /* These are for the most part invalid */
-                    /* 
-					Actually, according to the XML spec, they are fine, but expat complains and pain often 
+		if (chr < 0x80) {
+			switch (xmlCharClass[chr]) {
+				case 0:
+					*(out++) = chr;
+					break;
+					
+				case 1:
+					switch (chr) {
+						case '<': memcpy(out, "&lt;", 4); out += 4; break;
+						case '>': memcpy(out, "&gt;", 4); out += 4; break;
+						case '&': memcpy(out, "&amp;", 5); out += 5; break;
+						case '\'': memcpy(out, "&apos;", 6); out += 6; break;
+						case '\"': memcpy(out, "&quot;", 6); out += 6; break;
+					}
+					break;
+					
+				case 2:
+					if (allowNewlines) {
+						memcpy(out, "<br/>", 5);
+						out += 5;
+					}
+					break;
+					
+				default:
+					/* 
+					 Control characters are fine according to the XML spec, but expat complains and pain often 
 					 results. This *will* prevent certain broken game files from indexing properly, and will
 					 generally result in duplicate entries in these cases.
 					 */
-				} else if (chr < 0x80) {
-					add(chr);
-				} else if (chr < 0x800) {
-					add(0xc0 | (chr>>6));
-					add(0x80 | (chr&0x3f));
-				} else if (chr < 0x10000) {
-					add(0xe0 | (chr>>12));
-					add(0x80 | ((chr>>6)&0x3f));
-					add(0x80 | (chr&0x3f));
-				} else if (chr < 0x200000) {
-					add(0xf0 | (chr>>18));
-					add(0x80 | ((chr>>12)&0x3f));
-					add(0x80 | ((chr>>6)&0x3f));
-					add(0x80 | (chr&0x3f));
-				} else {
-					/* These characters can't be represented by unicode anyway */
-				}
+					break;
+			}
+		} else if (chr < 0x800) {
+			*(out++) = 0xc0 | (chr>>6);
+			*(out++) = 0x80 | (chr&0x3f);
+		} else {
+			*(out++) = 0xe0 | (chr>>12);
+			*(out++) = 0x80 | ((chr>>6)&0x3f);
+			*(out++) = 0x80 | (chr&0x3f);
 		}
 	}
 	
-	add(0);
-	return res;
+	buf->length = out - buf->data;
 }
 
 /* Stack of iterators that are being processed */
@@ -870,157 +938,221 @@ typedef struct ValueStackItem {
 	struct ValueStackItem* previous;
 } ValueStackItem;
 
-void IF_WriteIfiction(IFMetabase meta, int(*writeFunction)(const char* bytes, int length, void* userData), void* userData) {
-#define w(s) { unsigned char* res = s; writeFunction(res, strlen(res), userData); }
-#define wu(s) { unsigned char* res; res = MakeUtf8Xml(s, 1); writeFunction(res, strlen(res), userData); free(res); }
-#define wun(s) { unsigned char* res; res = MakeUtf8Xml(s, 0); writeFunction(res, strlen(res), userData); free(res); }
+/* Returns non-zero if the iFiction for a story can be reused the next time it is written */
+static int CanCacheId(IFID ident) {
+	int x;
+	
+	switch (ident->type) {
+		case ID_MD5:
+			/* Looking up an MD5 ID with no system can fill the system in, changing how it's written */
+			return ident->data.md5.systemId != NULL;
+			
+		case ID_COMPOUND:
+			for (x=0; x<ident->data.compound.count; x++) {
+				if (!CanCacheId(ident->data.compound.ids[x])) return 0;
+			}
+			return 1;
+			
+		default:
+			return 1;
+	}
+}
+
+/* Writes out the iFiction for a single story */
+static void WriteStory(IFXmlBuffer* buf, IFStory story) {
+#define w(s) BufferString(buf, s)
+#define wu(s) BufferXml(buf, s, 1)
+#define wun(s) BufferXml(buf, s, 0)
 	
-	IFStoryIterator stories;
 	ValueStackItem* values;
 	
-	IFStory story;
 	int x;
+	int idCount;
+	IFID singleId[1];
+	IFID* storyIds;
 	
-	/* Write out the header */
-	w("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-	w("<ifindex version=\"1.0\" xmlns=\"http://babel.ifarchive.org/protocol/iFiction/\">\n");
+	w(" <story>\n");
 	
-	/* Iterate through the stories */
-	stories = IFMB_GetStoryIterator(meta);
+	/* Write out the IDs for the story */
+	/* TODO: <format>, <bafn>, etc */
 	
-	while (story = IFMB_NextStory(stories)) {
-		int idCount;
-		IFID singleId[1];
-		IFID* storyIds;
-		
-		w(" <story>\n");
+	/* Get the IDs that apply to this story */
+	storyIds = IFMB_SplitId(IFMB_IdForStory(story), &idCount);
+	if (storyIds == NULL) {
+		singleId[0] = IFMB_IdForStory(story);
+		storyIds = singleId;
+		idCount = 1;
+	}
+	
+	/* Write them out in identification sections */
+	for (x=0; x<idCount; x++) {
+		char* idString;
 		
-		/* Write out the IDs for the story */
-		/* TODO: <format>, <bafn>, etc */
+		idString = IFMB_IdToString(storyIds[x]);
 		
-		/* Get the IDs that apply to this story */
-		storyIds = IFMB_SplitId(IFMB_IdForStory(story), &idCount);
-		if (storyIds == NULL) {
-			singleId[0] = IFMB_IdForStory(story);
-			storyIds = singleId;
-			idCount = 1;
-		}
+		w("  <identification><ifid>");
+		w(idString);
+		w("</ifid></identification>\n");
 		
-		/* Write them out in identification sections */
-		for (x=0; x<idCount; x++) {
-			char* idString;
+		free(idString);
+	}
+	
+	/* Iterate through the values for this story */
+	values = malloc(sizeof(ValueStackItem));
+	
+	values->iterator = IFMB_GetValueIterator(story);
+	values->previous = NULL;
+	
+	while (values != NULL) {
+		if (IFMB_NextValue(values->iterator)) {
+			IFValueIterator subValues;
+			char* key;
+			IFChar* value;
 			
-			idString = IFMB_IdToString(storyIds[x]);
+			key = IFMB_SubkeyFromIterator(values->iterator);
+			value = IFMB_ValueFromIterator(values->iterator);
+			subValues = IFMB_ChildrenFromIterator(values->iterator);
 			
-			w("  <identification><ifid>");
-			w(idString);
-			w("</ifid></identification>\n");
+			/* Ignore attribute keys */
+			if (key[0] == '@') {
+				if (subValues != NULL) IFMB_FreeValueIterator(subValues);
+				continue;
+			}
 			
-			free(idString);
-		}
-		
-		/* Iterate through the values for this story */
-		values = malloc(sizeof(ValueStackItem));
-		
-		values->iterator = IFMB_GetValueIterator(story);
-		values->previous = NULL;
-		
-		while (values != NULL) {
-			if (IFMB_NextValue(values->iterator)) {
-				IFValueIterator subValues;
-				char* key;
-				IFChar* value;
-				
-				key = IFMB_SubkeyFromIterator(values->iterator);
-				value = IFMB_ValueFromIterator(values->iterator);
-				subValues = IFMB_ChildrenFromIterator(values->iterator);
-				
-				/* Ignore attribute keys */
-				if (key[0] == '@') {
-					if (subValues != NULL) IFMB_FreeValueIterator(subValues);
-					continue;
-				}
-				
-				/* Ignore empty keys */
-				if (value == NULL && subValues == NULL) continue;
+			/* Ignore empty keys */
+			if (value == NULL && subValues == NULL) continue;
+			
+			/* Open the tag for this value */
+			w("  <");
+			w(key);
+			
+			/* Write out any attributes that this tag might have */
+			while (subValues != NULL && IFMB_NextValue(subValues)) {
+				char* subKey;
 				
-				/* Open the tag for this value */
-				w("  <");
-				w(key);
+				subKey = IFMB_SubkeyFromIterator(subValues);
 				
-				/* Write out any attributes that this tag might have */
-				while (subValues != NULL && IFMB_NextValue(subValues)) {
-					char* subKey;
-					
-					subKey = IFMB_SubkeyFromIterator(subValues);
-
-					if (subKey[0] == '@') {
-						w(" ");
-						w(subKey+1);
-						w("=\"");
-						wun(IFMB_ValueFromIterator(subValues));
-						w("\"");
-					}
+				if (subKey[0] == '@') {
+					w(" ");
+					w(subKey+1);
+					w("=\"");
+					wun(IFMB_ValueFromIterator(subValues));
+					w("\"");
 				}
-				
-				if (subValues != NULL) IFMB_FreeValueIterator(subValues);
-				
-				/* End of the opening tag */
+			}
+			
+			if (subValues != NULL) IFMB_FreeValueIterator(subValues);
+			
+			/* End of the opening tag */
+			w(">\n");
+			
+			/* Write the value itself */
+			if (value != NULL) {
+				w("   ");
+				wu(IFMB_ValueFromIterator(values->iterator));
+				w("\n");
+			}
+			
+			/* Get an iterator for any values underneath this one */
+			subValues = IFMB_ChildrenFromIterator(values->iterator);
+			
+			if (subValues == NULL) {
+				/* No child values */
+				w("  </");
+				w(IFMB_SubkeyFromIterator(values->iterator));
 				w(">\n");
-				
-				/* Write the value itself */
-				if (value != NULL) {
-					w("   ");
-					wu(IFMB_ValueFromIterator(values->iterator));
-					w("\n");
-				}
-				
-				/* Get an iterator for any values underneath this one */
-				subValues = IFMB_ChildrenFromIterator(values->iterator);
-				
-				if (subValues == NULL) {
-					/* No child values */
-					w("  </");
-					w(IFMB_SubkeyFromIterator(values->iterator));
-					w(">\n");
-				} else {
-					/* Push this iterator onto the stack */
-					ValueStackItem* newValues;
-					
-					newValues = malloc(sizeof(ValueStackItem));
-					
-					newValues->iterator = subValues;
-					newValues->previous = values;
-					
-					values = newValues;
-				}
-				
 			} else {
+				/* Push this iterator onto the stack */
+				ValueStackItem* newValues;
 				
-				ValueStackItem* previousValues;
-				
-				/* Finished this iterator, move back to the last one */
-				previousValues = values->previous;
-				
-				IFMB_FreeValueIterator(values->iterator);
-				free(values);
+				newValues = malloc(sizeof(ValueStackItem));
 				
-				values = previousValues;
+				newValues->iterator = subValues;
+				newValues->previous = values;
 				
-				/* Close the tag that we were writing */
-				if (values != NULL) {
-					w("  </");
-					w(IFMB_SubkeyFromIterator(values->iterator));
-					w(">\n");
-				}
+				values = newValues;
+			}
+			
+		} else {
+			
+			ValueStackItem* previousValues;
+			
+			/* Finished this iterator, move back to the last one */
+			previousValues = values->previous;
+			
+			IFMB_FreeValueIterator(values->iterator);
+			free(values);
+			
+			values = previousValues;
+			
+			/* Close the tag that we were writing */
+			if (values != NULL) {
+				w("  </");
+				w(IFMB_SubkeyFromIterator(values->iterator));
+				w(">\n");
+			}
+		}
+	}
+	
+	w(" </story>\n");
+	
+#undef w
+#undef wu
+#undef wun
+}
+
+void IF_WriteIfiction(IFMetabase meta, int(*writeFunction)(const char* bytes, int length, void* userData), void* userData) {
+	IFXmlBuffer output;
+	IFXmlBuffer storyXml;
+	IFStoryIterator stories;
+	IFStory story;
+	
+	output.data = malloc(sizeof(unsigned char)*IFXmlChunkSize);
+	output.length = 0;
+	output.size = IFXmlChunkSize;
+	output.writeFunction = writeFunction;
+	output.userData = userData;
+	
+	storyXml.data = NULL;
+	storyXml.length = 0;
+	storyXml.size = 0;
+	storyXml.writeFunction = NULL;
+	storyXml.userData = NULL;
+	
+	/* Write out the header */
+	BufferString(&output, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	BufferString(&output, "<ifindex version=\"1.0\" xmlns=\"http://babel.ifarchive.org/protocol/iFiction/\">\n");
+	
+	/* Iterate through the stories */
+	stories = IFMB_GetStoryIterator(meta);
+	
+	while ((story = IFMB_NextStory(stories))) {
+		if (story->xml == NULL) {
+			/* This story has changed since it was last written (or has never been written) */
+			storyXml.length = 0;
+			WriteStory(&storyXml, story);
+			
+			if (CanCacheId(story->id)) {
+				story->xml = malloc(sizeof(char)*storyXml.length);
+				story->xmlLength = storyXml.length;
+				memcpy(story->xml, storyXml.data, storyXml.length);
+			} else {
+				BufferBytes(&output, storyXml.data, storyXml.length);
+				continue;
 			}
 		}
 		
-		w(" </story>\n");
+		/* Reuse what we wrote last time */
+		BufferBytes(&output, (const unsigned char*)story->xml, story->xmlLength);
 	}
 	
 	IFMB_FreeStoryIterator(stories);
 	
 	/* Write out the footer */
-	w("</ifindex>\n");
+	BufferString(&output, "</ifindex>\n");
+	
+	if (output.length > 0) writeFunction((const char*)output.data, output.length, userData);
+	
+	free(output.data);
+	if (storyXml.data) free(storyXml.data);
 }
@@ -35,6 +35,7 @@ typedef enum IFXmlError {
 extern void IF_ReadIfiction(IFMetabase meta, const unsigned char* xml, size_t size);
 
 /* Save the records contained in the specified metabase using the specified function */
+/* (Output arrives in large chunks. Each story's XML is kept, and reused on the next save if the story hasn't changed) */
 extern void IF_WriteIfiction(IFMetabase meta, int(*writeFunction)(const char* bytes, int length, void* userData), void* userData);
 
 /* Returns a default string for an error message */
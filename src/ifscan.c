@@ -0,0 +1,539 @@
+/*
+ *  A Z-Machine
+ *  Copyright (C) 2000 Andrew Hunter
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Finding and identifying story files
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "../config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+
+/* pthreads are always there on Mac OS X, which doesn't use config.h */
+#if defined(HAVE_THREADS) || defined(__APPLE__)
+# define SCAN_THREADS
+# include <pthread.h>
+#endif
+
+#include "ifscan.h"
+#include "ifmetabase.h"
+#include "md5.h"
+
+/* Story formats that we can identify */
+typedef enum IFScanFormat {
+	IFScanZcode,
+	IFScanGlulx,
+	IFScanBlorb,
+	IFScanOther
+} IFScanFormat;
+
+#define ZCODE IFScanZcodeFiles
+#define GLULX IFScanGlulxFiles
+#define OTHER IFScanOtherFiles
+
+static const struct {
+	const char* extension;
+	IFScanFormat format;
+	int kinds;											/* The kinds of story a file with this extension can hold */
+} storyExtensions[] = {
+	{ "z1", IFScanZcode, ZCODE }, { "z2", IFScanZcode, ZCODE }, { "z3", IFScanZcode, ZCODE },
+	{ "z4", IFScanZcode, ZCODE }, { "z5", IFScanZcode, ZCODE }, { "z6", IFScanZcode, ZCODE },
+	{ "z7", IFScanZcode, ZCODE }, { "z8", IFScanZcode, ZCODE }, { "dat", IFScanZcode, ZCODE },
+	{ "ulx", IFScanGlulx, GLULX },
+	{ "blb", IFScanBlorb, ZCODE|GLULX }, { "zlb", IFScanBlorb, ZCODE }, { "zblorb", IFScanBlorb, ZCODE },
+	{ "glb", IFScanBlorb, GLULX }, { "gblorb", IFScanBlorb, GLULX },
+	{ "gam", IFScanOther, OTHER }, { "t3", IFScanOther, OTHER }, { "hex", IFScanOther, OTHER },
+	{ "taf", IFScanOther, OTHER },
+	{ NULL, IFScanOther, 0 }
+};
+
+#undef ZCODE
+#undef GLULX
+#undef OTHER
+
+/*
+ * Works out the format of a file from its extension, and the kinds of story it could hold.
+ * Returns 0 if it's not a story file
+ */
+static int FormatForFile(const char* filename, IFScanFormat* format, int* kinds) {
+	const char* extension;
+	char lower[8];
+	int x;
+
+	extension = strrchr(filename, '.');
+	if (extension == NULL || strchr(extension, '/') != NULL) return 0;
+	extension++;
+
+	for (x=0; extension[x] != 0; x++) {
+		if (x >= 7) return 0;
+		lower[x] = tolower((unsigned char)extension[x]);
+	}
+	lower[x] = 0;
+
+	for (x=0; storyExtensions[x].extension != NULL; x++) {
+		if (strcmp(storyExtensions[x].extension, lower) == 0) {
+			*format = storyExtensions[x].format;
+			*kinds = storyExtensions[x].kinds;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Looks for a 'UUID://...//' string in some story data */
+static IFID ScanForUuid(const unsigned char* bytes, int length) {
+	int x, y;
+
+	for (x=0; x<length-48; x++) {
+		char uuidText[50];
+		int isUuid;
+		IFID uuidId;
+
+		if (bytes[x] != 'U' || memcmp(bytes + x, "UUID://", 7) != 0) continue;
+
+		/* Check to see if we've got a UUID */
+		isUuid = 1;
+
+		for (y=0; y<7; y++) uuidText[y] = bytes[x+y];
+		for (y=7; y<48; y++) {
+			uuidText[y] = bytes[x+y];
+
+			if (bytes[x+y-1] == '/' && bytes[x+y] == '/') break;
+			if (bytes[x+y] == '-' || bytes[x+y] == '/') continue;
+			if (isxdigit(bytes[x+y])) continue;
+
+			isUuid = 0;
+			break;
+		}
+		uuidText[y] = 0;
+
+		if (isUuid) {
+			uuidId = IFMB_IdFromString(uuidText);
+			if (uuidId != NULL) return uuidId;
+		}
+	}
+
+	return NULL;
+}
+
+/* Identifies some Z-Code story data */
+static IFID ZcodeId(const unsigned char* bytes, int length) {
+	IFID uuidId;
+
+	if (length < 64) return NULL;
+
+	/* A UUID is used for preference */
+	uuidId = ScanForUuid(bytes, length);
+	if (uuidId != NULL) return uuidId;
+
+	return IFMB_ZcodeId((bytes[0x2]<<8)|bytes[0x3], (const char*)bytes + 0x12, (bytes[0x1c]<<8)|bytes[0x1d]);
+}
+
+/*
+ * Reads length bytes from offset in a file into buffer. Returns 0 if they
+ * aren't all there. Story files can be damaged or truncated, so nothing here
+ * is allowed to fail any harder than that.
+ */
+static int ReadAt(FILE* file, long offset, unsigned char* buffer, long length) {
+	if (offset < 0 || length < 0) return 0;
+	if (fseek(file, offset, SEEK_SET) != 0) return 0;
+	return fread(buffer, 1, length, file) == (size_t)length;
+}
+
+/* As for ReadAt, but allocates the buffer. Returns NULL on failure */
+static unsigned char* ReadBlock(FILE* file, long offset, long length) {
+	unsigned char* data;
+
+	if (length < 0) return NULL;
+	data = malloc(length>0?length:1);
+	if (data == NULL) return NULL;
+
+	if (!ReadAt(file, offset, data, length)) {
+		free(data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/* Reads a big-endian 32-bit word */
+static unsigned int ReadWord(const unsigned char* bytes) {
+	return ((unsigned int)bytes[0]<<24) | (bytes[1]<<16) | (bytes[2]<<8) | bytes[3];
+}
+
+/* Identifies some Glulx story data (from the start of the story to the end of its memory) */
+static IFID GlulxId(const unsigned char* bytes, int length) {
+	IFID uuidId;
+	int memsize;
+	unsigned int checksum;
+
+	if (length < 64) return NULL;
+
+	memsize = ReadWord(bytes + 16);
+	if (memsize > length || memsize < 0) memsize = length;
+	checksum = ReadWord(bytes + 32);
+
+	uuidId = ScanForUuid(bytes, memsize);
+	if (uuidId != NULL) return uuidId;
+
+	/* Legacy mode: Inform stories have their release and serial number in the header */
+	if (memcmp(bytes + 36, "Info", 4) == 0) {
+		return IFMB_GlulxId((bytes[52]<<8) | bytes[53], (const char*)bytes + 54, checksum);
+	} else {
+		return IFMB_GlulxIdNotInform(memsize, checksum);
+	}
+}
+
+/* Size of the Glulx story that starts at offset in a file, up to the end of its memory */
+static long GlulxLength(FILE* file, long offset, long length) {
+	unsigned char header[20];
+	unsigned int memsize;
+
+	if (length < 64) return length;
+	if (!ReadAt(file, offset, header, 20)) return length;
+
+	memsize = ReadWord(header + 16);
+	if (memsize < 64 || memsize > (unsigned long)length) return length;
+	return memsize;
+}
+
+/*
+ * Identifies a blorb file from its executable chunk, if it's one of the kinds of story we're
+ * looking for. The chunk table is walked here rather than by iff.c, so that every chunk can be
+ * checked against the size of the form before anything is read from it.
+ */
+static IFID BlorbId(FILE* file, long fileSize, int kinds) {
+	unsigned char header[12];
+	unsigned long formEnd, pos;
+	IFID result;
+
+	if (!ReadAt(file, 0, header, 12)) return NULL;
+	if (memcmp(header, "FORM", 4) != 0 || memcmp(header + 8, "IFRS", 4) != 0) return NULL;
+
+	/* The form must lie within the file */
+	formEnd = ReadWord(header + 4);
+	if (formEnd < 4 || formEnd > (unsigned long)fileSize - 8) return NULL;
+	formEnd += 8;
+
+	result = NULL;
+	pos = 12;
+
+	while (pos + 8 <= formEnd) {
+		unsigned char chunk[8];
+		unsigned long length;
+		int isZcode, isGlulx;
+
+		if (!ReadAt(file, pos, chunk, 8)) break;
+		length = ReadWord(chunk + 4);
+
+		/* Each chunk must lie within the form, which also means the walk always moves forward */
+		if (length > formEnd - pos - 8) break;
+
+		isZcode = memcmp(chunk, "ZCOD", 4) == 0;
+		isGlulx = memcmp(chunk, "GLUL", 4) == 0;
+
+		if (isZcode || isGlulx) {
+			unsigned char* data;
+
+			if (isZcode && !(kinds&IFScanZcodeFiles)) break;
+			if (isGlulx && !(kinds&IFScanGlulxFiles)) break;
+
+			/* Read just this chunk */
+			if (length < 64) break;
+			if (isGlulx) length = GlulxLength(file, pos + 8, length);
+
+			data = ReadBlock(file, pos + 8, length);
+			if (data == NULL) break;
+
+			result = isZcode?ZcodeId(data, length):GlulxId(data, length);
+			free(data);
+			break;
+		}
+
+		/* Chunks are padded to an even length */
+		pos += 8 + length + (length&1);
+	}
+
+	return result;
+}
+
+/* Identifies a file by the MD5 of its contents */
+static IFID Md5Id(const char* filename) {
+	md5_byte_t digest[16];
+	char idString[40];
+	int x;
+
+	if (md5_file(filename, digest) != 0) return NULL;
+
+	/* Same form as the IDs ZoomStoryID generates for these files */
+	strcpy(idString, "MD5-");
+	for (x=0; x<16; x++) {
+		sprintf(idString + 4 + x*2, "%02x", digest[x]);
+	}
+
+	return IFMB_IdFromString(idString);
+}
+
+/* Identifies a file if it holds one of the kinds of story given */
+static IFID IdentifyFile(const char* filename, int kinds) {
+	IFScanFormat format;
+	int fileKinds;
+	struct stat info;
+	long fileSize;
+	FILE* file;
+	unsigned char header[64];
+	IFID result;
+
+	if (!FormatForFile(filename, &format, &fileKinds)) return NULL;
+	if ((kinds&fileKinds) == 0) return NULL;
+
+	if (stat(filename, &info) != 0) return NULL;
+	if (info.st_size < 64 || info.st_size > 0x7fffffff) return NULL;
+	fileSize = info.st_size;
+
+	/* Other formats are identified from the whole file */
+	if (format == IFScanOther) return Md5Id(filename);
+
+	file = fopen(filename, "rb");
+	if (file == NULL) return NULL;
+
+	result = NULL;
+
+	if (!ReadAt(file, 0, header, 64)) {
+		/* Shrunk since we looked at it */
+	} else if (memcmp(header, "FORM", 4) == 0) {
+		result = BlorbId(file, fileSize, kinds);
+	} else if (memcmp(header, "Glul", 4) == 0 && (kinds&IFScanGlulxFiles)) {
+		long length;
+		unsigned char* data;
+
+		length = GlulxLength(file, 0, fileSize);
+		data = ReadBlock(file, 0, length);
+		if (data != NULL) result = GlulxId(data, length);
+		free(data);
+	} else if (format == IFScanZcode && header[0] >= 1 && header[0] <= 8) {
+		unsigned char* data;
+
+		data = ReadBlock(file, 0, fileSize);
+		if (data != NULL) result = ZcodeId(data, fileSize);
+		free(data);
+	}
+
+	fclose(file);
+
+	return result;
+}
+
+IFID IF_IdentifyFile(const char* filename) {
+	return IdentifyFile(filename, IFScanAllFiles);
+}
+
+/* Finding the files in a directory tree */
+
+typedef struct IFScan {
+	IFScanFile* files;
+	int numFiles;
+	int filesSize;
+
+	int kinds;											/* The IFScan...Files we're looking for */
+	int nextFile;										/* Next file to be identified by a worker */
+#ifdef SCAN_THREADS
+	pthread_mutex_t lock;
+#endif
+} IFScan;
+
+static void FindFiles(IFScan* scan, const char* path) {
+	DIR* dir;
+	struct dirent* entry;
+
+	dir = opendir(path);
+	if (dir == NULL) return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		IFScanFormat format;
+		int kinds;
+		struct stat info;
+		char* filename;
+
+		if (entry->d_name[0] == '.') continue;
+
+		filename = malloc(strlen(path) + strlen(entry->d_name) + 2);
+		sprintf(filename, "%s/%s", path, entry->d_name);
+
+		/* Symbolic links to directories aren't followed, so the scan can't loop */
+		if (lstat(filename, &info) != 0) {
+			free(filename);
+			continue;
+		}
+
+		if (S_ISDIR(info.st_mode)) {
+			FindFiles(scan, filename);
+			free(filename);
+			continue;
+		}
+
+		/* Files that can't hold any of the stories we want aren't even opened */
+		if (!FormatForFile(filename, &format, &kinds) || (kinds&scan->kinds) == 0) {
+			free(filename);
+			continue;
+		}
+
+		if (scan->numFiles >= scan->filesSize) {
+			scan->filesSize = scan->filesSize*2 + 64;
+			scan->files = realloc(scan->files, sizeof(IFScanFile)*scan->filesSize);
+		}
+
+		scan->files[scan->numFiles].filename = filename;
+		scan->files[scan->numFiles].ident = NULL;
+		scan->numFiles++;
+	}
+
+	closedir(dir);
+}
+
+/* Takes files off the list and identifies them until there are none left */
+static void* ScanWorker(void* data) {
+	IFScan* scan = data;
+
+	for (;;) {
+		IFScanFile* file;
+
+#ifdef SCAN_THREADS
+		pthread_mutex_lock(&scan->lock);
+#endif
+		file = NULL;
+		if (scan->nextFile < scan->numFiles) file = scan->files + (scan->nextFile++);
+#ifdef SCAN_THREADS
+		pthread_mutex_unlock(&scan->lock);
+#endif
+
+		if (file == NULL) break;
+		file->ident = IdentifyFile(file->filename, scan->kinds);
+	}
+
+	return NULL;
+}
+
+/* Adds the stories that were found to a metabase */
+static void MergeStories(IFMetabase meta, IFScan* scan) {
+	IFMetabase found;
+	IFStoryIterator iter;
+	IFStory story;
+	int x;
+
+	/*
+	 * The new stories are collected first (which also merges files that share an ID), so the
+	 * metabase's index stays sorted while we're checking it, and is sorted once at the end
+	 */
+	found = IFMB_Create();
+	for (x=0; x<scan->numFiles; x++) {
+		if (!IFMB_ContainsStoryWithId(meta, scan->files[x].ident)) {
+			IFMB_GetStoryWithId(found, scan->files[x].ident);
+		}
+	}
+
+	IFMB_BeginBulkLoad(meta);
+
+	iter = IFMB_GetStoryIterator(found);
+	while ((story = IFMB_NextStory(iter)) != NULL) {
+		IFMB_CopyStory(meta, story, NULL);
+	}
+	IFMB_FreeStoryIterator(iter);
+
+	IFMB_EndBulkLoad(meta);
+
+	IFMB_Free(found);
+}
+
+IFScanFile* IF_ScanDirectory(IFMetabase meta, const char* path, int kinds, int nthreads, int* count) {
+	IFScan scan;
+	int numIdentified;
+	int x;
+
+	scan.kinds = kinds;
+	scan.files = NULL;
+	scan.numFiles = 0;
+	scan.filesSize = 0;
+	scan.nextFile = 0;
+
+	FindFiles(&scan, path);
+
+#ifdef SCAN_THREADS
+	if (nthreads <= 0) nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > scan.numFiles) nthreads = scan.numFiles;
+
+	{
+		pthread_t* threads;
+		int started;
+
+		pthread_mutex_init(&scan.lock, NULL);
+		threads = malloc(sizeof(pthread_t)*(nthreads+1));
+
+		/* This thread is one of the workers, and picks up anything the others can't */
+		for (started=0; started<nthreads-1; started++) {
+			if (pthread_create(threads + started, NULL, ScanWorker, &scan) != 0) break;
+		}
+		ScanWorker(&scan);
+		for (x=0; x<started; x++) {
+			pthread_join(threads[x], NULL);
+		}
+
+		free(threads);
+		pthread_mutex_destroy(&scan.lock);
+	}
+#else
+	ScanWorker(&scan);
+#endif
+
+	/* Only the files that turned out to be stories are returned */
+	numIdentified = 0;
+	for (x=0; x<scan.numFiles; x++) {
+		if (scan.files[x].ident != NULL) {
+			scan.files[numIdentified++] = scan.files[x];
+		} else {
+			free(scan.files[x].filename);
+		}
+	}
+	scan.numFiles = numIdentified;
+
+	if (meta != NULL) MergeStories(meta, &scan);
+
+	*count = scan.numFiles;
+	return scan.files;
+}
+
+void IF_FreeScan(IFScanFile* files, int count) {
+	int x;
+
+	for (x=0; x<count; x++) {
+		free(files[x].filename);
+		IFMB_FreeId(files[x].ident);
+	}
+	free(files);
+}
@@ -0,0 +1,66 @@
+/*
+ *  A Z-Machine
+ *  Copyright (C) 2000 Andrew Hunter
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __IFSCAN_H
+#define __IFSCAN_H
+
+/*
+ * Library scanner: finds and identifies the story files in a directory tree.
+ *
+ * Files are identified the same way as ZoomStoryID: Z-Code and Glulx stories (bare or in a blorb)
+ * by their headers and any UUID they contain, and other story formats by the MD5 of their contents.
+ * Only the part of a file that's needed is read: for a blorb, that's its chunk table and the
+ * executable chunk, and for a Glulx story the memory described by its header.
+ *
+ * Where pthreads are available (HAVE_THREADS, or on Mac OS X), the files are identified on a pool
+ * of worker threads. Damaged files are never fatal: they just aren't identified.
+ */
+
+#include "ifmetabase.h"
+
+/* Kinds of story for a scan to look for */
+enum {
+	IFScanZcodeFiles = 1,		/* Z-Code stories, bare or in a blorb */
+	IFScanGlulxFiles = 2,		/* Glulx stories, bare or in a blorb */
+	IFScanOtherFiles = 4,		/* Other formats (.gam, .t3, .hex, .taf), identified by the MD5 of the whole file */
+	IFScanAllFiles   = 7
+};
+
+/* A file found by a scan */
+typedef struct IFScanFile {
+	char* filename;
+	IFID ident;
+} IFScanFile;
+
+/* Identifies a single file. Returns NULL if it isn't a story file */
+extern IFID IF_IdentifyFile(const char* filename);
+
+/*
+ * Scans the directory tree at path for the kinds of story given (some IFScan...Files), using up to
+ * nthreads threads (0 to use one per processor). Files whose extension rules out all of those kinds
+ * are never opened, and a blorb holding a different kind of story is left once its executable chunk
+ * has been found. Any stories that meta doesn't already contain are added to it as a single bulk
+ * load (meta can be NULL). Returns the story files found, and sets count to the number of them.
+ */
+extern IFScanFile* IF_ScanDirectory(IFMetabase meta, const char* path, int kinds, int nthreads, int* count);
+
+/* Frees the results of a scan */
+extern void IF_FreeScan(IFScanFile* files, int count);
+
+#endif
@@ -53,7 +53,15 @@ int            image_width      (image_data*);
 int            image_height     (image_data*);
 unsigned char* image_rgb        (image_data*);
 
-void           image_resample   (image_data*, int n, int d);
+/* Filters image_resample can use (the 'resample' option in .zoomrc) */
+enum
+  {
+    IMAGE_FILTER_BOX,      /* Fastest, blocky when enlarging */
+    IMAGE_FILTER_BILINEAR,
+    IMAGE_FILTER_LANCZOS   /* Sharpest (the default) */
+  };
+
+void           image_resample   (image_data*, int n, int d, int filter);
 
 void           image_set_data   (image_data*, void*,
 				 void (*destruct)(image_data*, void*));
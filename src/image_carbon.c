@@ -126,7 +126,8 @@ int image_width(image_data* img)
 void image_draw_carbon(image_data* img, 
 		       CGrafPtr port, 
 		       int x, int y,
-		       int n, int d)
+		       int n, int d,
+		       int filter)
 {
   Rect rct;
 
@@ -150,7 +151,15 @@ void image_draw_carbon(image_data* img,
    */
 
   GraphicsImportSetGWorld(img->gi, port, nil);
-  GraphicsImportSetQuality(img->gi, codecMaxQuality);
+  switch (filter)
+    {
+    case IMAGE_FILTER_BOX:
+      GraphicsImportSetQuality(img->gi, codecLowQuality); break;
+    case IMAGE_FILTER_BILINEAR:
+      GraphicsImportSetQuality(img->gi, codecNormalQuality); break;
+    default:
+      GraphicsImportSetQuality(img->gi, codecMaxQuality); break;
+    }
   GraphicsImportSetGraphicsMode(img->gi, graphicsModeComposition, NULL);
   GraphicsImportSetBoundsRect(img->gi, &rct);
   GraphicsImportDraw(img->gi);
@@ -271,7 +280,8 @@ void image_quartz_prepare(image_data* img)
 void image_draw_carbon(image_data* img, 
 		       CGrafPtr port, 
 		       int x, int y,
-		       int n, int d)
+		       int n, int d,
+		       int filter)
 {
   quartz_data* data;
   CGRect rect;
@@ -297,6 +307,23 @@ void image_draw_carbon(image_data* img,
   rect.size.height = (image_height(img)*n)/d;
   rect.origin.y   -= rect.size.height;
 
+  /* Quartz does the scaling, so the filter picks its interpolation */
+  switch (filter)
+    {
+    case IMAGE_FILTER_BOX:
+      CGContextSetInterpolationQuality(carbon_quartz_context,
+				       kCGInterpolationNone);
+      break;
+    case IMAGE_FILTER_BILINEAR:
+      CGContextSetInterpolationQuality(carbon_quartz_context,
+				       kCGInterpolationLow);
+      break;
+    default:
+      CGContextSetInterpolationQuality(carbon_quartz_context,
+				       kCGInterpolationHigh);
+      break;
+    }
+
   CGContextDrawImage(carbon_quartz_context, rect, data->image);
 }
 
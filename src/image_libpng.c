@@ -25,24 +25,10 @@
 
 #ifdef HAVE_LIBPNG
 
-#define QUALITY_HIGH           /* Undefine to use a 3x3 filter */
-#undef  QUALITY_REALLYLOW      /* Define (and undefine the above) to use no filter at all */
-
-#if defined(QUALITY_HIGH) && defined(QUALITY_REALLYLOW)
-# error You cannot define both QUALITY_HIGH and QUALITY_REALLYLOW
-#endif
-
-#ifdef QUALITY_HIGH
-# define MATRIX_SIZE 5
-#elif defined(QUALITY_REALLYLOW)
-# define MATRIX_SIZE 1
-#else
-# define MATRIX_SIZE 3
-#endif
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include <png.h>
 
@@ -387,344 +373,282 @@ unsigned char* image_rgb(image_data* data)
   return data->image;
 }
 
-void image_resample(image_data* data, int n, int d)
+/*
+ * Resampling.
+ *
+ * The filter is separable, so we scale the rows first and then the
+ * columns. For each axis we first work out which source pixels
+ * contribute to each destination pixel, and how much (as fixed-point
+ * weights that sum to 1<<WEIGHT_BITS). The inner loops are then just
+ * multiply-and-adds along a row of RGBA bytes, which the compiler can
+ * vectorise.
+ */
+
+#define WEIGHT_BITS 14
+
+struct contrib
 {
-  unsigned char* newimage, *ip;
-  int ny;
+  int start; /* First source pixel */
+  int count; /* Number of source pixels */
+  int first; /* Index of the first weight in the weight table */
+};
 
-  int newwidth, newheight;
+static double filter_box(double x)
+{
+  if (x >= -0.5 && x < 0.5)
+    return 1.0;
+  return 0.0;
+}
 
-#ifdef QUALITY_HIGH
-  int filter[5][5] = 
-    { {  1,  2,  3,  2,  1 },
-      {  2,  3,  4,  3,  2 },
-      {  3,  4,  5,  4,  3 },
-      {  2,  3,  4,  3,  2 },
-      {  1,  2,  3,  2,  1 } };
-#else  
-  int filter[3][3] =
-    { { 1, 2, 1 },
-      { 2, 4, 2 },
-      { 1, 2, 1 } };
-#endif
-  
-  if (data->image == NULL)
+static double filter_triangle(double x)
+{
+  if (x < 0) x = -x;
+  if (x < 1.0)
+    return 1.0 - x;
+  return 0.0;
+}
+
+static double sinc(double x)
+{
+  if (x == 0.0)
+    return 1.0;
+  x *= M_PI;
+  return sin(x)/x;
+}
+
+static double filter_lanczos(double x)
+{
+  if (x > -3.0 && x < 3.0)
+    return sinc(x)*sinc(x/3.0);
+  return 0.0;
+}
+
+/*
+ * Works out the contributions for scaling srclen pixels to dstlen with
+ * one of the IMAGE_FILTER_ filters. Returns the weight table; the
+ * contributions go in contrib.
+ */
+static int* make_contrib(int srclen, int dstlen, int filter_type,
+			 struct contrib* contrib)
+{
+  double (*filter)(double);
+  double support, scale, fscale;
+  int* weight;
+  double* w;
+  int maxtaps;
+  int x;
+
+  switch (filter_type)
     {
-      if (iload(data, data->pal_image, data->file, data->offset, 1) == NULL)
-	{
-	  return;
-	}
+    case IMAGE_FILTER_BOX:
+      filter = filter_box;      support = 0.5; break;
+    case IMAGE_FILTER_BILINEAR:
+      filter = filter_triangle; support = 1.0; break;
+    default:
+      filter = filter_lanczos;  support = 3.0; break;
     }
 
-  /*
-   * Not a very complicated resampling w/filter routine. We use bresenham
-   * to generate pixels and a 3x3 filter. The results are usually OK.
-   *
-   * The filtering could *definately* be better, and the resampling
-   * sometimes produces the odd pixel error. Ho-hum. The aliasing
-   * is usually unnoticable - dithering is the place where you'll
-   * see it the most, and it's damn hard to resample dithered areas
-   * properly anyway. At least, it is in reasonable time.
-   */
-   
-  newwidth  = (data->width*n)/d;
-  newheight = (data->height*n)/d;
-
-  ip = newimage = malloc(newwidth*newheight*4);
+  /* When shrinking, the filter is stretched to cover the source pixels */
+  scale  = (double)dstlen/(double)srclen;
+  fscale = 1.0;
+  if (scale < 1.0)
+    {
+      fscale   = scale;
+      support /= scale;
+    }
 
-  n *= MATRIX_SIZE; /* 3x3 filter, y'see */
+  maxtaps = (int)ceil(support)*2 + 1;
+  weight  = malloc(sizeof(int)*maxtaps*dstlen);
+  w       = malloc(sizeof(double)*maxtaps);
 
-  if (n >= d) /* Far more likely to happen... */
+  for (x=0; x<dstlen; x++)
     {
-      int dfx, dfy, Ex, NEx, Ey, NEy;
-      unsigned char* xp[MATRIX_SIZE];
-      int yp, dstx, dsty;
-
-      int i;
-
-      if (newwidth < newheight)
-	{ n = newwidth*MATRIX_SIZE; d = data->width-1; }
-      else
-	{ n = newheight*MATRIX_SIZE; d = data->height-1; }
-
-      /* Set up for bresenham */
-      dfx = 2*(data->width-1)-newwidth*MATRIX_SIZE;
-      dfy = 2*(data->height-1)-newheight*MATRIX_SIZE;
-      Ex = 2*(data->width-1);
-      Ey = 2*(data->height-1);
-      NEx = 2*((data->width-1)-newwidth*MATRIX_SIZE);
-      NEy = 2*((data->height-1)-newheight*MATRIX_SIZE);
-
-      /* Calculate our 3 initial y positions */
-      yp = 0;
-      for (i=0; i<MATRIX_SIZE; i++)
+      double centre, total;
+      int start, end;
+      int y, sum, biggest;
+      int* wp;
+
+      centre = (x+0.5)/scale;
+      start  = (int)floor(centre - support + 0.5);
+      end    = (int)floor(centre + support + 0.5);
+      if (start < 0)       start = 0;
+      if (end > srclen)    end   = srclen;
+      if (end - start > maxtaps) end = start + maxtaps;
+      if (end <= start)
 	{
-	  xp[i] = data->row[yp];
+	  /* Can happen with the box filter: use the nearest pixel */
+	  start = (int)centre;
+	  if (start >= srclen) start = srclen-1;
+	  end = start+1;
+	}
 
-	  /* Next position */
-	  if (dfy <= 0)
-	    {
-	      dfy += Ey;
-	    }
-	  else
-	    {
-	      dfy += NEy;
-	      yp++;
-	    }
+      total = 0;
+      for (y=start; y<end; y++)
+	{
+	  w[y-start] = filter((y+0.5-centre)*fscale);
+	  total += w[y-start];
 	}
 
-      ip = newimage; /* Current position */
+      contrib[x].start = start;
+      contrib[x].count = end-start;
+      contrib[x].first = x*maxtaps;
+      wp = weight + contrib[x].first;
 
-      for (dsty = 0; dsty<newheight; dsty++)
+      if (total == 0.0)
 	{
-	  for (dstx = 0; dstx<newwidth; dstx++)
-	    {
-	      int rs, gs, bs, as;
+	  /* Nothing contributed: fall back to the nearest pixel */
+	  for (y=start; y<end; y++)
+	    w[y-start] = 0;
+	  w[(end-start)/2] = total = 1.0;
+	}
 
-#ifndef QUALITY_REALLYLOW
-	      /* Do the sampling */
-	      rs = gs = bs = as = 0;
+      /* Convert to fixed point, making sure the weights sum to 1 */
+      sum = 0; biggest = 0;
+      for (y=0; y<end-start; y++)
+	{
+	  wp[y] = (int)floor(w[y]/total*(1<<WEIGHT_BITS) + 0.5);
+	  sum += wp[y];
+	  if (wp[y] > wp[biggest])
+	    biggest = y;
+	}
+      wp[biggest] += (1<<WEIGHT_BITS) - sum;
+    }
 
-	      for (i=0; i<MATRIX_SIZE; i++)
-		{
-		  int j;
+  free(w);
 
-		  for (j=0; j<MATRIX_SIZE; j++)
-		    {
-		      rs += xp[j][0]*filter[i][j];
-		      gs += xp[j][1]*filter[i][j];
-		      bs += xp[j][2]*filter[i][j];
-		      as += xp[j][3]*filter[i][j];
-		    }
+  return weight;
+}
 
-		  /* Next X */
-		  if (dfx <= 0)
-		    {
-		      dfx += Ex;
-		    }
-		  else
-		    {
-		      for (j=0; j<MATRIX_SIZE; j++)
-			xp[j] += 4;
-		      dfx += NEx;
-		    }
-		}
+static inline unsigned char clamp_sample(int v)
+{
+  v = (v + (1<<(WEIGHT_BITS-1)))>>WEIGHT_BITS;
+  if (v < 0)   return 0;
+  if (v > 255) return 255;
+  return v;
+}
 
-	      /* Scale the sample */
-# ifdef QUALITY_HIGH
-	      rs /= 65; gs /= 65; bs /= 65; as /= 65;
-# else
-	      rs >>= 4; gs >>= 4; bs >>= 4; as >>= 4;
-# endif
-#else
-	      rs = xp[0][0];
-	      gs = xp[0][1];
-	      bs = xp[0][2];
-	      as = xp[0][3];
-
-	      if (dfx <= 0)
-		dfx += Ex;
-	      else
-		{
-		  xp[0] += 4;
-		  dfx += NEx;
-		}
-#endif
+/* Scales a row of RGBA pixels horizontally */
+static void resample_row(const unsigned char* src,
+			 unsigned char*       dst,
+			 int                  dstlen,
+			 const struct contrib* contrib,
+			 const int*            weight)
+{
+  int x;
 
-	      /* store the sample */
-	      (*ip++) = rs;
-	      (*ip++) = gs;
-	      (*ip++) = bs;
-	      (*ip++) = as;
-	    }
+  for (x=0; x<dstlen; x++)
+    {
+      const unsigned char* sp;
+      const int* wp;
+      int r, g, b, a;
+      int y;
 
-	  /* Next 3 y positions */
-	  for (i=0; i<MATRIX_SIZE; i++)
-	    {
-	      xp[i] = data->row[yp];
+      sp = src + 4*contrib[x].start;
+      wp = weight + contrib[x].first;
+      r = g = b = a = 0;
 
-	      /* Next position */
-	      if (dfy <= 0)
-		{
-		  dfy += Ey;
-		}
-	      else
-		{
-		  dfy += NEy;
-		  yp++;
-		}
-	    }
+      for (y=0; y<contrib[x].count; y++)
+	{
+	  r += sp[0]*wp[y];
+	  g += sp[1]*wp[y];
+	  b += sp[2]*wp[y];
+	  a += sp[3]*wp[y];
 
-	  dfx = 2*(data->width)-newwidth*MATRIX_SIZE;
+	  sp += 4;
 	}
-    }
-  else
-    {
-      /* 
-       * Less likely: the new image is less than 1/3 of the size of
-       * the original.
-       */
-      int dfx, dfy, E, NE;
-      unsigned char* xp[MATRIX_SIZE];
-      int yp, dstx, dsty;
-      int subyp;
-
-      int i;
-
-      /*
-       * What's going on here?
-       *
-       * In a word - downscaling. This code won't be executed much...
-       *
-       * Well, bresenham's algorithm only works for slopes <= 1. So, we
-       * consider the mapping this way: Bresenham tells us when we should
-       * move on a pixel in the *smaller* of the two images. Now, matters
-       * are complicated somewhat here, because the 'larger' image we're
-       * considering is in fact 3 times larger than the 'smaller' one
-       * (for the filter).
-       *
-       * So, to find X, the number of pixels to move in the larger image
-       * for one in the smaller, we run bresenham's algorithm until it
-       * moves up a pixel - each iteration indicates to move on a pixel
-       * in the larger image (as above). This event indicates we should
-       * move on a pixel in the smaller image (note: as well as the
-       * larger). A spot of extra code to deal with the whole *3 problem,
-       * and bob's yer uncle.
-       *
-       * Note that, as we aren't considering every pixel in the source image
-       * anymore, we could introduce aliasing. But, the filtering is far
-       * from perfect, so you get some aliasing anyway.
-       */
-
-      /* Minor adjustment (ensures we don't overrun) */
-      if (newwidth < newheight)
-	{ n = newwidth*MATRIX_SIZE; d = data->width+1; }
-      else
-	{ n = newheight*MATRIX_SIZE; d = data->height+1; }
-
-      /* Set up for bresenham */
-      dfx = dfy = 2*n-d;
-      E = 2*n;
-      NE = 2*(n-d);
-
-      /* Set up initial 3 y positions*/
-      yp = 0;
-      subyp = 0;
-      for (i=0; i<MATRIX_SIZE; i++)
-	{
-	  xp[i] = data->row[yp];
 
-	  /* Next position */
-	  while (dfy > 0)
-	    {
-	      dfy += NE;
-	      subyp++;
-	      if (subyp >= MATRIX_SIZE)
-		{ subyp = 0; yp++; }
-	    }
-	  subyp++; if (subyp >= MATRIX_SIZE)  { subyp = 0; yp++; }
+      dst[0] = clamp_sample(r);
+      dst[1] = clamp_sample(g);
+      dst[2] = clamp_sample(b);
+      dst[3] = clamp_sample(a);
+      dst += 4;
+    }
+}
 
-	  dfy += E;
-	}
+/*
+ * Makes a row of len bytes from a weighted sum of the rows contrib
+ * refers to (ie, scales vertically). acc is scratch space for len ints.
+ */
+static void resample_column(unsigned char**       rows,
+			    unsigned char*        dst,
+			    int                   len,
+			    const struct contrib* contrib,
+			    const int*            weight,
+			    int*                  acc)
+{
+  int x, y;
 
-      ip = newimage; /* Current position */
+  for (x=0; x<len; x++)
+    acc[x] = 0;
 
-      for (dsty = 0; dsty<newheight; dsty++)
-	{
-	  int subx;
+  for (y=0; y<contrib->count; y++)
+    {
+      const unsigned char* sp = rows[contrib->start + y];
+      int w = weight[contrib->first + y];
 
-	  subx = 0;
+      for (x=0; x<len; x++)
+	acc[x] += sp[x]*w;
+    }
 
-	  for (dstx = 0; dstx<newwidth; dstx++)
-	    {
-	      int rs, gs, bs, as;
+  for (x=0; x<len; x++)
+    dst[x] = clamp_sample(acc[x]);
+}
 
-#ifndef QUALITY_REALLYLOW
-	      /* Do the sampling */
-	      rs = gs = bs = as = 0;
+void image_resample(image_data* data, int n, int d, int filter)
+{
+  unsigned char* newimage, *tmp;
+  unsigned char** trow;
+  struct contrib* xcontrib, *ycontrib;
+  int* xweight, *yweight;
+  int* acc;
+  int y;
 
-	      for (i=0; i<MATRIX_SIZE; i++)
-		{
-		  int j,k;
+  int newwidth, newheight;
 
-		  for (j=0; j<MATRIX_SIZE; j++)
-		    {
-		      rs += xp[j][0]*filter[i][j];
-		      gs += xp[j][1]*filter[i][j];
-		      bs += xp[j][2]*filter[i][j];
-		      as += xp[j][3]*filter[i][j];
-		    }
+  if (data->image == NULL)
+    {
+      if (iload(data, data->pal_image, data->file, data->offset, 1) == NULL)
+	{
+	  return;
+	}
+    }
 
-		  /* Next X */
-		  j = 0;
-		  while (dfx > 0)
-		    {
-		      dfx += NE;
-		      subx++;
-		      if (subx >= MATRIX_SIZE) { subx = 0; j+=4; }
-		    }
-		  subx++;
-		  if (subx >= MATRIX_SIZE) { subx = 0; j+=4; }
+  newwidth  = (data->width*n)/d;
+  newheight = (data->height*n)/d;
 
-		  for (k=0; k<MATRIX_SIZE; k++)
-		    xp[k] += j;
-		  dfx += E;
-		}
+  if (newwidth < 1)  newwidth  = 1;
+  if (newheight < 1) newheight = 1;
 
-	      /* Scale the sample */
-# ifdef QUALITY_HIGH
-	      rs /= 65; gs /= 65; bs /= 65; as /= 65;
-# else
-	      rs >>= 4; gs >>= 4; bs >>= 4; as >>= 4;
-# endif
-#else
-	      rs = xp[0][0];
-	      gs = xp[0][1];
-	      bs = xp[0][2];
-	      as = xp[0][3];	      
-
-	      i = 0;
-	      while (dfx > 0)
-		{
-		  dfx += NE;
-		  subx++;
-		  if (subx >= MATRIX_SIZE) { subx = 0; i+=4; }
-		}
-	      subx++;
-	      if (subx >= MATRIX_SIZE) { subx = 0; i+=4; }
-	      
-	      xp[0] += i;
-#endif
+  if (newwidth == data->width && newheight == data->height)
+    return;
 
-	      /* store the sample */
-	      (*ip++) = rs;
-	      (*ip++) = gs;
-	      (*ip++) = bs;
-	      (*ip++) = as;
-	    }
+  xcontrib = malloc(sizeof(struct contrib)*newwidth);
+  ycontrib = malloc(sizeof(struct contrib)*newheight);
+  xweight  = make_contrib(data->width, newwidth, filter, xcontrib);
+  yweight  = make_contrib(data->height, newheight, filter, ycontrib);
 
-	  /* Next 3 y positions */
-	  for (i=0; i<MATRIX_SIZE; i++)
-	    {
-	      xp[i] = data->row[yp];
-	      
-	      /* Next position */
-	      while (dfy > 0)
-		{
-		  dfy += NE;
-		  subyp++;
-		  if (subyp >= MATRIX_SIZE)
-		    { subyp = 0; yp++; }
-		}
-	      subyp++; if (subyp >= MATRIX_SIZE) { subyp=0; yp++; }
-	      
-	      dfy += E;
-	    }
+  /* Rows first... */
+  tmp  = malloc(newwidth*data->height*4);
+  trow = malloc(sizeof(unsigned char*)*data->height);
+  for (y=0; y<data->height; y++)
+    {
+      trow[y] = tmp + 4*y*newwidth;
+      resample_row(data->row[y], trow[y], newwidth, xcontrib, xweight);
+    }
 
-	  dfx = 2*n-d;
-	}
+  /* ...then columns */
+  newimage = malloc(newwidth*newheight*4);
+  acc      = malloc(sizeof(int)*newwidth*4);
+  for (y=0; y<newheight; y++)
+    {
+      resample_column(trow, newimage + 4*y*newwidth, newwidth*4,
+		      ycontrib + y, yweight, acc);
     }
 
+  free(tmp); free(trow); free(acc);
+  free(xcontrib); free(ycontrib);
+  free(xweight);  free(yweight);
+
   /* Reset the data structures */
   free(data->image);
 
@@ -734,9 +658,9 @@ void image_resample(image_data* data, int n, int d)
 
   data->row = realloc(data->row, sizeof(png_bytep)*newheight);
 
-  for (ny=0; ny<newheight; ny++)
+  for (y=0; y<newheight; y++)
     {
-      data->row[ny] = newimage + 4*ny*newwidth;
+      data->row[y] = newimage + 4*y*newwidth;
     }
 }
 
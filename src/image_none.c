@@ -45,7 +45,7 @@ int image_height(image_data* data) { return 10; }
 
 unsigned char* image_rgb(image_data* data) { return NULL; }
 
-void image_resample(image_data* data, int n, int d) { }
+void image_resample(image_data* data, int n, int d, int filter) { }
 
 void image_set_data(image_data* img, void* data, 
 		    void (*destruct)(image_data*, void*)) { }
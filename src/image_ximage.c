@@ -55,23 +55,6 @@
 # include <X11/extensions/Xrender.h>
 #endif
 
-struct x_data 
-{
-  Display* display;
-
-  XImage* image;
-  XImage* mask;
-
-#ifdef HAVE_XRENDER
-  XImage* render;
-
-  /*
-  Pixmap  pmap;
-  Picture piccy;
-  */
-#endif
-};
-
 /*
  * 16 or 32-bit truecolour images.
  */
@@ -506,85 +489,71 @@ XImage* image_to_mask_truecolour(XImage*     orig,
   return xim;
 }
 
-static void x_destruct(image_data* img, void* data)
+/* Bytes used by an XImage's pixels */
+static long ximage_size(XImage* xim)
 {
-  struct x_data* d;
-
-  d = data;
-
-  if (d->image != NULL)
-    {
-      free(d->image->data);
-      d->image->data = NULL;
-      XDestroyImage(d->image);
-    }
-  if (d->mask != NULL)
-    {
-      free(d->mask->data);
-      d->mask->data = NULL;
-      XDestroyImage(d->mask);
-    }
-#ifdef HAVE_XRENDER
-  if (d->render != NULL)
-    {
-      free(d->render->data);
-      d->render->data = NULL;
-      XDestroyImage(d->render);
-    }
-#endif
-
-  free(d);
+  if (xim == NULL)
+    return 0;
+  return (long)xim->bytes_per_line*xim->height;
 }
 
-void image_plot_X(image_data* img,
-		  Display*  display,
-		  Drawable  draw,
-		  GC        gc,
-		  int x, int y,
-		  int n, int d)
+static void free_ximage(XImage* xim)
 {
-  struct x_data* data;
+  if (xim == NULL)
+    return;
 
-  data = image_get_data(img);
+  free(xim->data);
+  xim->data = NULL;
+  XDestroyImage(xim);
+}
 
-  if (data == NULL)
-    {
-      data = malloc(sizeof(struct x_data));
-      data->image = NULL;
-      data->mask  = NULL;
-      data->display = display;
+void image_render_free(void* data)
+{
+  x_render* render = data;
 
-#ifdef HAVE_XRENDER
-      data->render = NULL;
-#endif
+  free_ximage(render->image);
+  free_ximage(render->mask);
+  free(render);
+}
 
-      image_set_data(img, data, x_destruct);
-    }
+x_render* image_render_X(image_data* img,
+			 Display*    display,
+			 int n, int d,
+			 int filter)
+{
+  x_render* render;
 
-  if (data->image == NULL)
-    {
-      image_unload_rgb(img);
-      if (n != d)
-	image_resample(img, n, d);
+  image_unload_rgb(img);
+  if (n != d)
+    image_resample(img, n, d, filter);
+
+  render = malloc(sizeof(x_render));
+  render->image = image_to_ximage_truecolour(img,
+					     display,
+					     DefaultVisual(display, DefaultScreen(display)));
+  render->mask  = image_to_mask_truecolour(render->image,
+					   img, display,
+					   DefaultVisual(display, DefaultScreen(display)));
+  render->size  = sizeof(x_render) +
+    ximage_size(render->image) + ximage_size(render->mask);
 
-      data->image = image_to_ximage_truecolour(img,
-					       display,
-					       DefaultVisual(display, DefaultScreen(display)));
-    }
-  if (data->mask == NULL)
-    {
-      data->mask = image_to_mask_truecolour(data->image,
-					    img, display,
-					    DefaultVisual(display, DefaultScreen(display)));
-    }
   image_unload_rgb(img);
 
+  return render;
+}
+
+void image_plot_X(x_render* render,
+		  Display*  display,
+		  Drawable  draw,
+		  GC        gc,
+		  int x, int y)
+{
   XSetFunction(display, gc, GXand);
-  XPutImage(display, draw, gc, data->mask, 0,0,x,y,
-	    image_width(img), image_height(img));
+  XPutImage(display, draw, gc, render->mask, 0,0,x,y,
+	    render->image->width, render->image->height);
   XSetFunction(display, gc, GXor);
-  XPutImage(display, draw, gc, data->image, 0,0,x,y,
-	    image_width(img), image_height(img));
+  XPutImage(display, draw, gc, render->image, 0,0,x,y,
+	    render->image->width, render->image->height);
   XSetFunction(display, gc, GXcopy);
 }
 
@@ -594,31 +563,37 @@ void image_plot_X(image_data* img,
 static Pixmap r_pix;
 static Picture r_pict;
 
-void image_plot_Xrender(image_data* img,
+x_render* image_render_Xrender(image_data* img,
+			       Display*    display,
+			       int n, int d,
+			       int filter)
+{
+  x_render* render;
+
+  image_unload_rgb(img);
+  if (n != d)
+    image_resample(img, n, d, filter);
+
+  render = malloc(sizeof(x_render));
+  render->image = image_to_ximage_render(img, display, 
+					 DefaultVisual(display, DefaultScreen(display)));
+  render->mask  = NULL;
+  render->size  = sizeof(x_render) + ximage_size(render->image);
+
+  image_unload_rgb(img);
+
+  return render;
+}
+
+void image_plot_Xrender(x_render* render,
 			Display*  display,
 			Picture   pic,
-			int x, int y,
-			int n, int d)
+			int x, int y)
 {
-  struct x_data* data;
   int xpos, ypos;
 
   GC agc;
 
-  data = image_get_data(img);
-
-  if (data == NULL)
-    {
-      data = malloc(sizeof(struct x_data));
-      data->image = NULL;
-      data->mask  = NULL;
-      data->display = display;
-
-      data->render = NULL;
-
-      image_set_data(img, data, x_destruct);
-    }
-  
   /* Get the format if necessary */
   if (format == NULL)
     {
@@ -637,19 +612,6 @@ void image_plot_Xrender(image_data* img,
 	}
     }
 
-  /* Render the image, if necessary */
-  if (data->render == NULL)
-    {
-      image_unload_rgb(img);
-      if (n != d)
-	image_resample(img, n, d);
-      
-      data->render = image_to_ximage_render(img, display, 
-					    DefaultVisual(display, DefaultScreen(display)));
-
-      image_unload_rgb(img);
-    }
-
   /*
    * Why do we things this roundabout way? Because Xrender (at least
    * with my Nvidia drivers) goes... odd... with 'large' composites,
@@ -674,22 +636,22 @@ void image_plot_Xrender(image_data* img,
   XSetFunction(display, agc, GXcopy);
   
   xpos = 0; ypos = 0;
-  for (xpos = 0; xpos < image_width(img); xpos+=RENDER_TILE)
+  for (xpos = 0; xpos < render->image->width; xpos+=RENDER_TILE)
     {
       int w = RENDER_TILE;
 
-      if (xpos + w > image_width(img))
-	w = image_width(img)-xpos;
+      if (xpos + w > render->image->width)
+	w = render->image->width-xpos;
 
-      for (ypos = 0; ypos < image_height(img); ypos+=RENDER_TILE)
+      for (ypos = 0; ypos < render->image->height; ypos+=RENDER_TILE)
 	{
 	  int h = RENDER_TILE;
 
-	  if (ypos + h > image_height(img))
-	    h = image_height(img)-ypos;
+	  if (ypos + h > render->image->height)
+	    h = render->image->height-ypos;
 	  
 	  XPutImage(display, r_pix, agc, 
-		    data->render,
+		    render->image,
 		    xpos, ypos, 0,0, w, h);
 	  XRenderComposite(display, PictOpOver,
 			   r_pict,
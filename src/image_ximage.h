@@ -39,28 +39,43 @@
 #   include <X11/extensions/Xrender.h>
 #  endif
 
-extern XImage* image_to_ximage_truecolour(image_data* img,
-					  Display*    display,
-					  Visual*     visual);
-extern XImage* image_to_mask_truecolour  (XImage*     orig,
-					  image_data* img,
-					  Display*    display,
-					  Visual*     visual);
-extern void    image_plot_X              (image_data* img,
-					  Display*  display,
-					  Drawable  draw,
-					  GC        gc,
-					  int x, int y,
-					  int n, int d);
+/* A picture rendered at a particular scale, ready to be plotted */
+typedef struct x_render
+{
+  XImage* image;
+  XImage* mask;  /* Not used with XRender */
+  long    size;  /* Bytes used, including the images */
+} x_render;
+
+extern XImage*   image_to_ximage_truecolour(image_data* img,
+					    Display*    display,
+					    Visual*     visual);
+extern XImage*   image_to_mask_truecolour  (XImage*     orig,
+					    image_data* img,
+					    Display*    display,
+					    Visual*     visual);
+extern x_render* image_render_X            (image_data* img,
+					    Display*    display,
+					    int n, int d,
+					    int filter);
+extern void      image_plot_X              (x_render* render,
+					    Display*  display,
+					    Drawable  draw,
+					    GC        gc,
+					    int x, int y);
+extern void      image_render_free         (void* render);
 #  ifdef HAVE_XRENDER
-extern XImage* image_to_ximage_render(image_data* img,
-				      Display*    display,
-				      Visual*     visual);
-extern void    image_plot_Xrender    (image_data* img,
-				      Display*  display,
-				      Picture   pic,
-				      int x, int y,
-				      int n, int d);
+extern XImage*   image_to_ximage_render(image_data* img,
+					Display*    display,
+					Visual*     visual);
+extern x_render* image_render_Xrender  (image_data* img,
+					Display*    display,
+					int n, int d,
+					int filter);
+extern void      image_plot_Xrender    (x_render* render,
+					Display*  display,
+					Picture   pic,
+					int x, int y);
 #  endif
 
 # endif
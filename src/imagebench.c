@@ -0,0 +1,202 @@
+/*
+ * Benchmark for image_resample, using the pictures in a blorb file
+ *
+ * Scales every PNG picture in each blorb by a few factors with each of
+ * the filters, timing only the resampling (the picture is decoded again
+ * before each round, outside the timing).
+ *
+ * Build it in src once configure has been run, against libpng:
+ *
+ *   gcc -O2 -DHAVE_CONFIG_H -I. -o imagebench imagebench.c image_libpng.c file.c -lpng -lm
+ *   ./imagebench pictures.blb [more.zblorb ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "zmachine.h"
+#include "file.h"
+#include "image.h"
+
+#define ROUNDS 5
+
+static const struct
+{
+  int n, d;
+} scales[] = { { 1, 3 }, { 1, 2 }, { 3, 2 }, { 2, 1 }, { 3, 1 } };
+#define N_SCALES (sizeof(scales)/sizeof(scales[0]))
+
+static const char* filter_name[] = { "box", "bilinear", "lanczos" };
+#define N_FILTERS 3
+
+void zmachine_fatal(char* format, ...)
+{
+  fprintf(stderr, "imagebench: fatal error: %s\n", format);
+  exit(1);
+}
+
+/***                           ----// 888 \\----                           ***/
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static unsigned int be32(const unsigned char* p)
+{
+  return (p[0]<<24)|(p[1]<<16)|(p[2]<<8)|p[3];
+}
+
+/* Times resampling a picture with every filter at every scale */
+static void bench(const char* filename, int num, ZFile* file,
+		  int offset, int length, double totals[N_FILTERS])
+{
+  image_data* img;
+  double      times[N_FILTERS][N_SCALES];
+  int         width, height;
+  int         scale, filter, round;
+
+  img = image_load(file, offset, length, NULL);
+  if (img == NULL)
+    {
+      printf("%s: picture %i won't load\n", filename, num);
+      return;
+    }
+
+  width  = image_width(img);
+  height = image_height(img);
+
+  for (filter=0; filter<N_FILTERS; filter++)
+    {
+      for (scale=0; scale<N_SCALES; scale++)
+	{
+	  double total = 0;
+
+	  for (round=0; round<ROUNDS; round++)
+	    {
+	      double start;
+
+	      /* Back to the original size */
+	      image_unload(img);
+	      img = image_load(file, offset, length, NULL);
+	      image_rgb(img);
+
+	      start = now();
+	      image_resample(img, scales[scale].n, scales[scale].d,
+			     filter);
+	      total += now() - start;
+	    }
+
+	  times[filter][scale] = total/ROUNDS;
+	  totals[filter]      += total/ROUNDS;
+	}
+    }
+
+  image_unload(img);
+
+  printf("%s: picture %i (%ix%i)\n", filename, num, width, height);
+  for (filter=0; filter<N_FILTERS; filter++)
+    {
+      printf("  %-8s", filter_name[filter]);
+      for (scale=0; scale<N_SCALES; scale++)
+	printf("  %i/%i %7.2fms", scales[scale].n, scales[scale].d,
+	       times[filter][scale]*1000.0);
+      printf("\n");
+    }
+}
+
+/* Finds the PNG pictures in a blorb file via its resource index */
+static int bench_blorb(char* filename, double totals[N_FILTERS])
+{
+  ZFile*         file;
+  unsigned char* header;
+  unsigned char* index;
+  int            size, n_resources, x, count;
+
+  size = get_file_size(filename);
+  file = open_file(filename);
+  if (file == NULL || size < 24)
+    return -1;
+
+  header = read_block(file, 0, 24);
+  if (memcmp(header, "FORM", 4) != 0 || memcmp(header+8, "IFRS", 4) != 0 ||
+      memcmp(header+12, "RIdx", 4) != 0 || be32(header+16) < 4 ||
+      be32(header+16) > size - 20)
+    {
+      free(header);
+      close_file(file);
+      return -1;
+    }
+
+  index = read_block(file, 20, 20 + be32(header+16));
+  n_resources = be32(index);
+  if (n_resources < 0 || 4 + n_resources*12 > be32(header+16))
+    n_resources = 0;
+
+  count = 0;
+  for (x=0; x<n_resources; x++)
+    {
+      unsigned char* entry = index + 4 + x*12;
+      unsigned char* chunk;
+      unsigned int   offset;
+
+      offset = be32(entry+8);
+      if (memcmp(entry, "Pict", 4) != 0 || offset > size - 8)
+	continue;
+
+      chunk = read_block(file, offset, offset+8);
+      if (memcmp(chunk, "PNG ", 4) == 0 && be32(chunk+4) <= size - offset - 8)
+	{
+	  bench(filename, be32(entry+4), file, offset+8, be32(chunk+4), totals);
+	  count++;
+	}
+      free(chunk);
+    }
+
+  free(index);
+  free(header);
+  close_file(file);
+  return count;
+}
+
+int main(int argc, char** argv)
+{
+  double totals[N_FILTERS];
+  int x, filter, pictures;
+
+  if (argc < 2)
+    {
+      fprintf(stderr, "Usage: %s blorb-file ...\n", argv[0]);
+      return 1;
+    }
+
+  for (filter=0; filter<N_FILTERS; filter++)
+    totals[filter] = 0;
+  pictures = 0;
+
+  for (x=1; x<argc; x++)
+    {
+      int count;
+
+      count = bench_blorb(argv[x], totals);
+      if (count < 0)
+	printf("%s: not a blorb file\n", argv[x]);
+      else
+	pictures += count;
+    }
+
+  if (pictures > 0)
+    {
+      printf("\nAll %i pictures at every scale:", pictures);
+      for (filter=0; filter<N_FILTERS; filter++)
+	printf("  %s %.1fms", filter_name[filter], totals[filter]*1000.0);
+      printf("\n");
+    }
+
+  return 0;
+}
@@ -43,6 +43,7 @@
 #include "random.h"
 #include "debug.h"
 #include "v6display.h"
+#include "profile.h"
 
 #if WINDOW_SYSTEM == 2
 #include <windows.h>
@@ -58,7 +59,7 @@
    break; case 1: if ((y)!=0) x=1; break; case 2: if ((y)!=0) x=0; break; \
    case 3: x ^= (y)!=0; }
 
-static struct v6_wind
+static ZSTATE struct v6_wind
 {
   int wrapping, scrolling, transcript, buffering;
 
@@ -183,7 +184,7 @@ ZFrame* call_routine(ZDWord* pc, ZStack* stack, ZDWord start)
   int n_locals;
   int x;
 
-  newframe = malloc(sizeof(ZFrame));
+  newframe = zmachine_alloc_frame();
   
   newframe->ret          = *pc;
   newframe->flags        = 0;
@@ -196,11 +197,14 @@ ZFrame* call_routine(ZDWord* pc, ZStack* stack, ZDWord start)
   else
     newframe->frame_num  = 1;
   newframe->last_frame   = stack->current_frame;
-  newframe->v4read       = NULL;
-  newframe->v5read       = NULL;
   newframe->end_func     = 0;
   stack->current_frame   = newframe;
   
+#ifdef PROFILE
+  if (machine.profile_file != NULL)
+    profile_call(start, newframe);
+#endif
+
   n_locals = GetCode(start);
   newframe->nlocals = n_locals;
 
@@ -296,6 +300,7 @@ void restart_machine(void)
       display_join(0,2);
     }
 
+  zmachine_flush_properties();
   zmachine_setup_header();
   display_has_restarted();
 }
@@ -304,6 +309,209 @@ void restart_machine(void)
 #define parent_3  4
 #define sibling_3 5
 #define child_3   6
+#define UnpackR(x) (machine.packtype==packed_v4?4*((ZUWord)x):(machine.packtype==packed_v8?8*((ZUWord)x):4*((ZUWord)x)+machine.routine_offset))
+#define UnpackS(x) (machine.packtype==packed_v4?4*((ZUWord)x):(machine.packtype==packed_v8?8*((ZUWord)x):4*((ZUWord)x)+machine.string_offset))
+#define Obj4(x) ((machine.memory + (GetWord(machine.header, ZH_objs))) + 126 + ((((ZUWord)x)-1)*14))
+#define parent_4  6
+#define sibling_4 8
+#define child_4   10
+#define GetParent4(x) (((x)[parent_4]<<8)|(x)[parent_4+1])
+#define GetSibling4(x) (((x)[sibling_4]<<8)|(x)[sibling_4+1])
+#define GetChild4(x) (((x)[child_4]<<8)|(x)[child_4+1])
+#define GetPropAddr4(x) (((x)[12]<<8)|(x)[13])
+
+/***                           ----// 888 \\----                           ***/
+
+/*
+ * The property index
+ *
+ * Looking up a property normally means scanning through the property
+ * table of an object. Instead, we build an index of each object's
+ * properties the first time they are used. The index depends only on
+ * the object's property table address and the property headers, so we
+ * record which bytes of dynamic memory those occupy and throw all the
+ * indexes away if any of them is overwritten. The string cache in
+ * zscii.c watches the memory its strings came from in the same way.
+ */
+
+void zmachine_flush_properties(void)
+{
+  int x;
+
+  if (machine.prop_index != NULL)
+    {
+      for (x=0; x<machine.n_prop_index; x++)
+	{
+	  if (machine.prop_index[x] != NULL)
+	    free(machine.prop_index[x]);
+	}
+      free(machine.prop_index);
+    }
+  if (machine.prop_headers != NULL)
+    free(machine.prop_headers);
+
+  machine.prop_index   = NULL;
+  machine.n_prop_index = 0;
+  machine.prop_headers = NULL;
+
+  zscii_flush_cache();
+}
+
+/*
+ * Everything that stores into dynamic memory calls this (via mem_write
+ * for the opcodes), so that the indexes and the string cache can notice
+ * when something they depend on changes
+ */
+void zmachine_memory_write(ZUWord address, ZUWord len)
+{
+  ZDWord x;
+
+  if (machine.prop_headers == NULL)
+    return;
+
+  for (x=address; x<(ZDWord)address+len && x<machine.dynamic_ceiling; x++)
+    {
+      if (machine.prop_headers[x>>3]&(1<<(x&7)))
+	{
+	  zmachine_flush_properties();
+	  return;
+	}
+    }
+}
+
+static inline void mem_write(ZUWord address, ZUWord len)
+{
+  if (machine.prop_headers != NULL)
+    zmachine_memory_write(address, len);
+}
+
+static inline void mark_prop_header(ZDWord address, int len)
+{
+  for (; len > 0 && address < machine.dynamic_ceiling; len--, address++)
+    machine.prop_headers[address>>3] |= 1<<(address&7);
+}
+
+void zmachine_watch_memory(ZDWord address, int len)
+{
+  if (machine.prop_headers == NULL)
+    machine.prop_headers = calloc((machine.dynamic_ceiling>>3)+1, 1);
+
+  mark_prop_header(address, len);
+}
+
+static ZPropIndex* index_object(ZUWord object)
+{
+  ZPropIndex* index;
+  ZByte*      obj;
+  ZUWord      adr;
+  ZByte*      last;
+  ZByte       dummy;
+
+  if (machine.prop_headers == NULL)
+    machine.prop_headers = calloc((machine.dynamic_ceiling>>3)+1, 1);
+
+  if (object >= machine.n_prop_index)
+    {
+      int x, n;
+
+      n = ((object>>6)+1)<<6;
+      machine.prop_index = realloc(machine.prop_index, 
+				   sizeof(ZPropIndex*)*n);
+      for (x=machine.n_prop_index; x<n; x++)
+	machine.prop_index[x] = NULL;
+      machine.n_prop_index = n;
+    }
+
+  index = calloc(1, sizeof(ZPropIndex));
+  machine.prop_index[object] = index;
+  last = &index->first;
+
+  if (ReadByte(0) <= 3)
+    {
+      ZByte size;
+
+      obj = Obj3(object);
+      mark_prop_header(obj + 7 - machine.memory, 2);
+
+      adr = (obj[7]<<8)|obj[8];
+      mark_prop_header(adr, 1);
+      adr += ReadByte(adr)*2 + 1;
+
+      while ((size = ReadByte(adr)) != 0)
+	{
+	  int pnum;
+
+	  mark_prop_header(adr, 1);
+	  pnum = size&0x1f;
+
+	  *last = pnum;
+	  last = &dummy;
+	  if (index->addr[pnum] == 0)
+	    {
+	      index->addr[pnum] = adr + 1;
+	      index->len[pnum]  = (size>>5) + 1;
+	      last = &index->next[pnum];
+	    }
+
+	  adr += (size>>5) + 2;
+	}
+    }
+  else
+    {
+      obj = Obj4(object);
+      mark_prop_header(obj + 12 - machine.memory, 2);
+
+      adr = GetPropAddr4(obj);
+      mark_prop_header(adr, 1);
+      adr += ReadByte(adr)*2 + 1;
+
+      while ((ReadByte(adr)&0x3f) != 0)
+	{
+	  int pnum, len, pad;
+
+	  pnum = ReadByte(adr)&0x3f;
+	  if (ReadByte(adr)&0x80)
+	    {
+	      len = ReadByte(adr+1)&0x3f;
+	      pad = 2;
+
+	      if (len == 0)
+		len = 64;
+	    }
+	  else
+	    {
+	      len = (ReadByte(adr)&0x40)?2:1;
+	      pad = 1;
+	    }
+	  mark_prop_header(adr, pad);
+
+	  *last = pnum;
+	  last = &dummy;
+	  if (index->addr[pnum] == 0)
+	    {
+	      index->addr[pnum] = adr + pad;
+	      index->len[pnum]  = len;
+	      last = &index->next[pnum];
+	    }
+
+	  adr += len + pad;
+	}
+    }
+  
+  /* The terminating header also matters */
+  mark_prop_header(adr, 1);
+  *last = 0;
+
+  return index;
+}
+
+static inline ZPropIndex* prop_index(ZUWord object)
+{
+  if (object < machine.n_prop_index && machine.prop_index[object] != NULL)
+    return machine.prop_index[object];
+  return index_object(object);
+}
+
 
 struct prop
 {
@@ -315,28 +523,18 @@ struct prop
 
 static inline struct prop* get_object_prop_3(ZUWord object, ZWord property)
 {
-  ZByte* obj;
-  ZByte* prop;
-  ZByte  size;
+  ZPropIndex* index;
   
-  static struct prop info;
+  static ZSTATE struct prop info;
 
-  obj = Obj3(object);
-  prop = machine.memory + ((obj[7]<<8)|obj[8]);
+  index = prop_index(object);
 
-  prop = prop + (prop[0]*2) + 1;
-
-  while ((size = prop[0]) != 0)
+  if (index->addr[property] != 0)
     {
-      if ((size&0x1f) == property)
-	{
-	  info.size = (size>>5) + 1;
-	  info.prop = prop + 1;
-	  info.isdefault = 0;
-	  return &info;
-	}
-      
-      prop = prop + (size>>5) + 2;
+      info.size = index->len[property];
+      info.prop = machine.memory + index->addr[property];
+      info.isdefault = 0;
+      return &info;
     }
 
   info.size = 2;
@@ -346,16 +544,6 @@ static inline struct prop* get_object_prop_3(ZUWord object, ZWord property)
   return &info;
 }
 
-#define UnpackR(x) (machine.packtype==packed_v4?4*((ZUWord)x):(machine.packtype==packed_v8?8*((ZUWord)x):4*((ZUWord)x)+machine.routine_offset))
-#define UnpackS(x) (machine.packtype==packed_v4?4*((ZUWord)x):(machine.packtype==packed_v8?8*((ZUWord)x):4*((ZUWord)x)+machine.string_offset))
-#define Obj4(x) ((machine.memory + (GetWord(machine.header, ZH_objs))) + 126 + ((((ZUWord)x)-1)*14))
-#define parent_4  6
-#define sibling_4 8
-#define child_4   10
-#define GetParent4(x) (((x)[parent_4]<<8)|(x)[parent_4+1])
-#define GetSibling4(x) (((x)[sibling_4]<<8)|(x)[sibling_4+1])
-#define GetChild4(x) (((x)[child_4]<<8)|(x)[child_4+1])
-#define GetPropAddr4(x) (((x)[12]<<8)|(x)[13])
 
 struct propinfo
 {
@@ -366,7 +554,7 @@ struct propinfo
 
 static inline struct propinfo* get_object_propinfo_4(ZByte* prop)
 {
-  static struct propinfo pinfo;
+  static ZSTATE struct propinfo pinfo;
   
   if (prop[0]&0x80)
     {
@@ -389,62 +577,21 @@ static inline struct propinfo* get_object_propinfo_4(ZByte* prop)
 
 static inline struct prop* get_object_prop_4(ZUWord object, ZWord property)
 {
-  ZByte* obj;
-  ZByte* prop;
-  int    pnum;
+  ZPropIndex* index;
   
-  static struct prop info;
+  static ZSTATE struct prop info;
 
   if (object != 0)
     {
-      obj = Obj4(object);
-      prop = Address((ZUWord)GetPropAddr4(obj));
-      
-      prop += (prop[0]*2) + 1;
-      pnum = 128;
-      
-      while (pnum != 0)
+      index = prop_index(object);
+
+      if (index->addr[property] != 0)
 	{
-	  int len, pad;
-	  
-	  if (prop[0]&0x80)
-	    {
-	      pnum = prop[0]&0x3f;
-	      len  = prop[1]&0x3f;
-	      pad  = 2;
-	      
-	      if (len == 0)
-		len = 64;
-	    }
-	  else
-	    {
-	      pnum = prop[0]&0x3f;
-	      len  = (prop[0]&0x40)?2:1;
-	      pad  = 1;
-	    }
-	  
-#ifdef DEBUG
-	  printf_debug("(Property %i, (looking for %i) length %i: ", pnum,
-		 property, len);
-	  {
-	    int x;
-	    
-	    for (x=0; x<=len+pad; x++)
-	      printf_debug("$%x ", prop[x]);
-	    printf_debug(")\n");
-	  }
-#endif
-	  
-	  if (pnum == property)
-	    {
-	      info.size = len;
-	      info.prop = prop + pad;
-	      info.isdefault = 0;
-	      info.pad = pad;
-	      return &info;
-	    }
-	  
-	  prop = prop + len + pad;
+	  info.size = index->len[property];
+	  info.prop = machine.memory + index->addr[property];
+	  info.isdefault = 0;
+	  info.pad = (info.prop[-1]&0x80)?2:1;
+	  return &info;
 	}
     }
 
@@ -465,20 +612,17 @@ static inline struct prop* get_object_prop_4(ZUWord object, ZWord property)
 static int* tracking_object(ZUWord arg)
 {
   ZByte* obj;
-  ZByte* prop;
   int len;
 
   if (ReadByte(0) <= 3)
     {
       obj = Obj3(arg);
-      prop = machine.memory + ((obj[7]<<8)|obj[8]) + 1;
-      return zscii_to_unicode(prop, &len);
+      return zscii_decode_at(((obj[7]<<8)|obj[8]) + 1, &len);
     }
   else
     {
       obj = Obj4(arg);
-      prop = Address((ZUWord)GetPropAddr4(obj)+1);
-      return zscii_to_unicode(prop, &len);
+      return zscii_decode_at((ZUWord)GetPropAddr4(obj)+1, &len);
     }
 }
 
@@ -502,11 +646,11 @@ static void draw_statusbar_123(ZStack* stack)
   ZWord score;
   ZWord moves;
   ZByte* obj;
-  ZByte* prop;
+  ZDWord name;
   int len;
 
   obj = Obj3(GetVar(16));
-  prop = machine.memory + ((obj[7]<<8)|obj[8]) + 1;
+  name = ((obj[7]<<8)|obj[8]) + 1;
 
   stream_flush_buffer();
   stream_buffering(0);
@@ -518,7 +662,7 @@ static void draw_statusbar_123(ZStack* stack)
   display_erase_line(1);
   display_set_cursor(2, 0);
 
-  display_prints((int*)zscii_to_unicode(prop, &len));
+  display_prints((int*)zscii_decode_at(name, &len));
 
   score = GetVar(17);
   moves = GetVar(18);
@@ -614,8 +758,8 @@ inline static int convert_colour(int col)
     }
 }
 
-char save_fname[256] = "savefile.qut";
-char script_fname[256] = "script.txt";
+ZSTATE char save_fname[256] = "savefile.qut";
+ZSTATE char script_fname[256] = "script.txt";
 
 #if WINDOW_SYSTEM != 3 && WINDOW_SYSTEM !=4
 static void get_fname(char* name, int len, int save)
@@ -902,6 +1046,7 @@ static void zcode_op_output_stream(ZStack* stack,
 	}
 
       mem = Address((ZUWord)machine.memory_pos[machine.memory_on-1]);
+      mem_write((ZUWord)machine.memory_pos[machine.memory_on-1], 2);
       mem[0] = 0;
       mem[1] = 0;
       break;
@@ -977,14 +1122,16 @@ static void zcode_op_readchar(ZDWord* pc,
       if (args->arg[2] != 0)
 	{
 	  ZFrame* newframe;
+	  ZReadCallback* callback;
 	  
 	  newframe = call_routine(pc, stack, UnpackR(args->arg[2]));
 	  args->arg[7] = 1;
 	  newframe->storevar  = 0;
 	  newframe->flags     = 0;
-	  newframe->readblock = *args;
-	  newframe->readstore = st;
-	  newframe->v5read    = zcode_op_readchar;
+	  callback = zmachine_read_callback(newframe);
+	  callback->readblock = *args;
+	  callback->readstore = st;
+	  callback->v5read    = zcode_op_readchar;
 	  return;
 	}
     }
@@ -1055,6 +1202,7 @@ static void zcode_op_aread_5678(ZDWord* pc,
 
       if (ret != 0)
 	{
+	  mem_write((ZUWord)args->arg[0]+1, 1);
 	  mem[1] = 0;
 	  free(buf);
 	  return;
@@ -1149,6 +1297,7 @@ static void zcode_op_aread_5678(ZDWord* pc,
       if (!res)
 	{
 	  ZFrame* newframe;
+	  ZReadCallback* callback;
 	  int x;
 
 	  mem[1] = 0;
@@ -1158,14 +1307,16 @@ static void zcode_op_aread_5678(ZDWord* pc,
 	      buf[x] = unicode_to_lower(buf[x]);
 	      mem[x+2] = zscii_get_char(buf[x]);
 	    }
+	  mem_write((ZUWord)args->arg[0]+1, x+1);
 
 	  newframe = call_routine(pc, stack, UnpackR(args->arg[3]));
 	  args->arg[7] = 1;
 	  newframe->storevar  = 0;
 	  newframe->flags     = 0;
-	  newframe->readblock = *args;
-	  newframe->readstore = st;
-	  newframe->v5read    = zcode_op_aread_5678;
+	  callback = zmachine_read_callback(newframe);
+	  callback->readblock = *args;
+	  callback->readstore = st;
+	  callback->v5read    = zcode_op_aread_5678;
 	  free(buf);
 	  return;
 	}
@@ -1204,6 +1355,7 @@ static void zcode_op_aread_5678(ZDWord* pc,
       buf[x] = unicode_to_lower(buf[x]);
       mem[x+2] = zscii_get_char(buf[x]);
     }
+  mem_write((ZUWord)args->arg[0]+1, x+1);
 
   if (args->n_args > 1 && args->arg[1] != 0)
     {
@@ -1267,7 +1419,7 @@ static void zcode_op_sread_4(ZDWord* pc,
 			     ZArgblock* args)
 {
   ZByte* mem;
-  static int* buf;
+  static ZSTATE int* buf;
   int x;
 
   stream_flush_buffer();
@@ -1284,6 +1436,7 @@ static void zcode_op_sread_4(ZDWord* pc,
 
       if (ret != 0)
 	{
+	  mem_write((ZUWord)args->arg[0]+1, 1);
 	  mem[1] = 0;
 	  return;
 	}
@@ -1307,6 +1460,7 @@ static void zcode_op_sread_4(ZDWord* pc,
       if (!res)
 	{
 	  ZFrame* newframe;
+	  ZReadCallback* callback;
 	  int x;
 
 	  for (x=0; buf[x] != 0; x++)
@@ -1315,13 +1469,15 @@ static void zcode_op_sread_4(ZDWord* pc,
 	      mem[x+1] = zscii_get_char(buf[x]);
 	    }
 	  mem[x+1] = 0;
+	  mem_write((ZUWord)args->arg[0]+1, x+1);
 
 	  newframe = call_routine(pc, stack, UnpackR(args->arg[3]));
 	  args->arg[7] = 1;
 	  newframe->storevar  = 0;
 	  newframe->flags     = 0;
-	  newframe->readblock = *args;
-	  newframe->v4read    = zcode_op_sread_4;
+	  callback = zmachine_read_callback(newframe);
+	  callback->readblock = *args;
+	  callback->v4read    = zcode_op_sread_4;
 	  return;
 	}
     }
@@ -1332,6 +1488,7 @@ static void zcode_op_sread_4(ZDWord* pc,
       mem[x+1] = zscii_get_char(buf[x]);
     }
   mem[x+1] = 0;
+  mem_write((ZUWord)args->arg[0]+1, x+1);
 
   if (args->n_args > 1)
     {
@@ -1399,8 +1556,8 @@ void zcode_v6_initialise(void)
   v6_set_newline_function(newline_function);
 }
 
-static int*  pending_text = NULL;
-static int   pending_len;
+static ZSTATE int*  pending_text = NULL;
+static ZSTATE int   pending_len;
 
 static void newline_return(ZDWord*    pc,
 			   ZStack*    stack,
@@ -1519,6 +1676,8 @@ static inline int zcode_v6_push_stack(ZStack* stack,
     return 0;
 
   val = s + (len*2);
+  mem_write(stk, 2);
+  mem_write(stk + len*2, 2);
   val[0] = value>>8;
   val[1] = value;
   
@@ -1597,7 +1756,367 @@ int zmachine_decode_doubleop(ZStack* stack,
 }
 #endif
 
-static clock_t start_clock, end_clock;
+/***                           ----// 888 \\----                           ***/
+/* The pre-decoder */
+#ifdef PREDECODE
+
+/*
+ * Instructions in static and high memory can't change while a game is
+ * running, so they only need to be decoded once. The results are kept
+ * in a table of pages covering the story file, and the interpreter can
+ * then skip straight to the operation. Instructions in dynamic memory
+ * are always decoded the slow way.
+ */
+
+#define PD_OP     0x01 /* Opcode is valid */
+#define PD_STORE  0x02 /* Has a store variable */
+#define PD_BRANCH 0x04 /* Has a branch offset */
+#define PD_STRING 0x08 /* Followed by a string (not pre-decoded) */
+#define PD_LONG   0x10 /* Has two operand type bytes */
+#define PD_EXT    0x20 /* Extended opcode follows */
+
+#define PREDECODE_BLOCK 1024
+
+#define PREDECODE_TABLES
+# ifdef SUPPORT_VERSION_3
+#  include "interp_z3.h"
+# endif
+# ifdef SUPPORT_VERSION_4
+#  include "interp_z4.h"
+# endif
+# ifdef SUPPORT_VERSION_5
+#  include "interp_z5.h"
+# endif
+# ifdef SUPPORT_VERSION_6
+#  include "interp_z6.h"
+# endif
+#undef PREDECODE_TABLES
+
+/* Marks instructions that must be decoded the slow way */
+static ZDecoded predecode_none;
+
+void zmachine_predecode_flush(void)
+{
+  int x;
+
+  if (machine.predecoded != NULL)
+    {
+      for (x=0; x<machine.n_predecoded; x++)
+	{
+	  if (machine.predecoded[x] != NULL)
+	    free(machine.predecoded[x]);
+	}
+      free(machine.predecoded);
+    }
+
+  for (x=0; x<machine.n_predecode_blocks; x++)
+    free(machine.predecode_blocks[x]);
+  if (machine.predecode_blocks != NULL)
+    free(machine.predecode_blocks);
+
+  machine.predecoded         = NULL;
+  machine.n_predecoded       = 0;
+  machine.predecode_blocks   = NULL;
+  machine.n_predecode_blocks = 0;
+  machine.predecode_free     = 0;
+}
+
+void zmachine_predecode_invalidate(ZDWord address)
+{
+  int page;
+
+  if (machine.predecoded == NULL)
+    return;
+
+  /* Instructions can span a page boundary, so the previous page goes too */
+  for (page = (address>>8)-1; page <= (address>>8); page++)
+    {
+      if (page < 0 || page >= machine.n_predecoded)
+	continue;
+
+      if (machine.predecoded[page] != NULL)
+	{
+	  free(machine.predecoded[page]);
+	  machine.predecoded[page] = NULL;
+	}
+    }
+}
+
+/*
+ * Decodes operand types as for zmachine_decode_varop. Returns the
+ * address following the operands, or -1 if the encoding is one we leave
+ * to the standard decoder.
+ */
+static ZDWord predecode_operands(ZDecoded* dec,
+				 ZDWord pos,
+				 int ntypes)
+{
+  ZDWord opos;
+  int x, type;
+  int omitted = 0;
+
+  opos = pos + ntypes;
+
+  for (x=0; x<ntypes*4; x++)
+    {
+      type = (GetCode(pos+(x>>2))>>(6-(x&3)*2))&3;
+
+      if (type == 3)
+	{
+	  omitted = 1;
+	  continue;
+	}
+      if (omitted)
+	return -1;
+
+      switch (type)
+	{
+	case 0:
+	  dec->arg[x] = (GetCode(opos)<<8)|GetCode(opos+1);
+	  opos += 2;
+	  break;
+
+	case 1:
+	  dec->arg[x] = GetCode(opos);
+	  opos++;
+	  break;
+
+	case 2:
+	  dec->arg[x] = GetCode(opos);
+	  dec->varargs |= 1<<x;
+	  opos++;
+	  break;
+	}
+
+      dec->n_args++;
+    }
+
+  return opos;
+}
+
+static ZDecoded* predecode_instruction(ZDWord pc)
+{
+  const ZByte* table;
+  const ZByte* ext_table;
+  ZDecoded     dec;
+  ZDecoded*    res;
+  ZByte        flags;
+  ZDWord       pos;
+  int          type;
+
+  switch (machine.version)
+    {
+#ifdef SUPPORT_VERSION_3
+    case 3:
+      table = predecode_v3; ext_table = predecode_ext_v3;
+      break;
+#endif
+#ifdef SUPPORT_VERSION_4
+    case 4:
+      table = predecode_v4; ext_table = predecode_ext_v4;
+      break;
+#endif
+#ifdef SUPPORT_VERSION_5
+    case 5:
+    case 7:
+    case 8:
+      table = predecode_v5; ext_table = predecode_ext_v5;
+      break;
+#endif
+#ifdef SUPPORT_VERSION_6
+    case 6:
+      table = predecode_v6; ext_table = predecode_ext_v6;
+      break;
+#endif
+
+    default:
+      return &predecode_none;
+    }
+
+  if (machine.predecoded == NULL)
+    {
+      machine.n_predecoded = (machine.story_length>>8)+1;
+      machine.predecoded   = calloc(machine.n_predecoded,
+				    sizeof(ZDecodedPage*));
+    }
+
+  if ((pc>>8) >= machine.n_predecoded)
+    return &predecode_none;
+
+  dec.instr     = GetCode(pc);
+  dec.ext_instr = 0;
+  dec.n_args    = 0;
+  dec.varargs   = 0;
+  dec.st        = 0;
+  dec.branch    = 0;
+  dec.negate    = 0;
+
+  flags = table[dec.instr];
+
+  if (flags&PD_EXT)
+    {
+      /* Extended instruction */
+      dec.ext_instr = GetCode(pc+1);
+      flags = ext_table[dec.ext_instr];
+      pos = predecode_operands(&dec, pc+2, (flags&PD_LONG)?2:1);
+    }
+  else if (dec.instr < 0x80)
+    {
+      /* Long 2OP */
+      dec.n_args = 2;
+      dec.arg[0] = GetCode(pc+1);
+      dec.arg[1] = GetCode(pc+2);
+      if (dec.instr&0x40)
+	dec.varargs |= 1;
+      if (dec.instr&0x20)
+	dec.varargs |= 2;
+      pos = pc+3;
+    }
+  else if (dec.instr < 0xc0)
+    {
+      /* Short 1OP or 0OP */
+      type = (dec.instr>>4)&3;
+      pos  = pc+1;
+
+      switch (type)
+	{
+	case 0:
+	  dec.arg[0] = (GetCode(pos)<<8)|GetCode(pos+1);
+	  dec.n_args = 1;
+	  pos += 2;
+	  break;
+
+	case 2:
+	  dec.varargs = 1;
+	case 1:
+	  dec.arg[0] = GetCode(pos);
+	  dec.n_args = 1;
+	  pos++;
+	  break;
+	}
+    }
+  else
+    {
+      /* Variable form */
+      pos = predecode_operands(&dec, pc+1, (flags&PD_LONG)?2:1);
+    }
+
+  if (!(flags&PD_OP) || (flags&PD_STRING) || pos < 0)
+    {
+      res = &predecode_none;
+    }
+  else
+    {
+      if (flags&PD_STORE)
+	{
+	  dec.st = GetCode(pos);
+	  pos++;
+	}
+
+      if (flags&PD_BRANCH)
+	{
+	  int tmp;
+
+	  tmp = GetCode(pos);
+	  dec.branch = tmp&0x3f;
+	  pos++;
+	  if (!(tmp&0x40))
+	    {
+	      if (dec.branch&0x20)
+		dec.branch -= 64;
+	      dec.branch <<= 8;
+	      dec.branch |= GetCode(pos);
+	      pos++;
+	    }
+	  dec.negate = tmp&0x80;
+	}
+
+      dec.next = pos;
+
+      if (machine.predecode_free <= 0)
+	{
+	  machine.n_predecode_blocks++;
+	  machine.predecode_blocks = realloc(machine.predecode_blocks,
+					     sizeof(ZDecoded*)*machine.n_predecode_blocks);
+	  machine.predecode_blocks[machine.n_predecode_blocks-1] =
+	    malloc(sizeof(ZDecoded)*PREDECODE_BLOCK);
+	  machine.predecode_free = PREDECODE_BLOCK;
+	}
+
+      res = machine.predecode_blocks[machine.n_predecode_blocks-1] +
+	(PREDECODE_BLOCK - machine.predecode_free);
+      machine.predecode_free--;
+
+      *res = dec;
+    }
+
+  if (machine.predecoded[pc>>8] == NULL)
+    machine.predecoded[pc>>8] = calloc(1, sizeof(ZDecodedPage));
+  machine.predecoded[pc>>8]->instr[pc&0xff] = res;
+
+  return res;
+}
+
+static inline ZDecoded* predecoded(ZDWord pc)
+{
+  ZDecodedPage* page;
+
+  if (machine.predecoded != NULL &&
+      (pc>>8) < machine.n_predecoded &&
+      (page = machine.predecoded[pc>>8]) != NULL &&
+      page->instr[pc&0xff] != NULL)
+    return page->instr[pc&0xff];
+
+  return predecode_instruction(pc);
+}
+
+static inline void predecode_load(ZStack* stack,
+				  const ZDecoded* dec,
+				  ZArgblock* argblock)
+{
+  int x;
+
+  argblock->n_args = dec->n_args;
+
+  if (dec->varargs == 0)
+    {
+      for (x=0; x<dec->n_args; x++)
+	argblock->arg[x] = dec->arg[x];
+    }
+  else
+    {
+      for (x=0; x<dec->n_args; x++)
+	{
+	  if (dec->varargs&(1<<x))
+	    argblock->arg[x] = GetVar(dec->arg[x]);
+	  else
+	    argblock->arg[x] = dec->arg[x];
+	}
+    }
+
+  for (x=dec->n_args; x<4; x++)
+    argblock->arg[x] = 0;
+
+  /*
+   * The read opcodes use arg[7] to mark a read that's resuming after a
+   * timed routine, so it mustn't be left over from an earlier call with
+   * eight arguments. Nothing looks at arg[4..6] beyond n_args.
+   */
+  if (dec->n_args < 8)
+    argblock->arg[7] = 0;
+}
+
+#define predecode_fetch(dec) \
+   predecode_load(stack, dec, &argblock); \
+   st        = dec->st; \
+   branch    = dec->branch; \
+   negate    = dec->negate; \
+   instr     = dec->instr; \
+   ext_instr = dec->ext_instr; \
+   pc        = dec->next;
+#endif
+
+static ZSTATE clock_t start_clock, end_clock;
 
 void zmachine_run(const int version,
 		  char* savefile)
@@ -1609,8 +2128,6 @@ void zmachine_run(const int version,
 #endif
   ZStack*        stack;
 
-  int x;
-
   pc    = GetWord(machine.header, ZH_initpc);
   stack = &machine.stack;
 
@@ -1624,10 +2141,7 @@ void zmachine_run(const int version,
 
   zmachine_setup_header();
 
-  for (x=0; x<UNDO_LEVEL; x++)
-    {
-      machine.undo[x] = NULL;
-    }
+  state_clear_undo();
 
 #if defined(SUPPORT_VERSION_6)
   if (version == 6)
@@ -1722,7 +2236,11 @@ void zmachine_runsome(const int version,
 #define uarg2 ((ZUWord)argblock.arg[1])
   ZArgblock          argblock;
   register ZStack*   stack;
-  int *              string;
+  int *              string = NULL; /* (String instructions aren't pre-decoded) */
+#ifdef PREDECODE
+  ZByte              ext_instr;
+  ZDecoded*          dec;
+#endif
 
   int x;
   
@@ -1830,6 +2348,24 @@ void zmachine_runsome(const int version,
 		  debug_set_breakpoint(pc, 1, 0);
 	  }
 #endif
+#ifdef PROFILE
+  machine.profile_instructions++;
+#endif
+
+#ifdef PREDECODE
+  if (machine.predecode && pc >= machine.dynamic_ceiling &&
+      (dec = predecoded(pc)) != &predecode_none)
+    {
+      predecode_fetch(dec);
+
+      if (instr == 0xbe)
+	{
+	  instr = ext_instr;
+	  goto *exec_ext[instr];
+	}
+      goto *exec[instr];
+    }
+#endif
 	  
   instr = GetCode(pc);
  execute_instr:
@@ -1867,6 +2403,9 @@ void zmachine_runsome(const int version,
 		  debug_set_breakpoint(pc, 1, 0);
 	  }
 #endif
+#ifdef PROFILE
+  machine.profile_instructions++;
+#endif
 
       instr = GetCode(pc);
 
@@ -1879,6 +2418,15 @@ void zmachine_runsome(const int version,
 	zmachine_fatal("PC set to a value outside the story file");
 #endif
 
+#ifdef PREDECODE
+      if (machine.predecode && pc >= machine.dynamic_ceiling &&
+	  (dec = predecoded(pc)) != &predecode_none)
+	{
+	  predecode_fetch(dec);
+	  goto execute_predecoded;
+	}
+#endif
+
       /*
        * This bit is a tad confusing :-) What's going on here is that
        * first the interpreter checks for a 'general' instruction,
@@ -1933,6 +2481,44 @@ void zmachine_runsome(const int version,
 	default:
 	  zmachine_fatal("Unsupported version");
 	}
+
+#ifdef PREDECODE
+      goto loop;
+
+      /*
+       * Pre-decoded instructions arrive here with their operands
+       * already in place, and just need to be dispatched
+       */
+    execute_predecoded:
+#define PREDECODE_EXEC
+#include "interp_gen.h"
+
+    predecoded_version:
+      switch (version)
+	{
+#ifdef SUPPORT_VERSION_3
+	case 3:
+#include "interp_z3.h"
+#endif
+#ifdef SUPPORT_VERSION_4
+	case 4:
+#include "interp_z4.h"
+#endif
+#ifdef SUPPORT_VERSION_5
+	case 5:
+	case 7:
+	case 8:
+#include "interp_z5.h"
+#endif
+#ifdef SUPPORT_VERSION_6
+	case 6:
+#include "interp_z6.h"
+#endif
+	default:
+	  zmachine_fatal("Unsupported version");
+	}
+#undef PREDECODE_EXEC
+#endif
       loop: ;
     }
 #endif
@@ -31,4 +31,10 @@ extern void zmachine_run(const int version,
 extern void zmachine_runsome(const int version, 
 			     int start_counter);
 
+extern void zmachine_predecode_flush     (void);
+extern void zmachine_predecode_invalidate(ZDWord address);
+extern void zmachine_flush_properties    (void);
+extern void zmachine_memory_write        (ZUWord address, ZUWord len);
+extern void zmachine_watch_memory        (ZDWord address, int len);
+
 #endif
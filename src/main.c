@@ -44,6 +44,7 @@
 #include "menu.h"
 #include "random.h"
 #include "debug.h"
+#include "profile.h"
 
 #include "display.h"
 #include "v6display.h"
@@ -53,13 +54,51 @@
 #include "carbondisplay.h"
 #endif
 
-ZMachine machine;
-extern char save_fname[256];
-extern char script_fname[256];
+#if WINDOW_SYSTEM == 5
+#include "batchdisplay.h"
+#endif
 
-int zoom_main(int argc, char** argv)
+#ifdef HAVE_THREADS
+#include <pthread.h>
+#endif
+
+ZSTATE ZMachine machine;
+extern ZSTATE char save_fname[256];
+extern ZSTATE char script_fname[256];
+
+/*
+ * Loads the debugging symbols (gameinfo.dbg) for a story. If optional
+ * is set, it's not an error for there to be none.
+ */
+static void load_symbols(const char* story_file, int optional)
 {
-  arguments args;
+  char* filename;
+  char* pathname;
+  int x;
+
+  filename = malloc(strlen(story_file) + strlen("gameinfo.dbg") + 1);
+  pathname = malloc(strlen(story_file) + 1);
+  strcpy(filename, story_file);
+  strcpy(pathname, story_file);
+
+  for (x=strlen(filename)-1; x > 0 && filename[x-1] != '/'; x--);
+
+  strcpy(filename + x, "gameinfo.dbg");
+  pathname[x] = 0;
+
+  if (!optional || get_file_size(filename) >= 0)
+    debug_load_symbols(filename, pathname);
+
+  free(filename);
+  free(pathname);
+}
+
+/*
+ * Loads and runs the story described by args (an arguments*)
+ */
+static void run_story(void* data)
+{
+  arguments* args = data;
 #ifdef HAVE_GETTIMEOFDAY
   struct timeval tv;
 #endif
@@ -74,46 +113,38 @@ int zoom_main(int argc, char** argv)
   random_seed((unsigned int)time(NULL));
 #endif
 
-#if WINDOW_SYSTEM != 3
-  get_options(argc, argv, &args);
-#else
-  args.story_file = NULL;
-  args.save_file = NULL;
-  args.warning_level = 0;
-  if (carbon_prefs.show_warnings)
-    {
-      args.warning_level = 1;
-      if (carbon_prefs.fatal_warnings)
-	args.warning_level = 2;
-    }
-  args.track_attr = args.track_objs = args.track_props = args.graphical = 0;
+  machine.warning_level = args->warning_level;
+#ifdef PREDECODE
+  machine.predecode = args->predecode;
 #endif
-  machine.warning_level = args.warning_level;
+  machine.undo_levels = args->undo_levels;
+  machine.undo_limit  = args->undo_limit;
 
-#ifdef TRACKING
-  machine.track_objects = args.track_objs;
-  machine.track_attributes = args.track_attr;
-  machine.track_properties = args.track_props;
+#ifdef PROFILE
+  machine.profile_file = args->profile;
+  if (machine.profile_file != NULL)
+    profile_reset();
 #endif
 
-  rc_load();
-#if WINDOW_SYSTEM == 3
-  carbon_merge_rc();
+#ifdef TRACKING
+  machine.track_objects = args->track_objs;
+  machine.track_attributes = args->track_attr;
+  machine.track_properties = args->track_props;
 #endif
 
 #if WINDOW_SYSTEM != 3  
-  if (args.story_file == NULL)
+  if (args->story_file == NULL)
     {
       rc_set_game("xxxxxx", 65535, 65535);
       display_initialise();
-      args.story_file = menu_get_story();
-      zmachine_load_story(args.story_file, &machine);
+      args->story_file = menu_get_story();
+      zmachine_load_story(args->story_file, &machine);
       rc_set_game(zmachine_get_serial(), Word(ZH_release), Word(ZH_checksum));
       display_reinitialise();
     }
   else
     {
-      zmachine_load_story(args.story_file, &machine);
+      zmachine_load_story(args->story_file, &machine);
       rc_set_game(zmachine_get_serial(), Word(ZH_release), Word(ZH_checksum));
       display_initialise();
     }
@@ -123,7 +154,7 @@ int zoom_main(int argc, char** argv)
 
     zmachine_load_story(NULL, &machine);
     FSRefMakePath(lastopenfs, path, 256);
-    args.story_file = path;
+    args->story_file = path;
     rc_set_game(zmachine_get_serial(), Word(ZH_release), Word(ZH_checksum));
     display_initialise();
   }
@@ -134,28 +165,28 @@ int zoom_main(int argc, char** argv)
     char* name;
     int x, len, slashpos;
 
-    len = strlen(args.story_file);
+    len = strlen(args->story_file);
 
-    machine.story_file = args.story_file;
+    machine.story_file = args->story_file;
 
     slashpos = -1;
     name = malloc(len+1);
     for (x=0; x<len; x++)
       {
 #if WINDOW_SYSTEM != 2
-	if (args.story_file[x] == '/')
+	if (args->story_file[x] == '/')
 	  slashpos = x;
 #else
-	if (args.story_file[x] == '\\')
+	if (args->story_file[x] == '\\')
 	  slashpos = x;
 #endif
       }
 
     for (x=slashpos+1;
-	 args.story_file[x] != 0 && args.story_file[x] != '.';
+	 args->story_file[x] != 0 && args->story_file[x] != '.';
 	 x++)
       {
-	name[x-slashpos-1] = args.story_file[x];
+	name[x-slashpos-1] = args->story_file[x];
       }
     name[x-slashpos-1] = 0;
 
@@ -184,8 +215,8 @@ int zoom_main(int argc, char** argv)
 	/*
 	 * Try to load a suitable blorb file...
 	 */
-	file = malloc(strlen(args.story_file)+6);
-	strcpy(file, args.story_file);
+	file = malloc(strlen(args->story_file)+6);
+	strcpy(file, args->story_file);
 
 	for (x=strlen(file)-1; x>=0 && file[x] != '.'; x--);
 	if (x < 0)
@@ -254,6 +285,7 @@ int zoom_main(int argc, char** argv)
   }
 #endif
   
+#if WINDOW_SYSTEM != 5
   display_set_style(2);
 #ifdef CUTE_STARTUP
   display_prints_c("\n\nMaze\n");
@@ -293,8 +325,9 @@ int zoom_main(int argc, char** argv)
   display_readchar(0);
   display_set_colour(rc_get_foreground(), rc_get_background());
   display_clear();
+#endif
 
-  machine.graphical = args.graphical;
+  machine.graphical = args->graphical;
   
   machine.display_active = 1;
 
@@ -302,24 +335,12 @@ int zoom_main(int argc, char** argv)
     {
       display_set_cursor(0,0);
       
-      if (args.debug_mode == 1)
+      if (args->debug_mode == 1)
 	{
-	  char* filename;
-	  char* pathname;
 	  int x;
 	  debug_symbol* start;
 	  
-	  filename = malloc(strlen(args.story_file) + strlen("gameinfo.dbg") + 1);
-	  pathname = malloc(strlen(args.story_file) + 1);
-	  strcpy(filename, args.story_file);
-	  strcpy(pathname, args.story_file);
-	  
-	  for (x=strlen(filename)-1; x > 0 && filename[x-1] != '/'; x--);
-	  
-	  strcpy(filename + x, "gameinfo.dbg");
-	  pathname[x] = 0;
-	  
-	  debug_load_symbols(filename, pathname);
+	  load_symbols(args->story_file, 0);
 	  
 	  start = hash_get(debug_syms.symbol, (unsigned char*)"main", 4);
 	  if (start == NULL ||
@@ -351,30 +372,30 @@ int zoom_main(int argc, char** argv)
 
       display_set_colour(rc_get_foreground(), rc_get_background()); display_set_font(0);
       display_set_window(0);
-      zmachine_run(3, args.save_file);
+      zmachine_run(3, args->save_file);
       break;
 #endif
 #ifdef SUPPORT_VERSION_4
     case 4:
-      zmachine_run(4, args.save_file);
+      zmachine_run(4, args->save_file);
       break;
 #endif
 #ifdef SUPPORT_VERSION_5
     case 5:
-      zmachine_run(5, args.save_file);
+      zmachine_run(5, args->save_file);
       break;
     case 7:
-      zmachine_run(7, args.save_file);
+      zmachine_run(7, args->save_file);
       break;
     case 8:
-      zmachine_run(8, args.save_file);
+      zmachine_run(8, args->save_file);
       break;
 #endif
 #ifdef SUPPORT_VERSION_6
     case 6:
       v6_startup();
       v6_set_cursor(1,1);
-      zmachine_run(6, args.save_file);
+      zmachine_run(6, args->save_file);
       break;
 #endif
 
@@ -384,14 +405,271 @@ int zoom_main(int argc, char** argv)
     }
 
   stream_flush_buffer();
+
+#ifdef PROFILE
+  if (machine.profile_file != NULL)
+    {
+      /* Routines are named from the debugging symbols, if there are any */
+      if (debug_syms.nroutines == 0)
+	load_symbols(args->story_file, 1);
+      profile_write(machine.profile_file);
+    }
+#endif
+}
+
+#if WINDOW_SYSTEM == 5
+/***                           ----// 888 \\----                           ***/
+
+/* Running several stories from a file of runs */
+
+typedef struct batch_job
+{
+  arguments args;
+  char*     transcript;
+  int       result;
+} batch_job;
+
+static batch_job* jobs     = NULL;
+static int        njobs    = 0;
+static int        next_job = 0;
+
+#ifdef HAVE_THREADS
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+# define LockJobs()   pthread_mutex_lock(&job_lock)
+# define UnlockJobs() pthread_mutex_unlock(&job_lock)
+#else
+# define LockJobs()
+# define UnlockJobs()
+#endif
+
+static char* copy_string(const char* str)
+{
+  char* res;
+
+  res = malloc(strlen(str)+1);
+  strcpy(res, str);
+  return res;
+}
+
+/* Reads the runs file: one 'story commands [transcript]' per line */
+static void read_runs(arguments* args)
+{
+  FILE* f;
+  char  line[1024];
+  int   lineno = 0;
+
+  f = fopen(args->runs, "r");
+  if (f == NULL)
+    zmachine_fatal("Unable to open runs file '%s'", args->runs);
+
+  while (fgets(line, 1024, f) != NULL)
+    {
+      char* field[3];
+      int   nfields;
+      char* tok;
+      batch_job* job;
+
+      lineno++;
+
+      nfields = 0;
+      for (tok = strtok(line, " \t\r\n");
+	   tok != NULL && tok[0] != '#' && nfields < 3;
+	   tok = strtok(NULL, " \t\r\n"))
+	field[nfields++] = tok;
+
+      if (nfields == 0)
+	continue;
+      if (nfields < 2)
+	zmachine_fatal("%s:%i: expected 'story commands [transcript]'",
+		       args->runs, lineno);
+
+      jobs = realloc(jobs, sizeof(batch_job)*(njobs+1));
+      job = jobs + (njobs++);
+
+      job->args = *args;
+      job->args.story_file = copy_string(field[0]);
+      job->args.save_file  = NULL;
+      job->args.commands   = copy_string(field[1]);
+      job->args.batch      = 1;
+      job->result          = 0;
+
+      if (nfields > 2)
+	{
+	  job->transcript = copy_string(field[2]);
+	}
+      else
+	{
+	  job->transcript = malloc(strlen(field[1])+5);
+	  strcpy(job->transcript, field[1]);
+	  strcat(job->transcript, ".out");
+	}
+    }
+
+  fclose(f);
+
+#ifdef PROFILE
+  /* Each run gets a profile of its own: FILE.1, FILE.2... */
+  if (args->profile != NULL && njobs > 1)
+    {
+      int x;
+
+      for (x=0; x<njobs; x++)
+	{
+	  jobs[x].args.profile = malloc(strlen(args->profile)+12);
+	  sprintf(jobs[x].args.profile, "%s.%i", args->profile, x+1);
+	}
+    }
+#endif
+}
+
+static void run_job(void* data)
+{
+  batch_job* job = data;
+
+  batch_set_input(job->args.commands, 1);
+  run_story(&job->args);
+}
+
+/* Takes jobs off the list until there are none left */
+static void* batch_worker(void* data)
+{
+  for (;;)
+    {
+      batch_job* job;
+      FILE*      out;
+
+      LockJobs();
+      if (next_job >= njobs)
+	{
+	  UnlockJobs();
+	  break;
+	}
+      job = jobs + (next_job++);
+      UnlockJobs();
+
+      out = fopen(job->transcript, "w");
+      if (out == NULL)
+	{
+	  fprintf(stderr, "Unable to write transcript '%s'\n",
+		  job->transcript);
+	  job->result = 1;
+	  continue;
+	}
+
+      batch_set_output(out);
+      job->result = batch_run(run_job, job);
+      batch_set_output(NULL);
+      fclose(out);
+
+      zmachine_unload_story();
+    }
+
+  batch_set_input(NULL, 1);
+  return NULL;
+}
+
+static int run_batch(arguments* args)
+{
+  int failed;
+  int x;
+
+  read_runs(args);
+  rc_load();
+
+#ifdef HAVE_THREADS
+  {
+    pthread_t* threads;
+    int nthreads;
+
+    nthreads = args->jobs;
+    if (nthreads > njobs)
+      nthreads = njobs;
+    if (nthreads < 1)
+      nthreads = 1;
+
+    threads = malloc(sizeof(pthread_t)*nthreads);
+    for (x=0; x<nthreads; x++)
+      {
+	if (pthread_create(threads + x, NULL, batch_worker, NULL) != 0)
+	  zmachine_fatal("Unable to start a thread");
+      }
+    for (x=0; x<nthreads; x++)
+      pthread_join(threads[x], NULL);
+    free(threads);
+  }
+#else
+  if (args->jobs > 1)
+    zmachine_warning("This interpreter cannot run stories at once: running them one at a time");
+  batch_worker(NULL);
+#endif
+
+  failed = 0;
+  for (x=0; x<njobs; x++)
+    {
+      printf("%s %s: %s\n", jobs[x].result==0?"ok":"FAILED",
+	     jobs[x].args.story_file, jobs[x].args.commands);
+      if (jobs[x].result != 0)
+	failed++;
+    }
+
+  return failed==0?0:1;
+}
+#endif
+
+int zoom_main(int argc, char** argv)
+{
+  arguments args;
+
+  machine.display_active = 0;
+
+#if WINDOW_SYSTEM != 3  
+  get_options(argc, argv, &args);
+#else
+  args.story_file = NULL;
+  args.save_file = NULL;
+  args.warning_level = 0;
+  if (carbon_prefs.show_warnings)
+    {
+      args.warning_level = 1;
+      if (carbon_prefs.fatal_warnings)
+	args.warning_level = 2;
+    }
+  args.track_attr = args.track_objs = args.track_props = args.graphical = 0;
+  args.predecode = 0;
+  args.undo_levels = args.undo_limit = 0;
+  args.batch = 0;
+  args.commands = NULL;
+  args.runs = NULL;
+  args.jobs = 1;
+  args.profile = NULL;
+#endif
+  machine.warning_level = args.warning_level;
+
+#if WINDOW_SYSTEM == 5
+  if (args.runs != NULL)
+    return run_batch(&args);
+
+  if (args.story_file == NULL)
+    zmachine_fatal("No story file given");
+  batch_set_input(args.commands, args.batch);
+#endif
+
+  rc_load();
+#if WINDOW_SYSTEM == 3
+  carbon_merge_rc();
+#endif
+
+  run_story(&args);
+
+#if WINDOW_SYSTEM != 5
   display_prints_c("\n");
   display_set_colour(7, 1);
   display_prints_c("[ Press any key to exit ]");
   display_set_colour(7, 0);
   display_readchar(0);
+#endif
 
   display_exit(0);
   
   return 0;
 }
-
@@ -37,6 +37,7 @@
   <ghost@aladdin.com>.  Other authors are noted in the change history
   that follows (in reverse chronological order):
 
+  2026-10-18 Added md5_file and md5_fd.
   2002-04-13 lpd Removed support for non-ANSI compilers; removed
 	references to Ghostscript; clarified derivation from RFC 1321;
 	now handles byte order either statically or dynamically.
@@ -55,9 +56,11 @@
  * byte order.  If ARCH_IS_BIG_ENDIAN is defined as 0, the code will be
  * compiled to run only on little-endian CPUs; if ARCH_IS_BIG_ENDIAN is
  * defined as non-zero, the code will be compiled to run only on big-endian
- * CPUs; if ARCH_IS_BIG_ENDIAN is not defined, the code will be compiled to
- * run on either big- or little-endian CPUs, but will run slightly less
- * efficiently on either one than if ARCH_IS_BIG_ENDIAN is defined.
+ * CPUs; if ARCH_IS_BIG_ENDIAN is not defined, the byte order the compiler
+ * gives in __BYTE_ORDER__ is used, and failing that the code will be
+ * compiled to run on either big- or little-endian CPUs, but will run
+ * slightly less efficiently on either one than if ARCH_IS_BIG_ENDIAN is
+ * defined.
  */
 
 typedef unsigned char md5_byte_t; /* 8-bit byte */
@@ -84,6 +87,14 @@ void md5_append(md5_state_t *pms, const md5_byte_t *data, int nbytes);
 /* Finish the message and return the digest. */
 void md5_finish(md5_state_t *pms, md5_byte_t digest[16]);
 
+/*
+ * Hash everything that can be read from a file descriptor (from its
+ * current position), or the whole of a named file. These return 0, or
+ * -1 if the file couldn't be read.
+ */
+int md5_fd(int fd, md5_byte_t digest[16]);
+int md5_file(const char *filename, md5_byte_t digest[16]);
+
 #ifdef __cplusplus
 }  /* end extern "C" */
 #endif
@@ -40,6 +40,22 @@ static struct argp_option options[] = {
   { "warnings", 'w', 0, 0, "Display interpreter warnings" },
   { "fatal", 'W', 0, 0, "Warnings are fatal" },
   { "debugmode", 'D', 0, 0, "Enable source-level debugger (requires gameinfo.dbg)" },
+#ifdef PREDECODE
+  { "predecode", 'p', 0, 0, "Cache decoded instructions (faster, but uses more memory)" },
+#endif
+#ifdef CAN_UNDO
+  { "undo", 'u', "LEVELS", 0, "Maximum number of undo levels" },
+  { "undo-memory", 'm', "KB", 0, "Maximum memory used for undo information" },
+#endif
+#if WINDOW_SYSTEM == 5
+  { "batch", 'b', 0, 0, "Exit when the commands run out instead of reading stdin" },
+  { "commands", 'c', "FILE", 0, "Read commands from FILE" },
+  { "runs", 'r', "FILE", 0, "Run each 'story commands [transcript]' line of FILE" },
+  { "jobs", 'j', "N", 0, "Number of stories to run at once with --runs" },
+#endif
+#ifdef PROFILE
+  { "profile", 'o', "FILE", 0, "Write an execution profile to FILE (and FILE.callgrind)" },
+#endif
 #ifdef TRACKING
   { "trackobjs", 'O', 0, 0, "Track object movement" },
   { "trackattrs", 'A', 0, 0, "Track attribute testing/setting" },
@@ -74,6 +90,34 @@ static error_t parse_opt(int key, char* arg, struct argp_state* state)
     case 'D':
       args->debug_mode = 1;
       break;
+
+    case 'p':
+      args->predecode = 1;
+      break;
+
+    case 'u':
+      args->undo_levels = atoi(arg);
+      break;
+    case 'm':
+      args->undo_limit = atoi(arg);
+      break;
+
+    case 'b':
+      args->batch = 1;
+      break;
+    case 'c':
+      args->commands = arg;
+      break;
+    case 'r':
+      args->runs = arg;
+      break;
+    case 'j':
+      args->jobs = atoi(arg);
+      break;
+
+    case 'o':
+      args->profile = arg;
+      break;
  
     case ARGP_KEY_ARG:
       if (state->arg_num >= 2)
@@ -107,6 +151,15 @@ void get_options(int argc, char** argv, arguments* args)
   args->track_props = 0;
 
   args->debug_mode  = 0;
+  args->predecode   = 0;
+  args->undo_levels = 0;
+  args->undo_limit  = 0;
+
+  args->batch       = 0;
+  args->commands    = NULL;
+  args->runs        = NULL;
+  args->jobs        = 1;
+  args->profile     = NULL;
    
   argp_parse(&argp, argc, argv, 0, 0, args);
 
@@ -127,8 +180,22 @@ void get_options(int argc, char** argv, arguments* args)
   args->warning_level = 0;
   args->graphical = 0;
   args->debug_mode = 0;
+  args->predecode = 0;
+  args->undo_levels = 0;
+  args->undo_limit = 0;
+  args->batch = 0;
+  args->commands = NULL;
+  args->runs = NULL;
+  args->jobs = 1;
+  args->profile = NULL;
+
+#ifdef PROFILE
+# define PROFILE_OPT "o:"
+#else
+# define PROFILE_OPT
+#endif
 
-  while ((opt=getopt(argc, argv, "?hVWwgD")) != -1)
+  while ((opt=getopt(argc, argv, "?hVWwgDpu:m:bc:r:j:" PROFILE_OPT)) != -1)
     {
       switch (opt)
 	{
@@ -141,6 +208,18 @@ void get_options(int argc, char** argv, arguments* args)
 	  printf_info("    -w         display warnings\n");
 	  printf_info("    -W         make all warnings fatal (strict standards compliance)\n");
 	  printf_info("    -D         enable symbolic debug mode (requires gameinfo.dbg)\n");
+	  printf_info("    -p         cache decoded instructions (faster, uses more memory)\n");
+	  printf_info("    -u LEVELS  maximum number of undo levels\n");
+	  printf_info("    -m KB      maximum memory used for undo information\n");
+#if WINDOW_SYSTEM == 5
+	  printf_info("    -b         exit when the commands run out\n");
+	  printf_info("    -c FILE    read commands from FILE\n");
+	  printf_info("    -r FILE    run each 'story commands [transcript]' line of FILE\n");
+	  printf_info("    -j N       number of stories to run at once with -r\n");
+#endif
+#ifdef PROFILE
+	  printf_info("    -o FILE    write an execution profile to FILE\n");
+#endif
 	  printf_info("Zoom is copyright (C) Andrew Hunter, 2000\n");
 	  printf_info_done();
 	  display_exit(0);
@@ -155,6 +234,38 @@ void get_options(int argc, char** argv, arguments* args)
 	  args->debug_mode = 1;
 	  break;
 
+	case 'p':
+	  args->predecode = 1;
+	  break;
+
+	case 'u':
+	  args->undo_levels = atoi(optarg);
+	  break;
+
+	case 'm':
+	  args->undo_limit = atoi(optarg);
+	  break;
+
+	case 'b':
+	  args->batch = 1;
+	  break;
+
+	case 'c':
+	  args->commands = optarg;
+	  break;
+
+	case 'r':
+	  args->runs = optarg;
+	  break;
+
+	case 'j':
+	  args->jobs = atoi(optarg);
+	  break;
+
+	case 'o':
+	  args->profile = optarg;
+	  break;
+
 	case 'W': /* W */
 	  args->warning_level = 2;
 	  break;
@@ -165,7 +276,7 @@ void get_options(int argc, char** argv, arguments* args)
 	}
     }
 
-  if (optind >= argc || (optind-argc)>2)
+  if ((optind >= argc && args->runs == NULL) || (optind-argc)>2)
     {
       zmachine_fatal("Usage: %s [OPTION...] story-file [save-file]\n",
 	     argv[0]);
@@ -191,6 +302,14 @@ void get_options(int argc, char** argv, arguments* args)
   args->warning_level = 0;
   args->graphical = 0;
   args->debug_mode = 0;
+  args->predecode = 0;
+  args->undo_levels = 0;
+  args->undo_limit = 0;
+  args->batch = 0;
+  args->commands = NULL;
+  args->runs = NULL;
+  args->jobs = 1;
+  args->profile = NULL;
   
   args->track_objs  = 0;
   args->track_attr  = 0;
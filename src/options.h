@@ -37,6 +37,16 @@ typedef struct arguments
   int   graphical;
 
   int   debug_mode;
+  int   predecode;
+  int   undo_levels;
+  int   undo_limit;
+
+  int   batch;
+  char* commands;
+  char* runs;
+  int   jobs;
+
+  char* profile;
 } arguments;
 
 extern void get_options(int argc, char** argv, arguments* args);
@@ -0,0 +1,391 @@
+/*
+ *  A Z-Machine
+ *  Copyright (C) 2000 Andrew Hunter
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Execution profiler
+ *
+ * Counts the instructions executed by each routine (and by the routines
+ * it calls), along with the number of times each routine is called and
+ * from where. Instructions are the unit of time here: they're what the
+ * game author can do something about, and counting them makes the
+ * profile the same from run to run.
+ */
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zmachine.h"
+#include "profile.h"
+#include "debug.h"
+#include "hash.h"
+
+#ifdef PROFILE
+
+typedef struct profile_routine profile_routine;
+typedef struct profile_arc     profile_arc;
+typedef struct profile_active  profile_active;
+
+/* A call from one routine to another */
+struct profile_arc
+{
+  profile_routine* callee;
+  unsigned long calls;
+  unsigned long inclusive;
+};
+
+struct profile_routine
+{
+  ZDWord address;
+
+  unsigned long calls;
+  unsigned long self;      /* Instructions executed by this routine */
+  unsigned long inclusive; /* ...and by the routines it called */
+  int           depth;     /* Number of calls currently on the stack */
+
+  hash callees;            /* profile_arcs, by callee address */
+};
+
+/* A routine call that has yet to return */
+struct profile_active
+{
+  profile_routine* routine;
+  int              frame_num;
+  unsigned long    start;     /* Instruction count when it was called */
+  unsigned long    children;  /* Instructions executed by its callees */
+};
+
+static ZSTATE hash             routines = NULL;
+static ZSTATE profile_active*  active   = NULL;
+static ZSTATE int              nactive  = 0;
+static ZSTATE int              active_size = 0;
+
+static profile_routine* find_routine(ZDWord address)
+{
+  profile_routine* r;
+
+  if (routines == NULL)
+    routines = hash_create();
+
+  r = hash_get(routines, (unsigned char*)&address, sizeof(ZDWord));
+  if (r == NULL)
+    {
+      r = malloc(sizeof(profile_routine));
+      r->address   = address;
+      r->calls     = 0;
+      r->self      = 0;
+      r->inclusive = 0;
+      r->depth     = 0;
+      r->callees   = NULL;
+
+      hash_store(routines, (unsigned char*)&address, sizeof(ZDWord), r);
+    }
+
+  return r;
+}
+
+static int free_arc(unsigned char* key, int keylen,
+		    void* data, void* arg)
+{
+  free(data);
+  return 0;
+}
+
+static int free_routine(unsigned char* key, int keylen,
+			void* data, void* arg)
+{
+  profile_routine* r = data;
+
+  if (r->callees != NULL)
+    {
+      hash_iterate(r->callees, free_arc, NULL);
+      hash_free(r->callees);
+    }
+  free(r);
+  return 0;
+}
+
+void profile_reset(void)
+{
+  if (routines != NULL)
+    {
+      hash_iterate(routines, free_routine, NULL);
+      hash_free(routines);
+    }
+
+  free(active);
+
+  routines    = NULL;
+  active      = NULL;
+  nactive     = 0;
+  active_size = 0;
+}
+
+void profile_call(ZDWord start, ZFrame* frame)
+{
+  profile_active* a;
+
+  if (nactive >= active_size)
+    {
+      active_size += 256;
+      active = realloc(active, sizeof(profile_active)*active_size);
+    }
+
+  a = active + (nactive++);
+  a->routine   = find_routine(start);
+  a->frame_num = frame->frame_num;
+  a->start     = machine.profile_instructions;
+  a->children  = 0;
+
+  a->routine->calls++;
+  a->routine->depth++;
+}
+
+void profile_return(ZFrame* frame)
+{
+  int frame_num;
+
+  frame_num = frame!=NULL?frame->frame_num:-1;
+
+  while (nactive > 0 && active[nactive-1].frame_num > frame_num)
+    {
+      profile_active* a;
+      unsigned long   inclusive;
+
+      a = active + (--nactive);
+      inclusive = machine.profile_instructions - a->start;
+
+      a->routine->self += inclusive - a->children;
+      a->routine->depth--;
+
+      /* Recursive calls are already counted by the outermost one */
+      if (a->routine->depth == 0)
+	a->routine->inclusive += inclusive;
+
+      if (nactive > 0)
+	{
+	  profile_routine* caller;
+	  profile_arc*     arc;
+
+	  caller = active[nactive-1].routine;
+	  active[nactive-1].children += inclusive;
+
+	  if (caller->callees == NULL)
+	    caller->callees = hash_create();
+
+	  arc = hash_get(caller->callees,
+			 (unsigned char*)&a->routine->address,
+			 sizeof(ZDWord));
+	  if (arc == NULL)
+	    {
+	      arc = malloc(sizeof(profile_arc));
+	      arc->callee    = a->routine;
+	      arc->calls     = 0;
+	      arc->inclusive = 0;
+
+	      hash_store(caller->callees,
+			 (unsigned char*)&a->routine->address,
+			 sizeof(ZDWord),
+			 arc);
+	    }
+
+	  arc->calls++;
+	  if (a->routine->depth == 0)
+	    arc->inclusive += inclusive;
+	}
+    }
+}
+
+/***                           ----// 888 \\----                           ***/
+
+/* Writing the profile */
+
+static ZSTATE profile_routine** sorted;
+static ZSTATE int               nsorted;
+
+static int collect_routine(unsigned char* key, int keylen,
+			   void* data, void* arg)
+{
+  sorted[nsorted++] = data;
+  return 0;
+}
+
+static int cmp_self(const void* a, const void* b)
+{
+  const profile_routine* ra = *(profile_routine* const*)a;
+  const profile_routine* rb = *(profile_routine* const*)b;
+
+  if (ra->self != rb->self)
+    return ra->self < rb->self ? 1 : -1;
+  return ra->address < rb->address ? -1 : ra->address > rb->address;
+}
+
+/* Name of a routine, from the debug symbols if we have them */
+static const char* routine_name(profile_routine* r)
+{
+  static ZSTATE char name[32];
+  debug_address addr;
+
+  addr = debug_find_address(r->address+1);
+  if (addr.routine != NULL && addr.routine->start == r->address)
+    return addr.routine->name;
+
+  sprintf(name, "routine_%05x", (unsigned)r->address);
+  return name;
+}
+
+/* Source file and line for a routine (NULL if not known) */
+static const char* routine_file(profile_routine* r, int* line)
+{
+  debug_address addr;
+
+  *line = 0;
+
+  addr = debug_find_address(r->address+1);
+  if (addr.routine == NULL || addr.routine->start != r->address)
+    return NULL;
+  if (addr.routine->defn_fl < 0 ||
+      addr.routine->defn_fl >= debug_syms.nfiles)
+    return NULL;
+
+  *line = addr.routine->defn_ln;
+  return debug_syms.files[addr.routine->defn_fl].name;
+}
+
+static int write_callee(unsigned char* key, int keylen,
+			void* data, void* arg)
+{
+  profile_arc* arc = data;
+  FILE*        f   = arg;
+  const char*  file;
+  int          line;
+
+  file = routine_file(arc->callee, &line);
+  if (file != NULL)
+    fprintf(f, "cfl=%s\n", file);
+  else
+    fprintf(f, "cfl=%s\n", machine.story_file);
+  fprintf(f, "cfn=%s\n", routine_name(arc->callee));
+  fprintf(f, "calls=%lu %i\n", arc->calls, line);
+  fprintf(f, "0 %lu\n", arc->inclusive);
+
+  return 0;
+}
+
+static void write_callgrind(const char* filename)
+{
+  FILE* f;
+  int x;
+
+  f = fopen(filename, "w");
+  if (f == NULL)
+    {
+      zmachine_warning("Unable to write profile '%s'", filename);
+      return;
+    }
+
+  fprintf(f, "# callgrind format\n");
+  fprintf(f, "version: 1\n");
+  fprintf(f, "creator: Zoom " VERSION "\n");
+  fprintf(f, "cmd: %s\n", machine.story_file);
+  fprintf(f, "positions: line\n");
+  fprintf(f, "events: Instructions\n");
+  fprintf(f, "summary: %lu\n\n", machine.profile_instructions);
+
+  for (x=0; x<nsorted; x++)
+    {
+      const char* file;
+      int line;
+
+      file = routine_file(sorted[x], &line);
+      fprintf(f, "fl=%s\n", file!=NULL?file:machine.story_file);
+      fprintf(f, "fn=%s\n", routine_name(sorted[x]));
+      fprintf(f, "%i %lu\n", line, sorted[x]->self);
+
+      if (sorted[x]->callees != NULL)
+	hash_iterate(sorted[x]->callees, write_callee, f);
+      fprintf(f, "\n");
+    }
+
+  fclose(f);
+}
+
+void profile_write(const char* filename)
+{
+  FILE* f;
+  char* cgname;
+  unsigned long total, counted;
+  int x;
+
+  /* Anything still running finishes now */
+  profile_return(NULL);
+
+  nsorted = 0;
+  sorted  = NULL;
+  if (routines != NULL)
+    {
+      sorted = malloc(sizeof(profile_routine*)*hash_capacity(routines));
+      hash_iterate(routines, collect_routine, NULL);
+    }
+  qsort(sorted, nsorted, sizeof(profile_routine*), cmp_self);
+
+  total   = machine.profile_instructions;
+  counted = 0;
+  for (x=0; x<nsorted; x++)
+    counted += sorted[x]->self;
+
+  /* The flat profile */
+  f = fopen(filename, "w");
+  if (f == NULL)
+    {
+      zmachine_warning("Unable to write profile '%s'", filename);
+    }
+  else
+    {
+      fprintf(f, "Profile of %s\n", machine.story_file);
+      fprintf(f, "%lu instructions executed, %lu outside any routine\n\n",
+	      total, total - counted);
+      fprintf(f, "  %%self         self    inclusive      calls  routine\n");
+
+      for (x=0; x<nsorted; x++)
+	{
+	  fprintf(f, "%7.2f %12lu %12lu %10lu  %s\n",
+		  total>0?100.0*sorted[x]->self/total:0.0,
+		  sorted[x]->self,
+		  sorted[x]->inclusive,
+		  sorted[x]->calls,
+		  routine_name(sorted[x]));
+	}
+
+      fclose(f);
+    }
+
+  /* The call graph */
+  cgname = malloc(strlen(filename)+11);
+  sprintf(cgname, "%s.callgrind", filename);
+  write_callgrind(cgname);
+  free(cgname);
+
+  free(sorted);
+  sorted = NULL;
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ *  A Z-Machine
+ *  Copyright (C) 2000 Andrew Hunter
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Execution profiler
+ */
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include "zmachine.h"
+
+#ifdef PROFILE
+
+/* Forgets everything counted so far (call before running a story) */
+extern void profile_reset (void);
+
+/* A routine at address start has been called, making frame the current one */
+extern void profile_call  (ZDWord start, ZFrame* frame);
+
+/* Frames above frame (which is now the current one) have returned */
+extern void profile_return(ZFrame* frame);
+
+/* Writes a flat profile to filename, and a callgrind one next to it */
+extern void profile_write (const char* filename);
+
+#endif
+
+#endif
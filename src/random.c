@@ -35,7 +35,7 @@
  * Note that lin_rand can return negative integers!
  */
 
-static ZDWord ls = 1;
+static ZSTATE ZDWord ls = 1;
 void lin_seed(ZDWord s)
 {
   ls = s;
@@ -48,9 +48,9 @@ ZDWord lin_rand(void)
   return ls;
 }
 
-static ZDWord seq[55];
-static int    n1 = 31;
-static int    n2 = 0;
+static ZSTATE ZDWord seq[55];
+static ZSTATE int    n1 = 31;
+static ZSTATE int    n2 = 0;
 
 /*
  * These functions implement a Mitchell-Moore additive random number
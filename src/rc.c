@@ -31,14 +31,15 @@
 #include "rc.h"
 #include "rcp.h"
 #include "hash.h"
+#include "image.h"
 
 extern FILE* yyin;
 extern int   rc_parse(void);
 extern int   _rc_line;
 
 hash            rc_hash    = NULL;
-static rc_game* game       = NULL;
-rc_game*        rc_defgame = NULL;
+static ZSTATE rc_game* game       = NULL;
+ZSTATE rc_game*        rc_defgame = NULL;
 
 #ifdef DATADIR
 # define ZOOMRC DATADIR "/zoomrc"
@@ -230,6 +231,20 @@ int rc_get_antialias(void)
   return game->antialias;
 }
 
+int rc_get_scrollback(void)
+{
+  if (game->scrollback == -1)
+    return rc_defgame->scrollback==-1?2048:rc_defgame->scrollback;
+  return game->scrollback;
+}
+
+int rc_get_resample(void)
+{
+  if (game->resample == -1)
+    return rc_defgame->resample==-1?IMAGE_FILTER_LANCZOS:rc_defgame->resample;
+  return game->resample;
+}
+
 int rc_get_interpreter(void)
 {
   if (game->interpreter == -1)
@@ -262,7 +277,17 @@ char* rc_get_savedir(void)
       if (rc_defgame->savedir == NULL)
 	{
 #if WINDOW_SYSTEM != 2
-	  static char* dir = NULL;
+	  static ZSTATE char* dir = NULL;
+	  static ZSTATE char* dir_story = NULL;
+
+	  /* The save directory follows the story file */
+	  if (machine.story_file != dir_story)
+	    {
+	      if (dir != NULL)
+		free(dir);
+	      dir = NULL;
+	      dir_story = machine.story_file;
+	    }
 
 	  if (dir == NULL && machine.story_file != NULL)
 	    {
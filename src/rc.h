@@ -25,6 +25,7 @@
 #define __RC_H
 
 #include "hash.h"
+#include "zmachine.h"
 
 typedef struct
 {
@@ -61,6 +62,8 @@ typedef struct
   int fg_col, bg_col;
 
   int antialias;
+  int scrollback;
+  int resample;   /* IMAGE_FILTER_*, or -1 */
 } rc_game;
 
 extern void       rc_load           (void);
@@ -72,6 +75,8 @@ extern char*      rc_get_name       (void);
 extern char*      rc_get_game_name  (char* serial, int revision);
 extern int        rc_get_interpreter(void);
 extern int        rc_get_antialias  (void);
+extern int        rc_get_scrollback (void);
+extern int        rc_get_resample   (void);
 extern int        rc_get_revision   (void);
 extern char*      rc_get_gamedir    (void);
 extern char*      rc_get_savedir    (void);
@@ -83,7 +88,7 @@ extern int        rc_get_foreground (void);
 extern int        rc_get_background (void);
 
 extern hash       rc_hash;
-extern rc_game*   rc_defgame;
+extern ZSTATE rc_game*   rc_defgame;
 extern int        rc_merging;
 
 #endif
@@ -8,6 +8,7 @@
 #include "rc.h"
 #include "rcp.h"
 #include "hash.h"
+#include "image.h"
 
 #define YYERROR_VERBOSE 1
 
@@ -19,7 +20,7 @@ extern int  rc_lex(void);
 
 int rc_merging = 0;
 
-#define EMPTY_GAME(x) x.fg_col = -1; x.bg_col = -1; x.interpreter = -1; x.revision = -1; x.name = NULL; x.fonts = NULL; x.n_fonts = -1; x.colours = NULL; x.n_colours = -1; x.gamedir = x.savedir = x.sounds = x.graphics = NULL; x.xsize = x.ysize = -1; x.antialias = -1;
+#define EMPTY_GAME(x) x.fg_col = -1; x.bg_col = -1; x.interpreter = -1; x.revision = -1; x.name = NULL; x.fonts = NULL; x.n_fonts = -1; x.colours = NULL; x.n_colours = -1; x.gamedir = x.savedir = x.sounds = x.graphics = NULL; x.xsize = x.ysize = -1; x.antialias = -1; x.scrollback = -1; x.resample = -1;
 
 static inline rc_game merge_games(const rc_game* a, const rc_game* b)
 {
@@ -44,6 +45,16 @@ static inline rc_game merge_games(const rc_game* a, const rc_game* b)
   else
     r.antialias = a->antialias;
 
+  if (a->scrollback == -1)
+    r.scrollback = b->scrollback;
+  else
+    r.scrollback = a->scrollback;
+
+  if (a->resample == -1)
+    r.resample = b->resample;
+  else
+    r.resample = a->resample;
+
   if (a->revision == -1)
     r.revision = b->revision;
   else
@@ -153,6 +164,11 @@ static inline rc_game merge_games(const rc_game* a, const rc_game* b)
 %token GRAPHICS
 %token SIZE
 %token ANTIALIAS
+%token SCROLLBACK
+%token RESAMPLE
+%token BOX
+%token BILINEAR
+%token LANCZOS
 %token YES
 %token NO
 
@@ -172,6 +188,7 @@ static inline rc_game merge_games(const rc_game* a, const rc_game* b)
 %type <game>  RCOptionList
 %type <game>  RCBlock
 %type <num>   YesOrNo
+%type <num>   Filter
 
 %{
 static int check_collision(char* ourid, char* name)
@@ -321,6 +338,11 @@ YesOrNo:	  YES { $$ = 1; }
 		| NO  { $$ = 0; }
 		;
 
+Filter:		  BOX      { $$ = IMAGE_FILTER_BOX; }
+		| BILINEAR { $$ = IMAGE_FILTER_BILINEAR; }
+		| LANCZOS  { $$ = IMAGE_FILTER_LANCZOS; }
+		;
+
 RCOption:	  INTERPRETER NUMBER
 		    {
 		      EMPTY_GAME($$);
@@ -331,6 +353,16 @@ RCOption:	  INTERPRETER NUMBER
 		      EMPTY_GAME($$);
 		      $$.antialias = $2;
 		    }
+		| SCROLLBACK NUMBER
+		    {
+		      EMPTY_GAME($$);
+		      $$.scrollback = $2;
+		    }
+		| RESAMPLE Filter
+		    {
+		      EMPTY_GAME($$);
+		      $$.resample = $2;
+		    }
 		| REVISION CHARACTER
 		    {
 		      EMPTY_GAME($$);
@@ -30,6 +30,8 @@
 #include "zmachine.h"
 #include "state.h"
 #include "file.h"
+#include "interp.h"
+#include "profile.h"
 #include "../config.h"
 
 /* #define DEBUG */
@@ -64,9 +66,10 @@ static struct
   { "ANNO", ANNO }
 };
 
-static ZByte* stacks = NULL;
-static char*  detail = NULL;
-static ZWord* stackpos = NULL;
+static ZSTATE ZByte* stacks = NULL;   /* Formatted stack frames (kept between calls) */
+static ZSTATE int    stacks_size = 0;
+static ZSTATE char*  detail = NULL;
+static ZSTATE ZWord* stackpos = NULL;
 
 static inline void push(ZStack* stack, const ZWord word)
 {
@@ -115,7 +118,14 @@ static int format_stacks(ZStack* stack, ZFrame* frame)
 
   pos = size;
   size += 8+frame->nlocals*2+frame->frame_size*2;
-  stacks = realloc(stacks, sizeof(ZByte)*((size>>8)+1)*256);
+  if (size > stacks_size)
+    {
+      while (stacks_size < size)
+	stacks_size = stacks_size>0?stacks_size*2:1024;
+      stacks = realloc(stacks, sizeof(ZByte)*stacks_size);
+      if (stacks == NULL)
+	zmachine_fatal("Out of memory while saving");
+    }
 
   stacks[pos]   = frame->ret>>16;
   stacks[pos+1] = frame->ret>>8;
@@ -149,81 +159,157 @@ static int format_stacks(ZStack* stack, ZFrame* frame)
   return size;
 }
 
-static inline void xor_memory(void)
+static void load_stacks(ZStack* stack, ZByte* frame, ZDWord len)
 {
-  ZDWord x,y, len;
-  ZByte* page;
-
-  for (x=0; x<machine.dynamic_ceiling; x+=1024)
+  /* Clean out all the old frames */
+  while (stack->current_frame != NULL)
     {
-      len = 1024;
-      if (x+1024>=machine.dynamic_ceiling)
-	len = machine.dynamic_ceiling-x;
-      
-      page = read_block(machine.file, 
-			x+machine.story_offset, 
-			x+len+machine.story_offset);
-      if (page == NULL)
-	zmachine_fatal("ARgh");
+      ZFrame* oldframe;
 
-      for(y=0; y<len; y++)
-	{
-	  machine.memory[y+x] ^= page[y];
-	}
+      oldframe = stack->current_frame;
+      stack->current_frame = oldframe->last_frame;
+
+      stack->stack_size += oldframe->frame_size;
+      stack->stack_top  -= oldframe->frame_size;
       
-      free(page);
+      zmachine_free_frame(oldframe);
     }
+
+#ifdef PROFILE
+  /* Calls in progress are charged up to here (the restored ones aren't) */
+  if (machine.profile_file != NULL)
+    profile_return(NULL);
+#endif
+
+  /* Load in the new frames */
+  {
+    ZDWord pos;
+
+    pos = 0;
+    
+    while (pos < len)
+      {
+	ZDWord  pc;
+	ZByte   flags;
+	ZByte   store;
+	ZByte   args;
+	ZUWord  frame_size;
+	ZFrame* newframe;
+	int x;
+
+	pc         = (frame[pos]<<16)|(frame[pos+1]<<8)|frame[pos+2];
+	flags      = frame[pos+3];
+	store      = frame[pos+4];
+	args       = frame[pos+5];
+	frame_size = (frame[pos+6]<<8)|frame[pos+7];
+
+	newframe = zmachine_alloc_frame();
+
+	newframe->ret          = pc;
+	newframe->flags        = args;
+	newframe->storevar     = store;
+	newframe->discard      = (flags&0x10)!=0;
+	newframe->nlocals      = flags&0x0f;
+	newframe->frame_size   = 0;
+	newframe->break_on_return = 0;
+	newframe->end_func     = 0;
+	if (stack->current_frame != NULL)
+	  newframe->frame_num  = stack->current_frame->frame_num+1;
+	else
+	  newframe->frame_num  = 0;
+	newframe->last_frame   = stack->current_frame;
+
+	stack->current_frame   = newframe;
+
+	pos += 8;
+	for (x=0; x<newframe->nlocals; x++)
+	  {
+	    newframe->local[x+1] = (frame[pos]<<8)|frame[pos+1];
+	    pos+=2;
+	  }
+	for (x=0; x<frame_size; x++)
+	  {
+	    push(stack, (frame[pos]<<8)|frame[pos+1]);
+	    pos += 2;
+	  }
+      }
+  }
 }
 
+/*
+ * Savefiles are built up in a work buffer that is kept between calls,
+ * so that it only needs to be reallocated when a save turns out to be
+ * larger than any previous one.
+ */
 struct save_state {
   int flen;
+  int size;
   ZByte* data;
 };
 
+static ZSTATE struct save_state work = { 0, 0, NULL };
+
+static void reserve(int len, struct save_state* state)
+{
+  int size;
+
+  if (state->flen+len <= state->size)
+    return;
+
+  size = state->size;
+  if (size < 1024)
+    size = 1024;
+  while (size < state->flen+len)
+    size *= 2;
+
+  state->data = realloc(state->data, size);
+  if (state->data == NULL)
+    zmachine_fatal("Out of memory while saving");
+  state->size = size;
+}
+
 static inline void wblock(ZByte* x, int len, struct save_state* state)
 {
+  reserve(len, state);
+  memcpy(state->data + state->flen, x, len);
   state->flen += len;
-  state->data = realloc(state->data, state->flen+16);
-  memcpy(state->data + state->flen - len, x, len);
 }
 
 static inline void wdword(ZDWord w, struct save_state* state)
 {
-  state->flen +=4;
-  state->data = realloc(state->data, state->flen+16);
-  state->data[state->flen-4] = w>>24;
-  state->data[state->flen-3] = w>>16;
-  state->data[state->flen-2] = w>>8;
-  state->data[state->flen-1] = w;
+  reserve(4, state);
+  state->data[state->flen++] = w>>24;
+  state->data[state->flen++] = w>>16;
+  state->data[state->flen++] = w>>8;
+  state->data[state->flen++] = w;
 }
 
 static inline void wword(ZUWord w, struct save_state* state)
 {
-  state->flen += 2;
-  state->data = realloc(state->data, state->flen+16);
-  state->data[state->flen-2] = w>>8;
-  state->data[state->flen-1] = w;
+  reserve(2, state);
+  state->data[state->flen++] = w>>8;
+  state->data[state->flen++] = w;
 }
 
 static inline void wbyte(ZUWord w, struct save_state* state)
 {
-  state->flen += 1;
-  state->data = realloc(state->data, state->flen+16);
-  state->data[state->flen-1] = w;
+  reserve(1, state);
+  state->data[state->flen++] = w;
 }
 
-ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
+/* Builds a savefile in the work buffer, returning its length (or -1) */
+static int compile(ZStack* stack, ZDWord pc, int compress)
 {
-  struct save_state state;
+  struct save_state* state;
   int size;
+  int memsize;
   char anno[256];
   time_t now;
   ZByte version;
   
-  state.data = NULL;
-  state.flen = 0;
+  state = &work;
+  state->flen = 0;
   
-  *len = -1;
   version = ReadByte(0);
 
   pc--; /*
@@ -236,29 +322,48 @@ ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
     {
       /* Shouldn't be able to run 'em, either */
       zmachine_warning("Can't save files for versions <3");
-      return NULL;
+      return -1;
     }
 #endif
+
+  /* Work out how big the file can get, so the buffer need only grow once */
+  stackpos = stack->stack;
+  size = format_stacks(stack, stack->current_frame);
+
+  if (compress)
+    {
+      /*
+       * Worst case is alternating zero and non-zero bytes, where every
+       * two bytes of memory turn into three
+       */
+      memsize = machine.dynamic_ceiling + machine.dynamic_ceiling/2 + 2;
+    }
+  else
+    {
+      memsize = machine.dynamic_ceiling;
+    }
+
+  reserve(8+14 + 8+memsize+1 + 8+size+1 + 8+sizeof(anno), state);
   
   /* header */
-  wblock(blocks[IFhd].text, 4, &state);
-  wdword(13, &state);
-  wword(Word(ZH_release), &state);
-  wblock(Address(ZH_serial), 6, &state);
-  wword(Word(ZH_checksum), &state);
+  wblock(blocks[IFhd].text, 4, state);
+  wdword(13, state);
+  wword(Word(ZH_release), state);
+  wblock(Address(ZH_serial), 6, state);
+  wword(Word(ZH_checksum), state);
 #ifdef DEBUG
   printf_debug("Save: release %i, checksum %i\n", Word(ZH_release), Word(ZH_checksum));
 #endif
-  wbyte(pc>>16, &state);
-  wbyte(pc>>8, &state);
-  wbyte(pc, &state);
+  wbyte(pc>>16, state);
+  wbyte(pc>>8, state);
+  wbyte(pc, state);
 
-  wbyte(0, &state);
+  wbyte(0, state);
 
   /* Dynamic memory */
   if (compress)
     {
-      ZByte* comp = NULL;
+      ZByte* comp;
       int clen = 0;
       int x, run;
       ZByte running;
@@ -266,8 +371,11 @@ ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
 #ifdef DEBUG
       printf_debug("Compile: compressing memory from 0 to %x\n", machine.dynamic_ceiling);
 #endif
-      
-      xor_memory();
+
+      /* Compress straight into the (already reserved) savefile buffer */
+      wblock(blocks[CMem].text, 4, state);
+      wdword(0, state);
+      comp = state->data + state->flen;
 
       run = 0;
       for (x=0; x<machine.dynamic_ceiling; x++)
@@ -277,7 +385,7 @@ ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
 	   * that there was *three* bytes after a 0 (a length and a
 	   * type). 
 	   */
-	  running = machine.memory[x];
+	  running = machine.memory[x]^machine.original_memory[x];
 
 	  if (running == 0)
 	    run++;
@@ -287,7 +395,6 @@ ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
 		{
 		  while (run > 256)
 		    {
-		      comp = realloc(comp, clen+2);
 		      comp[clen++] = 0;
 		      comp[clen++] = 0xff;
 		      run -= 256;
@@ -298,7 +405,6 @@ ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
 #endif
 		  if (run > 0)
 		    {
-		      comp = realloc(comp, clen+2);
 		      comp[clen++] = 0;
 		      comp[clen++] = run-1;
 		    }
@@ -306,48 +412,40 @@ ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
 		  run = 0;
 		}
 	      
-	      comp = realloc(comp, clen+1);
 	      comp[clen++] = running;
 	    }
 	}
 
-      wblock(blocks[CMem].text, 4, &state);
-      wdword(clen, &state);
-      wblock(comp, clen, &state);
+      state->data[state->flen-4] = clen>>24;
+      state->data[state->flen-3] = clen>>16;
+      state->data[state->flen-2] = clen>>8;
+      state->data[state->flen-1] = clen;
+      state->flen += clen;
 
       if (clen&1)
-	wbyte(0, &state);
-
-      free(comp);
-      
-      xor_memory();
+	wbyte(0, state);
     }
   else
     {
 #ifdef DEBUG
       printf_debug("Compile: storing memory from 0 to %x\n", machine.dynamic_ceiling);
 #endif
-      wblock(blocks[UMem].text, 4, &state);
-      wdword(machine.dynamic_ceiling, &state);
-      wblock(Address(0), machine.dynamic_ceiling, &state);
+      wblock(blocks[UMem].text, 4, state);
+      wdword(machine.dynamic_ceiling, state);
+      wblock(Address(0), machine.dynamic_ceiling, state);
 
       if (machine.dynamic_ceiling&1)
-	wbyte(0, &state);
+	wbyte(0, state);
     }
 
   /* Stack frames */
-  stackpos = stack->stack;
-  size = format_stacks(stack, stack->current_frame);
-  wblock(blocks[Stks].text, 4, &state);
-  wdword(size, &state);
-  wblock(stacks, size, &state);
-
-  free(stacks);
-  stacks = NULL;
+  wblock(blocks[Stks].text, 4, state);
+  wdword(size, state);
+  wblock(stacks, size, state);
 
   /* Annotations */
   now = time(NULL);
-  wblock(blocks[ANNO].text, 4, &state);
+  wblock(blocks[ANNO].text, 4, state);
   if (version <= 3)
     {
       char score[64];
@@ -370,47 +468,62 @@ ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
       sprintf(anno, "Version %i game, saved from Zoom version "
 	      VERSION " @%s", version, ctime(&now));
     }
-  wdword(strlen(anno), &state);
-  wblock(anno, strlen(anno), &state);
+  wdword(strlen(anno), state);
+  wblock(anno, strlen(anno), state);
   if (strlen(anno)&1)
-    wbyte(0, &state);
+    wbyte(0, state);
   
-  *len = state.flen;
-  return state.data;
+  return state->flen;
+}
+
+ZByte* state_compile(ZStack* stack, ZDWord pc, ZDWord* len, int compress)
+{
+  ZByte* result;
+  int    flen;
+
+  *len = -1;
+
+  flen = compile(stack, pc, compress);
+  if (flen < 0)
+    return NULL;
+
+  /* Hand back a copy of exactly the right size */
+  result = malloc(flen);
+  if (result == NULL)
+    return NULL;
+  memcpy(result, work.data, flen);
+
+  *len = flen;
+  return result;
 }
   
 int state_save(ZFile* f, ZStack* stack, ZDWord pc)
 {
   ZDWord flen;
-  ZByte* data;
 
   detail = NULL;
 
   if (!f)
     return 0;
 
-  data = state_compile(stack, pc, &flen, 1);
+  flen = compile(stack, pc, 1);
 
-  if (data == NULL)
+  if (flen < 0)
     return 0;
   
   /* Output the file itself */
   write_block(f, (unsigned char*)"FORM", 4);
   write_dword(f, flen+4);
   write_block(f, (unsigned char*)"IFZS", 4);
-  write_block(f, data, flen); 
+  write_block(f, work.data, flen); 
   close_file(f);
-
-  free(data);
-  data = NULL;
-  flen = 0;
   
   return 1;
 }
 
 int state_decompile(ZByte* st, ZStack* stack, ZDWord* pc, ZDWord len)
 {
-  static struct
+  static ZSTATE struct
   {
     unsigned char text[4];
     ZByte* pos;
@@ -545,8 +658,10 @@ int state_decompile(ZByte* st, ZStack* stack, ZDWord* pc, ZDWord len)
       /* CMem is all yuck :-( */
       ZDWord x, adr;
       ZByte* cmem;
+      ZByte* orig;
 
       cmem = blocks[CMem].pos;
+      orig = machine.original_memory;
       adr = 0;
       
       for (x=0; x<blocks[CMem].len; x++)
@@ -559,96 +674,35 @@ int state_decompile(ZByte* st, ZStack* stack, ZDWord* pc, ZDWord len)
 		zmachine_fatal("Corrupt CMem block");
 
 	      len = cmem[++x]+1;
-	      for (y=0; y<len; y++)
-		machine.memory[adr++] = 0;
+	      if (adr+len > machine.dynamic_ceiling)
+		break;
+	      for (y=0; y<len; y++, adr++)
+		machine.memory[adr] = orig[adr];
 	    }
 	  else
-	    machine.memory[adr++] = cmem[x];
+	    {
+	      if (adr >= machine.dynamic_ceiling)
+		break;
+	      machine.memory[adr] = cmem[x]^orig[adr];
+	      adr++;
+	    }
 	}
 
-      if (adr > machine.dynamic_ceiling)
+      if (x < blocks[CMem].len)
 	{
-	  zmachine_fatal("Compressed memory is larger than dynamic memory (by %i bytes)", adr - machine.dynamic_ceiling);
+	  zmachine_fatal("Compressed memory is larger than dynamic memory");
 	}
-      while (adr < machine.dynamic_ceiling)
+      if (adr < machine.dynamic_ceiling)
 	{
-	  machine.memory[adr++] = 0;
+	  memcpy(machine.memory + adr, orig + adr, 
+		 machine.dynamic_ceiling - adr);
 	}
-
-      xor_memory();
     }
 
-  /* Clean out all the old frames */
-  while (stack->current_frame != NULL)
-    {
-      ZFrame* oldframe;
-
-      oldframe = stack->current_frame;
-      stack->current_frame = oldframe->last_frame;
-
-      stack->stack_size += oldframe->frame_size;
-      stack->stack_top  -= oldframe->frame_size;
-      
-      free(oldframe);
-    }
-
-  /* Load in the new frames */
-  {
-    ZByte* frame;
-    ZDWord pos;
-
-    frame = blocks[Stks].pos;
-    pos = 0;
-    
-    while (pos < blocks[Stks].len)
-      {
-	ZDWord  pc;
-	ZByte   flags;
-	ZByte   store;
-	ZByte   args;
-	ZUWord  frame_size;
-	ZFrame* newframe;
-	int x;
-
-	pc         = (frame[pos]<<16)|(frame[pos+1]<<8)|frame[pos+2];
-	flags      = frame[pos+3];
-	store      = frame[pos+4];
-	args       = frame[pos+5];
-	frame_size = (frame[pos+6]<<8)|frame[pos+7];
-
-	newframe = malloc(sizeof(ZFrame));
-
-	newframe->ret          = pc;
-	newframe->flags        = args;
-	newframe->storevar     = store;
-	newframe->discard      = (flags&0x10)!=0;
-	newframe->nlocals      = flags&0x0f;
-	newframe->frame_size   = 0;
-	newframe->v4read       = NULL;
-	newframe->v5read       = NULL;
-	newframe->break_on_return = 0;
-	newframe->end_func     = 0;
-	if (stack->current_frame != NULL)
-	  newframe->frame_num  = stack->current_frame->frame_num+1;
-	else
-	  newframe->frame_num  = 0;
-	newframe->last_frame   = stack->current_frame;
-
-	stack->current_frame   = newframe;
+  /* Replace the stack */
+  load_stacks(stack, blocks[Stks].pos, blocks[Stks].len);
 
-	pos += 8;
-	for (x=0; x<newframe->nlocals; x++)
-	  {
-	    newframe->local[x+1] = (frame[pos]<<8)|frame[pos+1];
-	    pos+=2;
-	  }
-	for (x=0; x<frame_size; x++)
-	  {
-	    push(stack, (frame[pos]<<8)|frame[pos+1]);
-	    pos += 2;
-	  }
-      }
-  }
+  zmachine_flush_properties();
 
   /* Finally, restore PC */
   *pc = (blocks[IFhd].pos[10]<<16)|
@@ -719,6 +773,230 @@ int state_load(ZFile* f, ZDWord fsize,  ZStack* stack, ZDWord* pc)
   return state_decompile(file + 12, stack, pc, formsize-4);
 }
 
+/*
+ * Undo
+ *
+ * Rather than storing a complete copy of the game state for each undo
+ * level, we keep a copy of dynamic memory as it was at the most
+ * recent undo point, and each undo point records only the pages that
+ * differ between it and the point before it (along with the stack and
+ * PC, which are small). Restoring an undo point copies the saved image
+ * back and then rolls the saved image back by one level.
+ */
+
+#define UNDO_PAGE 256
+
+typedef struct ZUndo
+{
+  ZDWord  pc;
+
+  ZByte*  stacks;      /* Stack frames, in Quetzal Stks format */
+  ZDWord  stack_len;
+
+  int     n_pages;
+  ZUWord* page_num;    /* Pages that differ from the previous point */
+  ZByte*  pages;       /* Contents of those pages at the previous point */
+
+  ZDWord  size;        /* Total memory used by this point */
+
+  struct ZUndo* older;
+} ZUndo;
+
+static void undo_free(ZUndo* undo)
+{
+  free(undo->stacks);
+  free(undo->page_num);
+  free(undo->pages);
+  free(undo);
+}
+
+/* Forget the changes stored in the oldest undo point */
+static void undo_drop_oldest(void)
+{
+  ZUndo** last;
+  ZUndo*  oldest;
+
+  last = &machine.undo;
+  while ((*last)->older != NULL)
+    last = &(*last)->older;
+
+  oldest = *last;
+  *last  = NULL;
+
+  machine.undo_count--;
+  machine.undo_size -= oldest->size;
+  undo_free(oldest);
+
+  /* The pages of the new oldest point restore a state we no longer keep */
+  oldest = machine.undo;
+  if (oldest == NULL)
+    return;
+  while (oldest->older != NULL)
+    oldest = oldest->older;
+
+  machine.undo_size -= oldest->n_pages*(UNDO_PAGE+sizeof(ZUWord));
+  oldest->size      -= oldest->n_pages*(UNDO_PAGE+sizeof(ZUWord));
+  oldest->n_pages    = 0;
+  free(oldest->page_num); oldest->page_num = NULL;
+  free(oldest->pages);    oldest->pages    = NULL;
+}
+
+void state_clear_undo(void)
+{
+  while (machine.undo != NULL)
+    {
+      ZUndo* older;
+
+      older = machine.undo->older;
+      undo_free(machine.undo);
+      machine.undo = older;
+    }
+
+  free(machine.undo_memory);
+  machine.undo_memory = NULL;
+  machine.undo_count  = 0;
+  machine.undo_size   = 0;
+}
+
+int state_save_undo(ZStack* stack, ZDWord pc)
+{
+  ZUndo* undo;
+  int    levels;
+  ZDWord limit;
+  ZDWord x;
+
+  levels = machine.undo_levels;
+  if (levels <= 0)
+    levels = UNDO_LEVEL;
+  limit = machine.undo_limit;
+  if (limit <= 0)
+    limit = UNDO_MEMORY;
+  limit *= 1024;
+
+  undo = malloc(sizeof(ZUndo));
+  if (undo == NULL)
+    return 0;
+
+  undo->pc       = pc;
+  undo->n_pages  = 0;
+  undo->page_num = NULL;
+  undo->pages    = NULL;
+
+  /* Stack frames */
+  stackpos = stack->stack;
+  undo->stack_len = format_stacks(stack, stack->current_frame);
+  undo->stacks    = malloc(undo->stack_len);
+  if (undo->stacks == NULL)
+    {
+      free(undo);
+      return 0;
+    }
+  memcpy(undo->stacks, stacks, undo->stack_len);
+
+  /* Pages of dynamic memory that have changed since the last point */
+  if (machine.undo_memory == NULL || machine.undo == NULL)
+    {
+      free(machine.undo_memory);
+      machine.undo_memory = malloc(machine.dynamic_ceiling);
+      if (machine.undo_memory == NULL)
+	{
+	  undo_free(undo);
+	  return 0;
+	}
+      memcpy(machine.undo_memory, machine.memory, machine.dynamic_ceiling);
+    }
+  else
+    {
+      int max_pages;
+
+      max_pages = 0;
+
+      for (x=0; x<machine.dynamic_ceiling; x+=UNDO_PAGE)
+	{
+	  ZDWord len;
+
+	  len = UNDO_PAGE;
+	  if (x+UNDO_PAGE > machine.dynamic_ceiling)
+	    len = machine.dynamic_ceiling-x;
+
+	  if (memcmp(machine.undo_memory + x, machine.memory + x, len) == 0)
+	    continue;
+
+	  if (undo->n_pages >= max_pages)
+	    {
+	      max_pages += 16;
+	      undo->page_num = realloc(undo->page_num,
+				       sizeof(ZUWord)*max_pages);
+	      undo->pages    = realloc(undo->pages, UNDO_PAGE*max_pages);
+	    }
+
+	  undo->page_num[undo->n_pages] = x/UNDO_PAGE;
+	  memcpy(undo->pages + UNDO_PAGE*undo->n_pages,
+		 machine.undo_memory + x, len);
+	  memcpy(machine.undo_memory + x, machine.memory + x, len);
+	  undo->n_pages++;
+	}
+    }
+
+  undo->size = sizeof(ZUndo) + undo->stack_len +
+    undo->n_pages*(UNDO_PAGE+sizeof(ZUWord));
+
+  undo->older  = machine.undo;
+  machine.undo = undo;
+  machine.undo_count++;
+  machine.undo_size += undo->size;
+
+  /* Discard old points that take us over the limits */
+  while (machine.undo_count > levels ||
+	 (machine.undo_size > limit && machine.undo_count > 1))
+    {
+      undo_drop_oldest();
+    }
+
+  return 1;
+}
+
+int state_restore_undo(ZStack* stack, ZDWord* pc)
+{
+  ZUndo* undo;
+  int    x;
+
+  detail = NULL;
+
+  undo = machine.undo;
+  if (undo == NULL || machine.undo_memory == NULL)
+    {
+      detail = "No undo information available";
+      return 0;
+    }
+
+  /* Restore memory and stack from this point */
+  memcpy(machine.memory, machine.undo_memory, machine.dynamic_ceiling);
+  load_stacks(stack, undo->stacks, undo->stack_len);
+  *pc = undo->pc;
+  zmachine_flush_properties();
+
+  /* Roll the saved memory image back to the previous point */
+  for (x=0; x<undo->n_pages; x++)
+    {
+      ZDWord adr, len;
+
+      adr = undo->page_num[x]*UNDO_PAGE;
+      len = UNDO_PAGE;
+      if (adr+UNDO_PAGE > machine.dynamic_ceiling)
+	len = machine.dynamic_ceiling-adr;
+
+      memcpy(machine.undo_memory + adr, undo->pages + UNDO_PAGE*x, len);
+    }
+
+  machine.undo = undo->older;
+  machine.undo_count--;
+  machine.undo_size -= undo->size;
+  undo_free(undo);
+
+  return 1;
+}
+
 char* state_fail(void)
 {
   return detail;
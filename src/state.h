@@ -39,4 +39,8 @@ extern int    state_save     (ZFile* file, ZStack* stack, ZDWord  pc);
 extern int    state_load     (ZFile* file, ZDWord fsize, ZStack* stack, ZDWord* pc);
 extern char*  state_fail     (void);
 
+extern int    state_save_undo   (ZStack* stack, ZDWord pc);
+extern int    state_restore_undo(ZStack* stack, ZDWord* pc);
+extern void   state_clear_undo  (void);
+
 #endif
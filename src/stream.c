@@ -32,34 +32,37 @@
 #include "display.h"
 #include "zscii.h"
 #include "v6display.h"
+#include "interp.h"
 
-static int  buffering = 1;
-static int  buflen    = 0;
-static int  bufpos    = 0;
-static int* buffer = NULL;
+static ZSTATE int  buffering = 1;
+static ZSTATE int  buflen    = 0;
+static ZSTATE int  bufpos    = 0;
+static ZSTATE int* buffer = NULL;
 
-extern int* zscii_unicode;
+extern ZSTATE int* zscii_unicode;
 extern int  zscii_unicode_table[];
 
 static void prints_reformat_width(int len)
 {
   int* text;
+  int* line;
   int split;
   ZByte* mem;
   int x;
 
   mem = Address(machine.memory_pos[machine.memory_on-1]);
 
+  /* Splitting doesn't change the characters, so convert them just once */
+  text = malloc(sizeof(int)*(len+1));
+  for (x=0; x<len; x++)
+    text[x] = zscii_unicode[mem[x+2]];
+  line = text;
+
   do 
     {
-      text = malloc(sizeof(int)*len);
-      for (x=0; x<len; x++)
-	text[x] = zscii_unicode[mem[x+2]];
-      
-      split = v6_split_point(text, len, 
+      split = v6_split_point(line, len, 
 			     machine.memory_width[machine.memory_on-1],
 			     NULL);
-      free(text);
       
       if (split != len)
 	{
@@ -73,6 +76,7 @@ static void prints_reformat_width(int len)
 	  
 	  machine.memory_pos[machine.memory_on-1] += split+2;
 	  mem += split+2;
+	  line += split;
 	  len -= split;
 	  
 	  mem[0] = len>>8;
@@ -84,6 +88,8 @@ static void prints_reformat_width(int len)
 	}
     }
   while (split != len);
+
+  free(text);
 }
 
 static void prints(const unsigned int* const s)
@@ -92,8 +98,10 @@ static void prints(const unsigned int* const s)
     {
       ZByte* mem;
       ZUWord len;
+      ZUWord start;
       int x;
 
+      start = machine.memory_pos[machine.memory_on-1];
       len = Word(machine.memory_pos[machine.memory_on-1]);
       mem = Address(machine.memory_pos[machine.memory_on-1]);
       
@@ -156,6 +164,10 @@ static void prints(const unsigned int* const s)
 	  prints_reformat_width(len);
 	}
 
+      /* Let the property index and string cache know what we've written over */
+      zmachine_memory_write(start, machine.memory_pos[machine.memory_on-1] + 
+			    Word(machine.memory_pos[machine.memory_on-1]) + 2 - start);
+
       if (machine.version == 6)
 	{
 	  int* text;
@@ -337,7 +349,7 @@ int stream_readline(int* buf, int len, long int timeout)
 
 void stream_flush_buffer(void)
 {
-  static int flushing =  0;
+  static ZSTATE int flushing =  0;
 
   if (flushing)
     {
@@ -410,7 +422,7 @@ void stream_remove_buffer(const int* s)
 
 void stream_update_unicode_table(void)
 {
-  static int*  unitable = NULL;
+  static ZSTATE int*  unitable = NULL;
   int          x;
   ZByte*       ztable;
   
@@ -29,6 +29,7 @@
 #include "tokenise.h"
 #include "hash.h"
 #include "zscii.h"
+#include "interp.h"
 
 struct dict_entry
 {
@@ -100,6 +101,8 @@ ZDictionary* dictionary_cache(const ZUWord dict_pos)
     if (entry_length < text_len)
       zmachine_fatal("Bad dictionary: entry length is less than %i", text_len);
 
+    hash_reserve(dict->words, no_entries);
+
     for (x=0; x<no_entries; x++)
       {
 	struct dict_entry* entry;
@@ -365,5 +368,8 @@ void tokenise_string(unsigned int* string,
     }
 
   tokbuf[1] = wordno;
+
+  /* Let the string and property caches know about the new parse buffer */
+  zmachine_memory_write(tokbuf - machine.memory, tokpos);
 }
 
@@ -38,11 +38,11 @@
 
 typedef struct v6window v6window;
 
-static int active_win = 0;
+static ZSTATE int active_win = 0;
 
-static int erf_n, erf_d;
+static ZSTATE int erf_n, erf_d;
 
-static int mouse_win;
+static ZSTATE int mouse_win;
 
 struct v6window
 {
@@ -68,9 +68,9 @@ struct v6window
   int want_more;
 };
 
-static v6window win[8];
+static ZSTATE v6window win[8];
 
-static int (*nl_func)(const int * remaining,
+static ZSTATE int (*nl_func)(const int * remaining,
 		      int rem_len) = NULL;
 
 #define ACTWIN win[active_win]
@@ -249,6 +249,191 @@ static void scroll_to_height(int height, int change_baseline)
     }
 }
 
+/*
+ * Text measurement
+ *
+ * Finding where to break a line used to mean measuring the text from
+ * the start of the line at every space, which is quadratic in the line
+ * length. Instead, we keep a table of glyph advances for each style and
+ * add those up as we go, only asking the display for the width of the
+ * text near the break point we've guessed. Summed advances don't allow
+ * for kerning, so the guess is checked against the real width and moved
+ * if necessary: the result is always the same as measuring everything.
+ */
+
+#define N_ADVANCES 8
+
+typedef struct advance_table
+{
+  int   style;
+  float font_width, font_height; /* To notice the font changing */
+  float advance[256];            /* -1 if not measured yet */
+} advance_table;
+
+static ZSTATE advance_table advances[N_ADVANCES];
+static ZSTATE int           n_advances   = 0;
+static ZSTATE int           next_advance = 0;
+
+static advance_table* get_advances(int style)
+{
+  advance_table* tab;
+  float fw, fh;
+  int x;
+
+  fw = display_get_font_width(style);
+  fh = display_get_font_height(style);
+
+  tab = NULL;
+  for (x=0; x<n_advances; x++)
+    {
+      if (advances[x].style == style)
+	{
+	  tab = advances + x;
+	  break;
+	}
+    }
+
+  if (tab == NULL)
+    {
+      if (n_advances < N_ADVANCES)
+	tab = advances + (n_advances++);
+      else
+	{
+	  tab = advances + next_advance;
+	  next_advance = (next_advance+1)%N_ADVANCES;
+	}
+      tab->style = style;
+      tab->font_width = -1;
+    }
+
+  if (tab->font_width != fw || tab->font_height != fh)
+    {
+      tab->font_width  = fw;
+      tab->font_height = fh;
+      for (x=0; x<256; x++)
+	tab->advance[x] = -1;
+    }
+
+  return tab;
+}
+
+static inline float glyph_advance(advance_table* tab, int c)
+{
+  if (c < 0 || c >= 256)
+    return display_measure_text(&c, 1, tab->style);
+
+  if (tab->advance[c] < 0)
+    tab->advance[c] = display_measure_text(&c, 1, tab->style);
+  return tab->advance[c];
+}
+
+static inline int is_break(const int* text, int pos, int every_char)
+{
+  return every_char || text[pos] == ' ' || text[pos] == '-';
+}
+
+/* The last break point before pos, or -1 */
+static int prev_break(const int* text, int pos, int every_char)
+{
+  for (pos--; pos >= 0; pos--)
+    {
+      if (is_break(text, pos, every_char))
+	return pos;
+    }
+  return -1;
+}
+
+/*
+ * Finds the first break point in text[0..len) where base plus the width
+ * of the text before it (including the break character if incl is set)
+ * goes over limit (or reaches it, if strict is clear). Returns -1 if
+ * there's no such point; *last is set to the last break point looked at
+ * (the one returned, or the last in the text), and *width to the width
+ * at that point if it was measured (-1 otherwise).
+ */
+static int first_overflow(const int* text, int len, int style,
+			  int every_char, int incl,
+			  float base, float limit, int strict,
+			  int* last, float* width)
+{
+  advance_table* tab;
+  float guess, real;
+  int pos, lastbreak;
+
+#define OVER(w) (strict?(base+(w) > limit):(base+(w) >= limit))
+#define MEASURE(p) display_measure_text(text, (p)+incl, style)
+
+  tab = get_advances(style);
+
+  guess = real = 0;
+  lastbreak = -1;
+  *width = -1;
+
+  for (pos=0; pos<len; pos++)
+    {
+      if (is_break(text, pos, every_char))
+	{
+	  lastbreak = pos;
+
+	  if (OVER(guess + (incl?glyph_advance(tab, text[pos]):0)))
+	    {
+	      real = MEASURE(pos);
+	      if (OVER(real))
+		break;
+
+	      /* Guessed too early: carry on from the real width */
+	      guess = real - (incl?glyph_advance(tab, text[pos]):0);
+	    }
+	}
+
+      guess += glyph_advance(tab, text[pos]);
+    }
+
+  if (pos >= len)
+    {
+      /* Guessed too late? */
+      if (lastbreak < 0)
+	{
+	  *last = -1;
+	  return -1;
+	}
+
+      real = MEASURE(lastbreak);
+      if (!OVER(real))
+	{
+	  *last  = lastbreak;
+	  *width = real;
+	  return -1;
+	}
+      pos = lastbreak;
+    }
+
+  /* pos overflows: move back until the one before it doesn't */
+  for (;;)
+    {
+      int prev;
+      float prev_real;
+
+      prev = prev_break(text, pos, every_char);
+      if (prev < 0)
+	break;
+
+      prev_real = MEASURE(prev);
+      if (!OVER(prev_real))
+	break;
+
+      pos  = prev;
+      real = prev_real;
+    }
+
+#undef OVER
+#undef MEASURE
+
+  *last  = pos;
+  *width = real;
+  return pos;
+}
+
 void v6_prints(const int* text)
 {
   int height;
@@ -284,22 +469,38 @@ void v6_prints(const int* text)
       width = 0;
       last_word = this_word = text_pos;
 
-      while (ACTWIN.curx + width <= ACTWIN.xpos + ACTWIN.width - ACTWIN.rmargin &&
-	     text[text_pos] != 10 && text[text_pos] != 0)
+      if (ACTWIN.curx <= ACTWIN.xpos + ACTWIN.width - ACTWIN.rmargin)
 	{
-	  if (text[text_pos] == ' ' || 
-	      text[text_pos] == '-' ||
-	      ACTWIN.wrapping == 0)
+	  int line_len, brk, last;
+	  float brk_width;
+
+	  for (line_len = 0;
+	       text[start_pos+line_len] != 10 && text[start_pos+line_len] != 0;
+	       line_len++);
+
+	  /* Find the first break point that goes past the margin */
+	  brk = first_overflow(text + start_pos, line_len, ACTWIN.style,
+			       ACTWIN.wrapping == 0, 1,
+			       ACTWIN.curx,
+			       ACTWIN.xpos + ACTWIN.width - ACTWIN.rmargin, 1,
+			       &last, &brk_width);
+
+	  if (brk >= 0)
+	    {
+	      text_pos = start_pos + brk + 1;
+	      width    = brk_width;
+	    }
+	  else
 	    {
-	      /* Possible break point */
-	      width  = display_measure_text(text + start_pos,
-					    text_pos - start_pos + 1,
-					    ACTWIN.style);
+	      text_pos = start_pos + line_len;
+	    }
 
-	      last_word = this_word;
-	      this_word = text_pos+1;
+	  if (last >= 0)
+	    {
+	      this_word = start_pos + last + 1;
+	      last = prev_break(text + start_pos, last, ACTWIN.wrapping == 0);
+	      last_word = start_pos + last + 1;
 	    }
-	  text_pos++;
 	}
 
       if (text[text_pos] == 0 || text[text_pos] == 10)
@@ -694,27 +895,21 @@ int v6_split_point(int* text,
 		   int  width,
 		   int* width_out)
 {
-  float cwidth;
+  float cwidth, brk_width;
   int text_pos;
-  int this_word, last_word;
+  int brk, last, last_word;
 
-  this_word = last_word = text_pos = 0;
-  cwidth = 0;
+  text_pos = last_word = 0;
 
-  while (cwidth < width &&
-	 text_pos < text_len)
+  if (width > 0)
     {
-      if (text[text_pos] == ' ' ||
-	  text[text_pos] == '-')
-	{
-	  cwidth = display_measure_text(text,
-					text_pos,
-					ACTWIN.style);
-	  
-	  last_word = this_word;
-	  this_word = text_pos + 1;
-	}
-      text_pos++;
+      brk = first_overflow(text, text_len, ACTWIN.style, 0, 0,
+			   0, width, 0,
+			   &last, &brk_width);
+      text_pos = brk >= 0 ? brk + 1 : text_len;
+
+      if (last >= 0)
+	last_word = prev_break(text, last, 0) + 1;
     }
 
   cwidth = display_measure_text(text,
@@ -94,6 +94,15 @@ Picture            x_pixpic = None;
 XdbeBackBuffer x_backbuffer = None;
 #endif
 
+/* Without double buffering, we draw here and copy the changes across */
+static Pixmap x_backpixmap = None;
+
+/*
+ * The area that needs redrawing. This is redrawn when we next wait for
+ * an event; once it's made up of more than MAX_DAMAGE updates, it's
+ * simplified down to a single rectangle.
+ */
+#define MAX_DAMAGE 32
 static Region dregion = None;
 static int    updatecount = 0;
 static int    resetregion = 0;
@@ -430,7 +439,7 @@ static void reset_clip(void)
 #endif
 
       resetregion = 0;
-      XFree(rgn);
+      XDestroyRegion(rgn);
     }
 }
 
@@ -1083,52 +1092,11 @@ static void draw_window()
 	      if (xft_drawable != NULL)
 		XftDrawSetClip(xft_drawable, newregion);
 #endif
-	      XFree(r);
+	      XDestroyRegion(r);
 	      
 	      line = text_win[win].line;
 	      lasty = BORDER_SIZE;
 	      
-	      /* Free any lines that scrolled off ages ago */
-	      if (line != NULL)
-		{
-		  while (line->baseline < -32768)
-		    {
-		      struct line* n;
-		      
-		      n = line->next;
-		      if (n == NULL)
-			break;
-		      
-		      if (text_win[win].topline == line)
-			text_win[win].topline = NULL;
-		      
-		      if (n->start != line->start)
-			{
-			  struct text* nt;
-			  
-			  if (line->start != text_win[win].text)
-			    zmachine_fatal("Programmer is a spoon");
-			  text_win[win].text = n->start;
-			  
-			  text = line->start;
-			  while (text != n->start)
-			    {
-			      if (text == NULL)
-				zmachine_fatal("Programmer is a spoon");
-			      nt = text->next;
-			      free(text);
-			      text = nt;
-			    }
-			}
-		      
-		      
-		      free(line);
-		      text_win[win].line = n;
-		      
-		      line = n;
-		    }
-		}
-	      
 	      /* Skip to the first visible line */
 	      if (line != NULL)
 		{
@@ -1299,6 +1267,16 @@ static void draw_window()
       XdbeSwapBuffers(x_display, &i, 1);
     }
 #endif
+  if (x_backpixmap != None)
+    {
+      XRectangle box;
+
+      XSetRegion(x_display, x_wingc, dregion);
+      XClipBox(dregion, &box);
+      XCopyArea(x_display, x_backpixmap, x_mainwin, x_wingc,
+		box.x, box.y, box.width, box.height,
+		box.x, box.y);
+    }
 
   /* Caret */
   caret_shown = 0;
@@ -1363,8 +1341,8 @@ static void draw_window()
   }
 
   /* Free regions */
-  XFree(newregion);
-  XFree(dregion);
+  XDestroyRegion(newregion);
+  XDestroyRegion(dregion);
   dregion = None;
 
   updatecount = 0;
@@ -1470,6 +1448,7 @@ static void resize_window()
 	}
 
       CURWIN.line = CURWIN.lastline = NULL;
+      CURWIN.n_lines = 0;
 
       if (CURWIN.text != NULL)
 	{
@@ -2037,6 +2016,41 @@ static int process_events(long int to, int* buf, int buflen)
 		  
 		  win_left   = BORDER_SIZE;
 		  win_top    = BORDER_SIZE;
+
+		  if (x_backpixmap != None)
+		    {
+		      /* The back buffer must match the window size */
+		      XFreePixmap(x_display, x_backpixmap);
+		      x_backpixmap = XCreatePixmap(x_display, x_mainwin,
+						   total_x, total_y,
+						   DefaultDepth(x_display,
+								x_screen));
+		      x_drawable = x_backpixmap;
+
+#ifdef HAVE_XFT
+		      if (xft_drawable != NULL && x_pixmap == None)
+			XftDrawChange(xft_drawable, x_drawable);
+#endif
+#ifdef HAVE_XRENDER
+		      if (x_winpic != None)
+			{
+			  XRenderFreePicture(x_display, x_winpic);
+			  x_winpic = XRenderCreatePicture(x_display, x_drawable, x_picformat, 0, NULL);
+			}
+#endif
+
+		      /* Nothing in it yet, so redraw everything */
+		      {
+			XRectangle r;
+
+			r.x = 0; r.y = 0;
+			r.width = total_x; r.height = total_y;
+
+			if (dregion == None)
+			  dregion = XCreateRegion();
+			XUnionRectWithRegion(&r, dregion, dregion);
+		      }
+		    }
 		  
 		  /* Reformat window here */
 		  scroll_overlays = 0;
@@ -2360,20 +2374,16 @@ void display_update_region(XFONT_MEASURE left,
     dregion = XCreateRegion();
 
   updatecount++;
-  if (updatecount == 20)
+  if (updatecount > MAX_DAMAGE)
     {
-      XFree(dregion);
+      /* Just redraw everything in the bounding box */
+      XClipBox(dregion, &clip);
+      XDestroyRegion(dregion);
       dregion = XCreateRegion();
-
-      clip.x = 0;
-      clip.y = 0;
-      clip.width = total_x;
-      clip.height = total_y;
       XUnionRectWithRegion(&clip, dregion, dregion);
-      return;
+
+      updatecount = 1;
     }
-  else if (updatecount > 20)
-    return;
 
   clip.x = left + BORDER_SIZE; clip.y = top + BORDER_SIZE;
   clip.width = right - left; clip.height = bottom - top;
@@ -2586,6 +2596,15 @@ void display_initialise(void)
     }
 #endif
 
+  /* If not, use a pixmap */
+  if (x_drawable == x_mainwin)
+    {
+      x_backpixmap = XCreatePixmap(x_display, x_mainwin,
+				   total_x, total_y,
+				   DefaultDepth(x_display, x_screen));
+      x_drawable = x_backpixmap;
+    }
+
 #ifdef HAVE_XRENDER
   if (XRenderQueryExtension(x_display, &x, &y))
     {
@@ -3143,7 +3162,8 @@ float display_get_font_descent(int style)
 
 void display_plot_image(BlorbImage* img, int x, int y)
 {
-  int sc_n, sc_d;
+  x_render* render;
+  int sc_n, sc_d, filter;
 
   if (img == NULL)
     return;
@@ -3157,20 +3177,36 @@ void display_plot_image(BlorbImage* img, int x, int y)
       return;
     }
 
+  /* Scaled copies are kept in the picture cache, so changing scale doesn't mean decoding again */
+  filter = rc_get_resample();
+  render = blorb_findrender(img, sc_n, sc_d, filter);
+
 #ifdef HAVE_XRENDER
   if (x_pixpic != None)
     {
-      image_plot_Xrender(img->loaded, x_display, x_pixpic,
-			 x, y, sc_n, sc_d);
+      if (render == NULL)
+	{
+	  render = image_render_Xrender(img->loaded, x_display,
+					sc_n, sc_d, filter);
+	  blorb_storerender(img, sc_n, sc_d, filter,
+			    render, render->size, image_render_free);
+	}
+      image_plot_Xrender(render, x_display, x_pixpic, x, y);
     }
   else
 #endif
     {
-      image_plot_X(img->loaded, x_display, x_pixmap, x_pixgc,
-		 x, y, sc_n, sc_d);
+      if (render == NULL)
+	{
+	  render = image_render_X(img->loaded, x_display,
+				  sc_n, sc_d, filter);
+	  blorb_storerender(img, sc_n, sc_d, filter,
+			    render, render->size, image_render_free);
+	}
+      image_plot_X(render, x_display, x_pixmap, x_pixgc, x, y);
     }
 
-  pixmap_update(x, y, x+image_width(img->loaded), y+image_height(img->loaded));
+  pixmap_update(x, y, x+render->image->width, y+render->image->height);
 }
 
 void display_wait_for_more(void)
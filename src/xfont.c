@@ -35,6 +35,7 @@
 #include "font3.h"
 #include "format.h"
 #include "rc.h"
+#include "hash.h"
 
 #ifdef HAVE_XFT
 # include <X11/Xft/Xft.h>
@@ -45,10 +46,28 @@
 # include <t1libx.h>
 #endif
 
+/*
+ * Widths of recently measured strings. Layout measures every word it
+ * formats, and reformatting the window after a resize measures them all
+ * again, so we remember these per font rather than asking the font
+ * library (which, for Xft and t1lib, is slow) each time.
+ */
+#define WIDTH_CACHE_SIZE 512 /* Power of 2 */
+#define WIDTH_CACHE_LEN  20  /* Longest string that's remembered */
+
+typedef struct cached_width
+{
+  int           len; /* 0 if this entry is unused */
+  int           text[WIDTH_CACHE_LEN];
+  XFONT_MEASURE width;
+} cached_width;
+
 /* Definition of an xfont */
 
 struct xfont
 {
+  cached_width* widths;
+
   enum
   {
     XFONT_X,
@@ -148,6 +167,7 @@ xfont* xfont_load_font(char* font)
   xfont* f;
 
   f = malloc(sizeof(xfont));
+  f->widths = NULL;
 
   if (strcmp(font, "font3") == 0)
     {
@@ -281,6 +301,7 @@ void xfont_release_font(xfont* f)
       break;
     }
 
+  free(f->widths);
   free(f);
 }
 
@@ -402,7 +423,7 @@ XFONT_MEASURE xfont_get_descent(xfont* f)
   return -1;
 }
 
-XFONT_MEASURE xfont_get_text_width(xfont* f, const int* text, int len)
+static XFONT_MEASURE measure_text(xfont* f, const int* text, int len)
 {
   static XChar2b* xtxt = NULL;
   int x;
@@ -475,6 +496,33 @@ XFONT_MEASURE xfont_get_text_width(xfont* f, const int* text, int len)
   return -1;
 }
 
+XFONT_MEASURE xfont_get_text_width(xfont* f, const int* text, int len)
+{
+  cached_width* entry;
+
+  if (len <= 0)
+    return 0;
+
+  if (len > WIDTH_CACHE_LEN || f->type == XFONT_FONT3)
+    return measure_text(f, text, len);
+
+  if (f->widths == NULL)
+    f->widths = calloc(WIDTH_CACHE_SIZE, sizeof(cached_width));
+
+  entry = f->widths + (hash_hash((unsigned char*)text, len*sizeof(int))&
+		       (WIDTH_CACHE_SIZE-1));
+
+  if (entry->len != len ||
+      memcmp(entry->text, text, len*sizeof(int)) != 0)
+    {
+      entry->len   = len;
+      entry->width = measure_text(f, text, len);
+      memcpy(entry->text, text, len*sizeof(int));
+    }
+
+  return entry->width;
+}
+
 void xfont_plot_string(xfont* f,
 		       Drawable draw,
 		       GC gc,
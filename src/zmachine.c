@@ -36,6 +36,7 @@
 #include "stream.h"
 #include "blorb.h"
 #include "v6display.h"
+#include "interp.h"
 
 #if WINDOW_SYSTEM == 2
 # include <windows.h>
@@ -45,11 +46,107 @@
 # include "carbondisplay.h"
 #endif
 
+#ifdef HAVE_THREADS
+# include <pthread.h>
+#endif
+
+#include "state.h"
+
+/*
+ * Pristine dynamic memory images. Every machine needs its own copy of
+ * the story to run, but the original dynamic memory (which is only ever
+ * read, for restarting and for compressed saves) is shared between all
+ * the machines in the process that are running the same story.
+ */
+typedef struct ZImage
+{
+  ZByte*         data;
+  ZDWord         length;
+  int            refs;
+  struct ZImage* next;
+} ZImage;
+
+static ZImage* images = NULL;
+
+#ifdef HAVE_THREADS
+static pthread_mutex_t image_lock = PTHREAD_MUTEX_INITIALIZER;
+# define LockImages()   pthread_mutex_lock(&image_lock)
+# define UnlockImages() pthread_mutex_unlock(&image_lock)
+#else
+# define LockImages()
+# define UnlockImages()
+#endif
+
+static ZByte* image_share(ZByte* memory, ZDWord length)
+{
+  ZImage* image;
+
+  LockImages();
+  for (image = images; image != NULL; image = image->next)
+    {
+      if (image->length == length &&
+	  memcmp(image->data, memory, length) == 0)
+	break;
+    }
+
+  if (image == NULL)
+    {
+      image = malloc(sizeof(ZImage));
+      if (image != NULL)
+	image->data = malloc(length);
+      if (image == NULL || image->data == NULL)
+	{
+	  UnlockImages();
+	  zmachine_fatal("Unable to allocate memory for the story file");
+	}
+
+      memcpy(image->data, memory, length);
+      image->length = length;
+      image->refs   = 0;
+      image->next   = images;
+      images = image;
+    }
+
+  image->refs++;
+  UnlockImages();
+
+  return image->data;
+}
+
+static void image_release(ZByte* data)
+{
+  ZImage** image;
+
+  LockImages();
+  for (image = &images; *image != NULL; image = &(*image)->next)
+    {
+      if ((*image)->data == data)
+	{
+	  ZImage* gone = *image;
+
+	  if (--gone->refs == 0)
+	    {
+	      *image = gone->next;
+	      free(gone->data);
+	      free(gone);
+	    }
+	  break;
+	}
+    }
+  UnlockImages();
+}
+
 void zmachine_load_file(ZFile* file, ZMachine* machine) {
     ZFrame* frame;
 
     // machine->story_length must be set already
     machine->story_offset = 0;
+
+#ifdef PREDECODE
+    /* Any instructions decoded for a previous story are now invalid */
+    zmachine_predecode_flush();
+#endif
+    zmachine_flush_properties();
     machine->file = file;
 
     if (machine->file == NULL) {
@@ -74,14 +171,22 @@ void zmachine_load_file(ZFile* file, ZMachine* machine) {
             zmachine_fatal("This blorb file does not contain an executable Z-Code section");
         }
 
+    }
+
+    /*
+     * Map the story where we can. The mapping is copy-on-write, so the
+     * pages a story (or the debugger, setting breakpoints) writes to get
+     * a private copy, and the rest are shared through the page cache
+     */
+    machine->memory = map_block(machine->file,
+                                machine->story_offset,
+                                machine->story_offset+machine->story_length);
+    machine->memory_mapped = machine->memory != NULL;
+
+    if (machine->memory == NULL)
         machine->memory = read_block(machine->file,
                                      machine->story_offset,
                                      machine->story_offset+machine->story_length);
-    }
-    else
-    {
-        machine->memory = read_block(machine->file, 0, machine->story_length);
-    }
     if (machine->memory == NULL)
         zmachine_fatal("Unable to read story file");
     /* close_file(machine->file); */
@@ -101,7 +206,7 @@ void zmachine_load_file(ZFile* file, ZMachine* machine) {
     /*
      * Topmost frame is a 'fake' frame to make quetzal work properly
      */
-    frame = machine->stack.current_frame = malloc(sizeof(ZFrame));
+    frame = machine->stack.current_frame = zmachine_alloc_frame();
 
     frame->ret          = 0;
     frame->flags        = 0;
@@ -111,8 +216,7 @@ void zmachine_load_file(ZFile* file, ZMachine* machine) {
     frame->last_frame   = NULL;
     frame->frame_num    = 0;
     frame->nlocals      = 0;
-    frame->v4read       = NULL;
-    frame->v5read       = NULL;
+    frame->end_func     = 0;
 	frame->break_on_return = 0;
 
     machine->header = machine->memory;
@@ -120,12 +224,17 @@ void zmachine_load_file(ZFile* file, ZMachine* machine) {
     if (machine->header[0] > 8)
         zmachine_fatal("Not a ZCode file");
 
-    if (machine->memory[0] >= 5)
-        zscii_install_alphabet();
+    zscii_install_alphabet();
 
     machine->dynamic_ceiling     = (ZUWord)GetWord(machine->header, ZH_static);
     machine->buffering           = 1;
 
+    /* Keep the original dynamic memory for restarting and compressed saves */
+    if (machine->original_memory != NULL)
+        image_release(machine->original_memory);
+    machine->original_memory     = image_share(machine->memory,
+                                               machine->dynamic_ceiling);
+
     machine->globals             = machine->memory +
         GetWord(machine->header, ZH_globals);
     /*machine->objects             = machine->memory +
@@ -156,8 +265,6 @@ void zmachine_load_file(ZFile* file, ZMachine* machine) {
                 machine->heb    = NULL;
                 machine->heblen = 0;
             }
-            else
-                stream_update_unicode_table();
         }
         else
         {
@@ -166,6 +273,7 @@ void zmachine_load_file(ZFile* file, ZMachine* machine) {
             machine->heblen = 0;
         }
     }
+    stream_update_unicode_table();
 
     /* Parse the abbreviations table */
     if (GetWord(machine->header, ZH_abbrevs) != 0)
@@ -258,7 +366,82 @@ void zmachine_load_story(char* filename, ZMachine* machine)
   zmachine_load_file(machine->file, machine);
 }
 
-#if WINDOW_SYSTEM==1 || WINDOW_SYSTEM==2 || WINDOW_SYSTEM==3
+static int free_dictionary(unsigned char* key, int keylen,
+			   void* data, void* arg)
+{
+  ZDictionary* dict = data;
+
+  hash_free(dict->words);
+  free(dict);
+
+  return 0;
+}
+
+/*
+ * Releases everything that loading and running the current story
+ * allocated, leaving the machine ready for another story
+ */
+void zmachine_unload_story(void)
+{
+  ZFrame* frame;
+  int x;
+
+  state_clear_undo();
+#ifdef PREDECODE
+  zmachine_predecode_flush();
+#endif
+  zmachine_flush_properties();
+
+  frame = machine.stack.current_frame;
+  while (frame != NULL)
+    {
+      ZFrame* last = frame->last_frame;
+
+      zmachine_free_frame(frame);
+      frame = last;
+    }
+  if (machine.stack.stack != NULL)
+    free(machine.stack.stack);
+
+  for (x=0; x<96; x++)
+    {
+      if (machine.abbrev[x] != NULL)
+	free(machine.abbrev[x]);
+    }
+
+  if (machine.cached_dictionaries != NULL)
+    {
+      hash_iterate(machine.cached_dictionaries, free_dictionary, NULL);
+      hash_free(machine.cached_dictionaries);
+    }
+
+  if (machine.transcript_file != NULL)
+    close_file(machine.transcript_file);
+  if (machine.script_file != NULL)
+    close_file(machine.script_file);
+
+  if (machine.blorb != NULL)
+    blorb_closefile(machine.blorb);
+  if (machine.blorb_file != NULL && machine.blorb_file != machine.file)
+    close_file(machine.blorb_file);
+  if (machine.file != NULL)
+    close_file(machine.file);
+
+  if (machine.original_memory != NULL)
+    image_release(machine.original_memory);
+  if (machine.memory != NULL)
+    {
+      if (machine.memory_mapped)
+	unmap_block(machine.memory, machine.story_offset,
+		    machine.story_offset+machine.story_length);
+      else
+	free(machine.memory);
+    }
+
+  memset(&machine, 0, sizeof(ZMachine));
+}
+
+#if WINDOW_SYSTEM==1 || WINDOW_SYSTEM==2 || WINDOW_SYSTEM==3 || WINDOW_SYSTEM==5
 void zmachine_fatal(char* format, ...)
 {
   va_list  ap;
@@ -269,7 +452,7 @@ void zmachine_fatal(char* format, ...)
   string[255] = 0;
   va_end(ap);
 
-#if WINDOW_SYSTEM != 3
+#if WINDOW_SYSTEM != 3 && WINDOW_SYSTEM != 5
   if (machine.display_active)
     {
       machine.display_active = 0;
@@ -807,7 +990,7 @@ void zmachine_mark_statusbar(void)
 
 char* zmachine_get_serial(void)
 {
-  static char serial[7];
+  static ZSTATE char serial[7];
   ZByte* addr;
   int x;
 
@@ -856,6 +1039,62 @@ void zmachine_dump_stack(ZStack* stack) {
   display_printf("== Dump finished\n");
 }
 
+/*
+ * Stack frames are allocated in blocks and recycled through a free
+ * list, as routine calls are far too frequent to go through malloc
+ * each time.
+ */
+#define FRAME_BLOCK 128
+
+static ZSTATE ZFrame* free_frames = NULL;
+
+ZFrame* zmachine_alloc_frame(void) {
+  ZFrame* frame;
+
+  if (free_frames == NULL) {
+    ZFrame* block;
+    int x;
+
+    block = malloc(sizeof(ZFrame)*FRAME_BLOCK);
+    if (block == NULL)
+      zmachine_fatal("Out of memory for stack frames");
+
+    for (x=0; x<FRAME_BLOCK; x++) {
+      block[x].last_frame = free_frames;
+      free_frames = block + x;
+    }
+  }
+
+  frame = free_frames;
+  free_frames = frame->last_frame;
+
+  frame->read = NULL;
+  return frame;
+}
+
+void zmachine_free_frame(ZFrame* frame) {
+  if (frame->read != NULL) {
+    free(frame->read);
+    frame->read = NULL;
+  }
+
+  frame->last_frame = free_frames;
+  free_frames = frame;
+}
+
+ZReadCallback* zmachine_read_callback(ZFrame* frame) {
+  if (frame->read == NULL) {
+    frame->read = malloc(sizeof(ZReadCallback));
+    if (frame->read == NULL)
+      zmachine_fatal("Out of memory for stack frames");
+  }
+
+  frame->read->v4read    = NULL;
+  frame->read->v5read    = NULL;
+  frame->read->readstore = 0;
+  return frame->read;
+}
+
 #ifdef DEBUG
 ZWord debug_print_var(ZWord val, int var)
 {
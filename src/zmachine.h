@@ -50,7 +50,22 @@
  *
  * CAN_UNDO means that the undo commands are supported
  *
- * SQUEEZEUNDO will cause the undo buffer to be compressed (which is slow)
+ * UNDO_LEVEL and UNDO_MEMORY are the default maximum number of undo
+ * levels and the default maximum amount of memory (in kilobytes) that
+ * undo information may use. Only the parts of memory that change
+ * between turns are stored, so these can be quite generous.
+ *
+ * PREDECODE adds support for caching decoded instructions from static
+ * and high memory (enabled at runtime with the 'predecode' option). This
+ * makes the interpreter faster at the expense of some memory.
+ *
+ * CACHE_STRINGS is the number of decoded strings to keep, so that text
+ * that is printed often (object names, room descriptions) only has to
+ * be decoded once. Undefine it to decode every string every time.
+ *
+ * PROFILE adds support for writing a profile of the routines that a
+ * game runs (enabled at runtime with the 'profile' option). Without it,
+ * the interpreter doesn't do any of the bookkeeping.
  *
  * SPEC_10 will cause the interpreter to indicate that it is
  * conformant to the v1.0 specification.
@@ -68,8 +83,10 @@
 #undef  PAGED_MEMORY /* Not implemented, anyway ;-) */
 #define GLOBAL_PC    /* Set to make the program counter global */
 #define CAN_UNDO     /* Support the undo commands */
-#define UNDO_LEVEL 5 /* Number of levels of undo that we support */
-#undef  SQUEEZEUNDO  /* Store undo information in a compressed format (slow) */
+#define UNDO_LEVEL 200   /* Default number of levels of undo that we support */
+#define UNDO_MEMORY 4096 /* Default memory limit for undo information (kB) */
+#define PREDECODE    /* Support caching pre-decoded instructions */
+#define CACHE_STRINGS 512 /* Number of decoded strings to cache */
 #undef  TRACKING     /* Enable object tracking options */
 #define SPEC_10      /*
 		      * Unset if you don`t believe me when I say this
@@ -91,6 +108,10 @@
 #undef REMOTE_BREAKPOINT /* Send SIGUSR1 to force a breakpoint at the next execution point */
 #endif
 
+#ifndef PROFILE
+#undef  PROFILE      /* Support writing execution profiles */
+#endif
+
 /*
  * Versions to support (note that support for version 5 includes
  * support for versions 7 and 8 as well
@@ -100,6 +121,18 @@
 #define SUPPORT_VERSION_5
 #define SUPPORT_VERSION_6
 
+/*
+ * A batch build with thread support (HAVE_THREADS) can run several
+ * stories at once, one per thread. ZSTATE marks the interpreter state
+ * (the machine itself, and the file-level state that goes with it)
+ * that each thread gets its own copy of.
+ */
+#ifdef HAVE_THREADS
+# define ZSTATE __thread
+#else
+# define ZSTATE
+#endif
+
 /* File format */
 
 enum ZHeader_bytes
@@ -165,6 +198,15 @@ typedef struct ZArgblock
   ZWord arg[8];
 } ZArgblock;
 
+/* A read that should be resumed when a timed routine returns */
+typedef struct ZReadCallback
+{
+  void (*v4read)(ZDWord*, struct ZStack*, ZArgblock*);
+  void (*v5read)(ZDWord*, struct ZStack*, ZArgblock*, int);
+  ZArgblock readblock;
+  int       readstore;
+} ZReadCallback;
+
 typedef struct ZFrame
 {
   /* Return address */
@@ -176,21 +218,56 @@ typedef struct ZFrame
   ZByte  discard;    /* Nonzero if result should be discarded */
   
   ZWord  frame_size; /* Evaluation size */
+  ZUWord frame_num;
+
+  ZByte  break_on_return; /* Used by the debugger */
+  ZByte  end_func;
 
   ZWord  local[16];
-  ZUWord frame_num;
-  
-  int break_on_return; /* Used by the debugger */
 
-  void (*v4read)(ZDWord*, struct ZStack*, ZArgblock*);
-  void (*v5read)(ZDWord*, struct ZStack*, ZArgblock*, int);
-  int  end_func;
-  ZArgblock readblock;
-  int       readstore;
+  ZReadCallback* read; /* Non-NULL if a read continues on return */
   
   struct ZFrame* last_frame;
 } ZFrame;
 
+/*
+ * The properties of an object, indexed by property number. Addresses
+ * are those of the property data (0 if the object doesn't have that
+ * property).
+ */
+typedef struct ZPropIndex
+{
+  ZUWord addr[64];
+  ZByte  len [64];
+  ZByte  next[64];   /* Number of the following property in the table */
+  ZByte  first;      /* Number of the first property in the table */
+} ZPropIndex;
+
+/*
+ * A pre-decoded instruction. Operands that refer to variables are stored 
+ * as variable numbers, as their values can only be known when the
+ * instruction is executed.
+ */
+typedef struct ZDecoded
+{
+  ZDWord next;       /* Address of the following instruction */
+  ZDWord branch;     /* Branch offset */
+
+  ZWord  arg[8];     /* Operand values (or variable numbers) */
+
+  ZByte  instr;      /* Opcode byte */
+  ZByte  ext_instr;  /* Extended opcode (when instr is 0xbe) */
+  ZByte  n_args;     /* Number of operands */
+  ZByte  varargs;    /* Bitmask of operands that are variables */
+  ZByte  st;         /* Variable to store the result in */
+  ZByte  negate;     /* Nonzero if the branch condition is inverted */
+} ZDecoded;
+
+typedef struct ZDecodedPage
+{
+  ZDecoded* instr[256];
+} ZDecodedPage;
+
 typedef struct ZStack
 {
   ZDWord  stack_total;
@@ -210,12 +287,17 @@ typedef struct ZMachine
 
   ZByte*   header;
   ZByte*   dynamic_memory;
+  ZByte*   original_memory; /* Dynamic memory as it is in the story file (shared) */
 
   ZFile*   file;
   char*    story_file;
 
-  ZByte* undo    [UNDO_LEVEL];
-  ZDWord undo_len[UNDO_LEVEL];
+  struct ZUndo* undo;        /* Most recent undo point */
+  ZByte*        undo_memory; /* Dynamic memory at the most recent undo point */
+  int           undo_count;
+  ZDWord        undo_size;   /* Memory used by undo points (bytes) */
+  int           undo_levels; /* Maximum undo points (0 for UNDO_LEVEL) */
+  ZDWord        undo_limit;  /* Memory limit in kB (0 for UNDO_MEMORY) */
 
   ZByte  version;
 
@@ -223,6 +305,7 @@ typedef struct ZMachine
   ZMap     memory; /* Still not implemented */
 #else
   ZByte*   memory;
+  int      memory_mapped; /* memory is mapped from the story file */
 #endif
 
   ZByte*   globals;
@@ -246,6 +329,19 @@ typedef struct ZMachine
   ZDWord routine_offset;
   ZDWord string_offset;
 
+  ZPropIndex**   prop_index;         /* Property index for each object */
+  int            n_prop_index;
+  ZByte*         prop_headers;       /* Bitmap of bytes the indexes depend on */
+
+#ifdef PREDECODE
+  int            predecode;          /* Nonzero to use pre-decoded instructions */
+  ZDecodedPage** predecoded;         /* Page table covering the story file */
+  int            n_predecoded;
+  ZDecoded**     predecode_blocks;   /* Storage for decoded instructions */
+  int            n_predecode_blocks;
+  int            predecode_free;     /* Entries left in the last block */
+#endif
+
   int display_active;
   ZDisplay* dinfo;
 
@@ -288,6 +384,11 @@ typedef struct ZMachine
   int track_attributes;
 #endif
 
+#ifdef PROFILE
+  char*         profile_file;         /* NULL if we're not profiling */
+  unsigned long profile_instructions; /* Instructions executed so far */
+#endif
+
   ZFile*     blorb_file;
   IffFile*   blorb_tokens;
   BlorbFile* blorb;
@@ -303,6 +404,7 @@ typedef struct ZDictionary
 
 extern void  zmachine_load_story    (char* filename, ZMachine* machine);
 extern void  zmachine_load_file     (ZFile* file, ZMachine* machine);
+extern void  zmachine_unload_story  (void);
 extern void  zmachine_setup_header  (void);
 extern void  zmachine_resize_display(ZDisplay* dis);
 extern void  zmachine_fatal         (char* format, ...);
@@ -315,6 +417,10 @@ extern void  zmachine_dump_stack    (ZStack* stack);
 extern ZWord   pop         (ZStack*);
 extern ZWord   top         (ZStack*);
 extern ZFrame* call_routine(ZDWord* pc, ZStack* stack, ZDWord start);
+
+extern ZFrame* zmachine_alloc_frame(void);
+extern void    zmachine_free_frame (ZFrame* frame);
+extern ZReadCallback* zmachine_read_callback(ZFrame* frame);
      
 /* Utility macros */
 
@@ -333,6 +439,6 @@ extern ZWord debug_print_var(ZWord val, int var);
 #define GetWord(m, x) ((m[x]<<8)|(m[x+1]))
 #define Address(x) (machine.memory + (x))
 
-extern ZMachine machine;
+extern ZSTATE ZMachine machine;
 
 #endif
@@ -525,30 +525,13 @@ static int lastDownloadId = 0;
 		
 		// If we have an MD5, then verify that the file matches it
 		if (md5) {
-			md5_state_t state;
-			md5_init(&state);
-			
-			NSFileHandle* readDownload = [NSFileHandle fileHandleForReadingAtPath: tmpFile];
-			if (readDownload == nil) {
+			// Get the MD5 digest of the downloaded file
+			md5_byte_t digest[16];
+			if (md5_file([tmpFile fileSystemRepresentation], digest) != 0) {
 				[self failed: @"The downloaded file was deleted before it could be processed"];
 				return;
 			}
 			
-			// Read in the file and update the MD5 sum
-			NSData* readBytes;
-			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-			while ((readBytes = [readDownload readDataOfLength: 65536]) && [readBytes length] > 0) {
-				md5_append(&state, [readBytes bytes], [readBytes length]);
-				
-				[pool release];
-				pool = [[NSAutoreleasePool alloc] init];
-			}
-			[pool release]; pool = nil;
-			
-			// Finish up and get the MD5 digest
-			md5_byte_t digest[16];
-			md5_finish(&state, digest);
-			
 			NSData* digestData = [NSData dataWithBytes: digest
 												length: 16];
 			NSLog(@"MD5 digest is %@", digestData);
@@ -106,6 +106,13 @@ ZByte* read_block(ZFile* file, int start_pos, int end_pos) {
     return res2;
 }
 
+ZByte* map_block(ZFile* file, int start_pos, int end_pos) {
+    return NULL;
+}
+
+void unmap_block(ZByte* block, int start_pos, int end_pos) {
+}
+
 void   read_block2(ZByte* block, ZFile* file, int start_pos, int end_pos) {
     NSAutoreleasePool* p = [[NSAutoreleasePool alloc] init];
     NSData* result = nil;
@@ -47,26 +47,30 @@ NSString* ZoomOpenPanelLocation = @"ZoomOpenPanelLocation";
 
 		NSString* configDir = [self zoomConfigDirectory];
 
-		// Load the metadata
-		NSData* userData = [NSData dataWithContentsOfFile: [configDir stringByAppendingPathComponent: @"metadata.iFiction"]];
-		NSData* gameData = [NSData dataWithContentsOfFile: [configDir stringByAppendingPathComponent: @"gamedata.iFiction"]];
-		NSData* infocomData = [NSData dataWithContentsOfFile: [[NSBundle mainBundle] pathForResource: @"infocom" ofType: @"iFiction"]];
-		NSData* archiveData = [NSData dataWithContentsOfFile: [[NSBundle mainBundle] pathForResource: @"archive" ofType: @"iFiction"]];
+		// Load the metadata (via snapshots in the config directory, which are rebuilt when the files change)
+		ZoomMetadata* userData = [[ZoomMetadata alloc] initWithContentsOfFile: [configDir stringByAppendingPathComponent: @"metadata.iFiction"]
+																	 snapshot: [configDir stringByAppendingPathComponent: @"metadata.ifmb"]];
+		ZoomMetadata* gameData = [[ZoomMetadata alloc] initWithContentsOfFile: [configDir stringByAppendingPathComponent: @"gamedata.iFiction"]
+																	 snapshot: [configDir stringByAppendingPathComponent: @"gamedata.ifmb"]];
+		ZoomMetadata* infocomData = [[ZoomMetadata alloc] initWithContentsOfFile: [[NSBundle mainBundle] pathForResource: @"infocom" ofType: @"iFiction"]
+																		snapshot: [configDir stringByAppendingPathComponent: @"infocom.ifmb"]];
+		ZoomMetadata* archiveData = [[ZoomMetadata alloc] initWithContentsOfFile: [[NSBundle mainBundle] pathForResource: @"archive" ofType: @"iFiction"]
+																		snapshot: [configDir stringByAppendingPathComponent: @"archive.ifmb"]];
 		
 		if (userData) 
-			[gameIndices addObject: [[[ZoomMetadata alloc] initWithData: userData] autorelease]];
+			[gameIndices addObject: [userData autorelease]];
 		else
 			[gameIndices addObject: [[[ZoomMetadata alloc] init] autorelease]];
 
 		if (gameData) 
-			[gameIndices addObject: [[[ZoomMetadata alloc] initWithData: gameData] autorelease]];
+			[gameIndices addObject: [gameData autorelease]];
 		else
 			[gameIndices addObject: [[[ZoomMetadata alloc] init] autorelease]];
 		
 		if (infocomData) 
-			[gameIndices addObject: [[[ZoomMetadata alloc] initWithData: infocomData] autorelease]];
+			[gameIndices addObject: [infocomData autorelease]];
 		if (archiveData) 
-			[gameIndices addObject: [[[ZoomMetadata alloc] initWithData: archiveData] autorelease]];
+			[gameIndices addObject: [archiveData autorelease]];
 	}
 	
 	return self;
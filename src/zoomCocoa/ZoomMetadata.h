@@ -26,6 +26,8 @@ extern NSString* ZoomMetadataWillDestroyStory;			// A story with a particular ID
 // Initialisation
 - (id) init;											// Blank metadata
 - (id) initWithContentsOfFile: (NSString*) filename;	// Calls initWithData
+- (id) initWithContentsOfFile: (NSString*) filename		// Uses (or rebuilds) a binary snapshot of the file
+					 snapshot: (NSString*) snapshotFile;
 - (id) initWithData: (NSData*) xmlData;					// Designated initialiser
 
 // Thread safety [called by ZoomStory]
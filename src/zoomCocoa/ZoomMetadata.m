@@ -16,6 +16,8 @@
 
 NSString* ZoomMetadataWillDestroyStory = @"ZoomMetadataWillDestroyStory";
 
+static int dataWrite(const char* bytes, int length, void* userData);
+
 @implementation ZoomMetadata
 
 // = Initialisation, etc =
@@ -70,6 +72,52 @@ NSString* ZoomMetadataWillDestroyStory = @"ZoomMetadataWillDestroyStory";
 					 filename: fname];
 }
 
+// Identifies a particular version of a file, so we can tell when a snapshot is out of date
+static NSString* stampForFile(NSString* fname) {
+	NSDictionary* attributes = [[NSFileManager defaultManager] fileAttributesAtPath: fname
+																	   traverseLink: YES];
+	if (attributes == nil) return nil;
+	
+	return [NSString stringWithFormat: @"%@ %qu %.0f", 
+		[fname lastPathComponent],
+		[attributes fileSize],
+		[[attributes fileModificationDate] timeIntervalSinceReferenceDate]];
+}
+
+- (id) initWithContentsOfFile: (NSString*) fname
+					 snapshot: (NSString*) snapshotFile {
+	NSString* stamp = stampForFile(fname);
+	if (stamp == nil) {
+		[self release];
+		return nil;
+	}
+	
+	self = [self init];
+	
+	if (self) {
+		filename = [fname copy];
+		
+		// Snapshots are much faster to load than the XML, so use one if it's up to date
+		NSData* snapshot = [NSData dataWithContentsOfMappedFile: snapshotFile];
+		
+		if (snapshot != nil && IFMB_ReadSnapshot(metadata, [stamp UTF8String], [snapshot bytes], [snapshot length])) {
+			return self;
+		}
+		
+		// Otherwise, read the XML and make a new snapshot for next time
+		NSData* xmlData = [NSData dataWithContentsOfFile: fname];
+		IF_ReadIfiction(metadata, [xmlData bytes], [xmlData length]);
+		
+		NSMutableData* newSnapshot = [[NSMutableData alloc] init];
+		IFMB_WriteSnapshot(metadata, [stamp UTF8String], dataWrite, newSnapshot);
+		[newSnapshot writeToFile: snapshotFile
+					  atomically: YES];
+		[newSnapshot release];
+	}
+	
+	return self;
+}
+
 - (id) initWithData: (NSData*) xmlData {
 	return [self initWithData: xmlData
 					 filename: nil];
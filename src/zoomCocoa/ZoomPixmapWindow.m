@@ -247,7 +247,15 @@
 	destRect.size = [[zView resources] sizeForImageWithNumber: number
 												forPixmapSize: [pixmap size]];
 	
+	NSImageInterpolation interpolation;
+	switch ([[zView preferences] imageFilter]) {
+		case ZoomImageFilterBox:		interpolation = NSImageInterpolationNone; break;
+		case ZoomImageFilterBilinear:	interpolation = NSImageInterpolationLow; break;
+		default:						interpolation = NSImageInterpolationHigh; break;
+	}
+	
 	[pixmap lockFocus];
+	[[NSGraphicsContext currentContext] setImageInterpolation: interpolation];
 	[img setFlipped: [pixmap isFlipped]];
 	[img drawInRect: destRect
 		   fromRect: imgRect
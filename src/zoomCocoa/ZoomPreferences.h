@@ -16,6 +16,13 @@ enum GlulxInterpreter {
 	GlulxGlulxe		= 1
 };
 
+// How pictures are scaled (the same filters as the 'resample' option in .zoomrc)
+enum ZoomImageFilter {
+	ZoomImageFilterBox		= 0,
+	ZoomImageFilterBilinear	= 1,
+	ZoomImageFilterLanczos	= 2
+};
+
 @interface ZoomPreferences : NSObject<NSCoding> {
 	NSMutableDictionary* prefs;
 	NSLock* prefLock;
@@ -71,6 +78,7 @@ enum GlulxInterpreter {
 - (BOOL) showBorders;
 - (BOOL) showGlkBorders;
 - (BOOL) showCoverPicture;
+- (enum ZoomImageFilter) imageFilter;
 
 // The dictionary
 - (NSDictionary*) dictionary;
@@ -110,6 +118,7 @@ enum GlulxInterpreter {
 - (void) setForegroundColour: (int) value;
 - (void) setBackgroundColour: (int) value;
 - (void) setShowCoverPicture: (BOOL) value;
+- (void) setImageFilter: (enum ZoomImageFilter) value;
 
 // Notifications
 - (void) preferencesHaveChanged;
@@ -43,6 +43,7 @@ static NSString* backgroundColour   = @"BackgroundColour";
 static NSString* showBorders		= @"ShowBorders";
 static NSString* showGlkBorders		= @"ShowGlkBorders";
 static NSString* showCoverPicture   = @"ShowCoverPicture";
+static NSString* imageFilter		= @"ImageFilter";
 
 // == Global preferences ==
 
@@ -203,6 +204,8 @@ static NSArray* DefaultColours(void) {
 				  forKey: showBorders];
 		[prefs setObject: [NSNumber numberWithBool: YES]
 				  forKey: showGlkBorders];
+		[prefs setObject: [NSNumber numberWithInt: ZoomImageFilterLanczos]
+				  forKey: imageFilter];
 		
 		[pool release];
 	}
@@ -728,6 +731,12 @@ static NSArray* DefaultColours(void) {
 	return [val boolValue];	
 }
 
+- (enum ZoomImageFilter) imageFilter {
+	NSNumber* val = [prefs objectForKey: imageFilter];
+	if (val == nil) return ZoomImageFilterLanczos;
+	return [val intValue];
+}
+
 - (BOOL) showBorders {
 	NSNumber* val = [prefs objectForKey: showBorders];
 	if (val == nil) return YES;
@@ -746,6 +755,12 @@ static NSArray* DefaultColours(void) {
 	[self preferencesHaveChanged];	
 }
 
+- (void) setImageFilter: (enum ZoomImageFilter) value {
+	[prefs setObject: [NSNumber numberWithInt: value]
+			  forKey: imageFilter];
+	[self preferencesHaveChanged];
+}
+
 - (void) setShowBorders: (BOOL) value {
 	[prefs setObject: [NSNumber numberWithBool: value]
 			  forKey: showBorders];
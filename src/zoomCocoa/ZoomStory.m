@@ -22,11 +22,50 @@ NSString* ZoomStoryExtraMetadata = @"ZoomStoryExtraMetadata";
 
 NSString* ZoomStoryExtraMetadataChangedNotification = @"ZoomStoryExtraMetadataChangedNotification";
 
+// Compiled key paths for the standard keys (these are read from every story whenever the library is sorted)
+static struct {
+	NSString* key;
+	const char* valueKey;
+	IFKeyPath path;
+} standardKeys[] = {
+	{ @"title", "bibliographic.title", NULL },
+	{ @"headline", "bibliographic.headline", NULL },
+	{ @"author", "bibliographic.author", NULL },
+	{ @"genre", "bibliographic.genre", NULL },
+	{ @"group", "bibliographic.group", NULL },
+	{ @"year", "bibliographic.firstpublished", NULL },
+	{ @"zarfian", "bibliographic.forgiveness", NULL },
+	{ @"teaser", "zoom.teaser", NULL },
+	{ @"comment", "zoom.comment", NULL },
+	{ @"rating", "zoom.rating", NULL },
+	{ @"description", "bibliographic.description", NULL },
+	{ @"coverpicture", "zcode.coverpicture", NULL },
+	{ nil, NULL, NULL }
+};
+
+static IFKeyPath keyPathForKey(NSString* key) {
+	int x;
+	
+	for (x=0; standardKeys[x].key != nil; x++) {
+		if ([key isEqualToString: standardKeys[x].key]) return standardKeys[x].path;
+	}
+	
+	return NULL;
+}
+
 @implementation ZoomStory
 
 + (void) initialize {
 	NSUserDefaults* defs = [NSUserDefaults standardUserDefaults];
 	
+	if (standardKeys[0].path == NULL) {
+		int x;
+		
+		for (x=0; standardKeys[x].key != nil; x++) {
+			standardKeys[x].path = IFMB_CompileKeyPath(standardKeys[x].valueKey);
+		}
+	}
+	
 	[defs registerDefaults: 
 		[NSDictionary dictionaryWithObjectsAndKeys:
 			[NSDictionary dictionary], ZoomStoryExtraMetadata,
@@ -92,7 +131,8 @@ NSString* ZoomStoryExtraMetadataChangedNotification = @"ZoomStoryExtraMetadataCh
 	ZoomMetadata* fileMetadata = nil;
 	
 	if (fileID == nil) {
-		fileID = [[[ZoomStoryID alloc] initWithData: [NSData dataWithContentsOfFile: filename]] autorelease];
+		fileID = [[[ZoomStoryID alloc] initWithContentsOfFile: filename] autorelease];
+		if (fileID == nil) return nil;			// Couldn't read the file
 	}
 	
 	// If this file is a blorb file, then extract the IFmd chunk
@@ -551,8 +591,14 @@ NSString* ZoomStoryExtraMetadataChangedNotification = @"ZoomStoryExtraMetadataCh
 	
 	[metadata lock];
 	
-	id newKey = [self newKeyForOld: key];
-	IFChar* value = IFMB_GetValue(story, [newKey UTF8String]);
+	IFKeyPath path = keyPathForKey(key);
+	IFChar* value;
+	
+	if (path != NULL) {
+		value = IFMB_GetValueForPath(story, path);
+	} else {
+		value = IFMB_GetValue(story, [[self newKeyForOld: key] UTF8String]);
+	}
 	
 	if (value != nil) {
 		int len = IFMB_StrLen(value);
@@ -617,7 +663,13 @@ NSString* ZoomStoryExtraMetadataChangedNotification = @"ZoomStoryExtraMetadataCh
 		free(characters);
 	}
 	
-	IFMB_SetValue(story, [[self newKeyForOld: key] UTF8String], metaValue);
+	IFKeyPath path = keyPathForKey(key);
+	
+	if (path != NULL) {
+		IFMB_SetValueForPath(story, path, metaValue);
+	} else {
+		IFMB_SetValue(story, [[self newKeyForOld: key] UTF8String], metaValue);
+	}
 	if (metaValue) free(metaValue);
 	
 	[metadata unlock];
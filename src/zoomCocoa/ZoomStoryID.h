@@ -22,6 +22,7 @@
 - (id) initWithData: (NSData*) genericGameData;
 - (id) initWithData: (NSData*) genericGameData
 			   type: (NSString*) type;
+- (id) initWithContentsOfFile: (NSString*) filename;
 - (id) initWithIdent: (struct IFID*) ident;
 - (id) initWithIdString: (NSString*) idString;
 - (id) initWithZcodeRelease: (int) release
@@ -431,6 +431,24 @@
 	return self;
 }
 
+// The identity block for an MD5 digest of a game of the given type
+static IFID IdentForDigest(NSString* type, const unsigned char* r) {
+	// Build the string
+	int len = ([type length]+32+2);
+	char* result = malloc(sizeof(char)*len);
+	IFID ident;
+	
+	snprintf(result, len, "%s-%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
+			 [type UTF8String],
+			 r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9], r[10], r[11], r[12], r[13], r[14], r[15]);
+	
+	// Allocate the identity block
+	ident = IFMB_IdFromString(result);
+	free(result);
+	
+	return ident;
+}
+
 - (id) initWithData: (NSData*) genericGameData
 			   type: (NSString*) type {
 	self = [super init];
@@ -444,19 +462,29 @@
 		md5_append(&md5state, [genericGameData bytes], [genericGameData length]);
 		md5_finish(&md5state, r);
 		
-		// Build the string
-		int len = ([type length]+32+2);
-		char* result = malloc(sizeof(char)*len);
-		
-		snprintf(result, len, "%s-%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-				 [type UTF8String],
-				 r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9], r[10], r[11], r[12], r[13], r[14], r[15]);
-		
-		// Allocate the identity block
-		ident = IFMB_IdFromString(result);
+		ident = IdentForDigest(type, r);
 		needsFreeing = YES;
-			
-		free(result);
+	}
+	
+	if (ident == nil) {
+		[self release];
+		return nil;
+	}
+	
+	return self;
+}
+
+- (id) initWithContentsOfFile: (NSString*) filename {
+	self = [super init];
+	
+	if (self) {
+		// Take MD5 of the file, without loading all of it
+		unsigned char r[16];
+		
+		if (md5_file([filename fileSystemRepresentation], r) == 0) {
+			ident = IdentForDigest(@"MD5", r);
+			needsFreeing = YES;
+		}
 	}
 	
 	if (ident == nil) {
@@ -186,6 +186,7 @@ extern NSString* ZoomStyleAttributeName;
 
 // Setting/updating preferences
 - (void) setPreferences: (ZoomPreferences*) prefs;
+- (ZoomPreferences*) preferences;
 - (void) preferencesHaveChanged: (NSNotification*)not;
 
 - (void) reformatWindow;
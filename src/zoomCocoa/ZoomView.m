@@ -2313,6 +2313,10 @@ shouldChangeTextInRange:(NSRange)affectedCharRange
 											   object: viewPrefs];
 }
 
+- (ZoomPreferences*) preferences {
+	return viewPrefs;
+}
+
 - (void) preferencesHaveChanged: (NSNotification*)not {
 	// Usually called by the notification manager
 	if ([not object] != viewPrefs) {
@@ -129,6 +129,8 @@
 	rc_defgame->xsize = 80;
 	rc_defgame->ysize = 25;
 	rc_defgame->antialias = 1;
+	rc_defgame->scrollback = -1;
+	rc_defgame->resample = -1;
 	rc_defgame->fg_col = [display foregroundColour];
 	rc_defgame->bg_col = [display backgroundColour];
 	
@@ -658,10 +660,7 @@ static NSString* zscii_to_string(ZByte* buf) {
 				break;
 		}
 		
-		int x;
-		for (x=0; x<UNDO_LEVEL; x++) {
-			machine.undo[x] = NULL;
-		}
+		state_clear_undo();
 		
 		// Note that we're restoring, not restarting
 		wasRestored = YES;
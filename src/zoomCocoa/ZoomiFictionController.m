@@ -29,6 +29,7 @@
 #import "ZoomSignPost.h"
 
 #import "ifmetabase.h"
+#import "ifscan.h"
 
 #ifndef NSAppKitVersionNumber10_2
 # define NSAppKitVersionNumber10_2 663
@@ -2367,6 +2368,22 @@ int tableSorter(id a, id b, void* context) {
 	// Work out the group to use to store the files that we've added
 	if (groupName == nil || [groupName length] == 0) groupName = @"Downloaded";
 	
+	// Identify the Z-Code stories (bare or in blorbs) in one go, on as many threads as there are processors.
+	// Everything else is left for the plug-ins that run it, so no file gets read twice.
+	NSMutableDictionary* scannedIds = [NSMutableDictionary dictionary];
+	int scanCount, scanFile;
+	IFScanFile* scanned = IF_ScanDirectory(NULL, [directory fileSystemRepresentation], IFScanZcodeFiles, 0, &scanCount);
+	for (scanFile=0; scanFile<scanCount; scanFile++) {
+		NSString* scannedPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation: scanned[scanFile].filename
+																						   length: strlen(scanned[scanFile].filename)];
+		ZoomStoryID* scannedId = [[ZoomStoryID alloc] initWithIdent: scanned[scanFile].ident];
+		
+		if (scannedId) [scannedIds setObject: scannedId
+									  forKey: [scannedPath stringByStandardizingPath]];
+		[scannedId release];
+	}
+	IF_FreeScan(scanned, scanCount);
+	
 	// Iterate through the directory and organise any files that we find
 	NSMutableArray* addedFiles = [NSMutableArray array];
 	NSDirectoryEnumerator* dirEnum = [[NSFileManager defaultManager] enumeratorAtPath: directory];
@@ -2398,8 +2415,9 @@ int tableSorter(id a, id b, void* context) {
 			continue;
 		}
 		
-		// Must have an ID
-		ZoomStoryID* storyId = [ZoomStoryID idForFile: path];
+		// Must have an ID (Z-Code was identified by the scan; anything else may need a plug-in)
+		ZoomStoryID* storyId = [scannedIds objectForKey: path];
+		if (!storyId) storyId = [ZoomStoryID idForFile: path];
 		if (!storyId) continue;
 		
 		// Organise this file
@@ -22,12 +22,14 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "zmachine.h"
 #include "zscii.h"
+#include "interp.h"
 
-static unsigned int *buf  = NULL;
-static int maxlen = 0;
+static ZSTATE unsigned int *buf  = NULL;
+static ZSTATE int maxlen = 0;
 
 /* Default tables */
 static unsigned int alpha_a[32] =
@@ -51,7 +53,7 @@ static unsigned int alpha_c[32] =
 static unsigned int* convert_table[3] = { alpha_a, alpha_b, alpha_c };
 
 /* Table that maps alphabet + character to ZSCII character */
-static unsigned int** convert = convert_table;
+static ZSTATE unsigned int** convert = convert_table;
 
 int  zscii_unicode_table[256] =
 {
@@ -90,7 +92,7 @@ int  zscii_unicode_table[256] =
 };
 
 /* Table that maps (8-bit) ZSCII to unicode */
-int* zscii_unicode = zscii_unicode_table;
+ZSTATE int* zscii_unicode = zscii_unicode_table;
 
 #ifdef DEBUG
 char* zscii_to_ascii(ZByte* string, int* len)
@@ -113,6 +115,314 @@ char* zscii_to_ascii(ZByte* string, int* len)
 }
 #endif
 
+#ifdef ZSCII_REFERENCE
+/*
+ * The reference decoder: zscii_to_unicode as it was before the fast path,
+ * one Z-character at a time. zsciitest.c (which includes this file with
+ * ZSCII_REFERENCE defined) checks that the two agree.
+ */
+static unsigned int* zscii_to_unicode_reference(ZByte* string, int* len)
+{
+	int abet = 0;
+	int x = 0;
+	int y = 0;
+	int zlen, z;
+	ZWord zchar = 0;
+	int fin = 0;
+		
+	zlen = 0;
+	
+	if (maxlen <= 0)
+    {
+		maxlen += 512;
+		buf = realloc(buf, sizeof(int)*maxlen);
+    }
+	
+	while (!fin)
+    {
+		ZUWord word;
+		
+		fin = (string[x]&0x80) != 0;
+		
+		word = ((unsigned)string[x]<<8)|(unsigned)string[x+1];
+		
+		for (z=0; z<3; z++)
+		{
+			int c;
+			
+			c = (word&0x7c00)>>10;
+			
+			if ((y+8) > maxlen)
+			{
+				maxlen += 1024;
+				buf = realloc(buf, sizeof(int)*maxlen);
+			}
+			
+			switch (abet)
+			{
+				/* Standard alphabets */
+				case 2:
+					if (c == 6)
+					{
+						/* Next 2 chars make up a Z-Character */
+						abet=4;
+						break;
+					}
+				case 1:
+				case 0:
+					if (c >= 6)
+					{
+						if (convert[abet][c] < 256)
+							buf[y++] = zscii_unicode[convert[abet][c]];
+						else
+							buf[y++] = convert[abet][c];
+						
+						if (buf[y-1] == 9)
+						{
+							y--;
+							buf[y++] = ' ';
+							buf[y++] = ' ';
+							buf[y++] = ' ';
+						}
+						if (buf[y-1] == 11)
+						{
+							y--;
+							buf[y++] = ' ';
+							buf[y++] = ' ';
+						}
+						abet=0;
+					}
+					else
+					{
+						switch (c)
+						{
+							case 0: /* Space */
+								buf[y++] = ' ';
+								break;
+								
+							case 1: /* Next char is an abbreviation */
+							case 2:
+							case 3:
+								zchar=(c-1)<<5;
+								abet=3;
+								break;
+								
+							case 4: /* Shift to alphabet 1 */
+								abet=1;
+									break;
+								case 5: /* Shift to alphabet 2 */
+									abet=2;
+									break;
+								default:
+									/* Ignore */
+									break;
+						}
+					}
+					break;
+					
+				case 3: /* Abbreviation */
+				{
+					int z;
+					int* abbrev;
+					int addr;
+					ZByte* table;
+					
+					zchar |= c;
+					
+					/* 
+						* Annoyingly, some games seem to rewrite the abbreviation
+					 * table at runtime. This may cause weird things to happen
+					 * if a game is sick enough to use abbreviations in
+					 * abbreviations, too.
+					 */
+					table = machine.memory + GetWord(machine.header, ZH_abbrevs);
+					addr = ((table[zchar*2]<<9)|(table[zchar*2+1]<<1));
+					
+					if (machine.abbrev_addr[zchar] != addr)
+					{
+					   if (addr >= 0 && addr < machine.story_length)
+					   {
+						  /* 
+						  * Hack, this function was never designed to be called
+						   * recursively
+						   */
+						  unsigned int* oldbuf;
+						  int oldmaxlen;
+						  int ablen;
+						  
+						  oldbuf = buf;
+						  oldmaxlen = maxlen;
+						  maxlen = 0;
+						  buf = NULL;
+						  
+						  zlen = y;
+						  abbrev = zscii_to_unicode_reference((ZByte*)machine.memory +
+													addr,
+													&ablen);
+						  
+						  buf = oldbuf;
+						  maxlen = oldmaxlen;
+						  
+						  for (z=0; abbrev[z]!=0; z++)
+							  zlen++;
+						  
+						  while ((zlen+2) > maxlen)
+						  {
+							  maxlen += 1024;
+							  buf = realloc(buf, sizeof(int)*(maxlen));
+						  }
+						  
+						  for (z=0; abbrev[z] != 0; z++)
+						  {
+							  buf[y++] = abbrev[z];
+						  }
+						  
+						  free(abbrev);
+					   }
+					  else
+					  {
+						zmachine_fatal("Found a bad entry in the abbreviation table for entry %i", zchar);
+					  }
+					}
+					else if (machine.abbrev[zchar])
+					{
+						abbrev = machine.abbrev[zchar];
+						
+						for (z=0; abbrev[z]!=0; z++)
+							zlen++;
+						
+						while ((zlen+2) > maxlen)
+						{
+							maxlen+=1024;
+							buf = realloc(buf, sizeof(int)*(maxlen));
+						}
+						
+						for (z=0; abbrev[z] != 0; z++)
+						{
+							buf[y++] = abbrev[z];
+						}
+					}
+					else
+					{
+					  zmachine_fatal("Found a bad entry in the abbreviation table for entry %i", zchar);
+					}
+				}
+					
+					abet = 0;
+						break;
+						
+					case 4: /* First byte of a Z-Char */
+						zchar = c<<5;
+							abet = 5;
+							break;
+							
+						case 5: /* Second byte of a Z-Char */
+							zchar |= c;
+								abet = 0;
+								
+								if (zchar < 256)
+								{
+									switch(zchar)
+									{
+										default:
+											buf[y++] = zscii_unicode[zchar];
+											
+											if (buf[y-1] == 9)
+											{
+												y--;
+												buf[y++] = ' ';
+												buf[y++] = ' ';
+												buf[y++] = ' ';
+											}
+									}
+								}
+									else
+									{
+#ifdef SPEC_11
+										if (zchar > 767)
+										{
+											/* Unicode character, this is a bit of a PITA */
+											int ulen;
+											int i;
+																						
+											ulen = zchar - 767;
+											x += 2;
+											
+											for (i=0; i<ulen; i++)
+											{
+												if ((y+1) > maxlen)
+												{
+													maxlen += 1024;
+													buf = realloc(buf, sizeof(int)*maxlen);
+												}
+												
+												buf[y++] = (~((((unsigned)string[x])<<8)|((unsigned)string[x+1])))&0xffff;
+												x += 2;
+											}
+											
+											if (z == 2)
+												goto onward; /* Blech */
+										}
+#else
+										buf[y++] = zchar;
+#endif
+									}
+									break;
+			}
+			
+			word <<= 5;
+		}
+		
+		x += 2;
+onward: 
+			; /* Stupid ANSI standard, or is this an ISO thing? */
+    }
+	
+	*len = x;
+	buf[y] = 0;
+	
+	return buf;
+}
+#endif
+
+/*
+ * Lookup tables for the fast path through zscii_to_unicode: the Unicode
+ * character for each Z-character in alphabets 0 and 1, or 0 where the
+ * character needs the full treatment (shifts, abbreviations, tabs...).
+ * These are rebuilt after a new alphabet is installed.
+ */
+static ZSTATE unsigned int fast_a0[32];
+static ZSTATE unsigned int fast_a1[32];
+static ZSTATE int          fast_ready = 0;
+
+static void build_fast_tables(void)
+{
+	int c, abet;
+	
+	for (abet=0; abet<2; abet++)
+	{
+		unsigned int* table = abet==0?fast_a0:fast_a1;
+		
+		for (c=0; c<32; c++)
+		{
+			unsigned int chr = 0;
+			
+			if (c >= 6)
+			{
+				chr = convert[abet][c];
+				if (chr < 256)
+					chr = zscii_unicode[chr];
+				if (chr == 9 || chr == 11)
+					chr = 0;
+			}
+			table[c] = chr;
+		}
+	}
+	fast_a0[0] = ' ';
+	
+	fast_ready = 1;
+}
+
 /*
  * Convert a ZSCII string (packed) to Unicode (unpacked)
  */
@@ -132,6 +442,8 @@ unsigned int* zscii_to_unicode(ZByte* string, int* len)
 		maxlen += 512;
 		buf = realloc(buf, sizeof(int)*maxlen);
     }
+	if (!fast_ready)
+		build_fast_tables();
 	
 	while (!fin)
     {
@@ -141,6 +453,37 @@ unsigned int* zscii_to_unicode(ZByte* string, int* len)
 		
 		word = ((unsigned)string[x]<<8)|(unsigned)string[x+1];
 		
+		/*
+		 * Fast path: most words are three characters from alphabet 0,
+		 * or a shift to alphabet 1 followed by its character
+		 */
+		if (abet == 0 && (y+8) <= maxlen)
+		{
+			int c[3];
+			int i, out;
+			
+			c[0] = (word>>10)&0x1f;
+			c[1] = (word>>5)&0x1f;
+			c[2] = word&0x1f;
+			
+			for (i=0, out=y; i<3; i++)
+			{
+				if (fast_a0[c[i]])
+					buf[out++] = fast_a0[c[i]];
+				else if (c[i] == 4 && i < 2 && fast_a1[c[i+1]])
+					buf[out++] = fast_a1[c[++i]];
+				else
+					break;
+			}
+			
+			if (i == 3)
+			{
+				y = out;
+				x += 2;
+				continue;
+			}
+		}
+		
 		for (z=0; z<3; z++)
 		{
 			int c;
@@ -379,6 +722,217 @@ onward:
 	return buf;
 }
 
+/***                           ----// 888 \\----                           ***/
+
+/*
+ * The string cache
+ *
+ * Decoded strings are kept by address, with the least recently used
+ * one thrown out when the cache fills up. Strings in dynamic memory
+ * (object names, mostly) and the tables that decoding depends on (the
+ * abbreviations and the alphabet) are watched via zmachine_watch_memory():
+ * writing to them flushes the cache.
+ */
+
+#ifdef CACHE_STRINGS
+
+#define CACHE_BUCKETS 256 /* Power of 2 */
+
+typedef struct ZCachedString
+{
+  ZDWord        address;
+  int           len;     /* Length of the Z-string in bytes */
+  unsigned int* text;
+
+  int           older, newer;	/* LRU list (-1 at the ends) */
+  int           next;		/* Next in this bucket (plus 1, 0 at the end) */
+} ZCachedString;
+
+static ZSTATE ZCachedString cached[CACHE_STRINGS];
+static ZSTATE int           bucket[CACHE_BUCKETS]; /* First entry plus 1 */
+static ZSTATE int           n_cached = 0;
+static ZSTATE int           newest   = -1;
+static ZSTATE int           oldest   = -1;
+static ZSTATE int           abbrevs_watched = 0;
+static ZSTATE int           alphabet_watched = 0;
+
+#define Bucket(adr) (((adr)^((adr)>>8))&(CACHE_BUCKETS-1))
+
+void zscii_flush_cache(void)
+{
+  int x;
+
+  for (x=0; x<n_cached; x++)
+    free(cached[x].text);
+  for (x=0; x<CACHE_BUCKETS; x++)
+    bucket[x] = 0;
+
+  n_cached = 0;
+  newest = oldest = -1;
+  abbrevs_watched = 0;
+
+  /* The alphabet may have been rewritten */
+  if (alphabet_watched)
+    {
+      alphabet_watched = 0;
+      zscii_install_alphabet();
+    }
+}
+
+static void lru_unlink(int x)
+{
+  if (cached[x].older >= 0)
+    cached[cached[x].older].newer = cached[x].newer;
+  else
+    oldest = cached[x].newer;
+
+  if (cached[x].newer >= 0)
+    cached[cached[x].newer].older = cached[x].older;
+  else
+    newest = cached[x].older;
+}
+
+static void lru_push(int x)
+{
+  cached[x].older = newest;
+  cached[x].newer = -1;
+  if (newest >= 0)
+    cached[newest].newer = x;
+  newest = x;
+  if (oldest < 0)
+    oldest = x;
+}
+
+/* Frees up the least recently used entry and returns it */
+static int cache_evict(void)
+{
+  int  x;
+  int* link;
+
+  x = oldest;
+  lru_unlink(x);
+
+  for (link = bucket + Bucket(cached[x].address);
+       *link != x+1;
+       link = &cached[*link-1].next);
+  *link = cached[x].next;
+
+  free(cached[x].text);
+  return x;
+}
+
+/*
+ * Watches the abbreviation and alphabet tables, and any abbreviations
+ * that live in dynamic memory. The abbreviations decoded when the game
+ * was loaded can't be used for the latter, as they may have changed
+ * since.
+ */
+static void watch_tables(void)
+{
+  ZUWord table;
+  ZDWord addr;
+  int    x;
+
+  zmachine_watch_memory(ZH_abbrevs, 2);
+  table = GetWord(machine.header, ZH_abbrevs);
+
+  if (table != 0)
+    {
+      zmachine_watch_memory(table, 192);
+
+      for (x=0; x<96 && table+x*2+1 < machine.story_length; x++)
+	{
+	  addr = GetWord(machine.memory, table+x*2)<<1;
+	  if (addr == 0 || addr >= machine.dynamic_ceiling)
+	    continue;
+
+	  machine.abbrev_addr[x] = -1;
+	  for (; addr+1 < machine.dynamic_ceiling; addr += 2)
+	    {
+	      zmachine_watch_memory(addr, 2);
+	      if (machine.memory[addr]&0x80)
+		break;
+	    }
+	}
+    }
+
+  if (ReadByte(0) >= 5)
+    {
+      zmachine_watch_memory(ZH_alphatable, 2);
+      table = Word(ZH_alphatable);
+      if (table != 0 && table < machine.dynamic_ceiling)
+	{
+	  zmachine_watch_memory(table, 78);
+	  alphabet_watched = 1;
+	}
+    }
+
+  abbrevs_watched = 1;
+}
+
+/*
+ * Decodes the string at the given address, returning the cached copy
+ * if there is one. The result is only good until the next call.
+ */
+unsigned int* zscii_decode_at(ZDWord address, int* len)
+{
+  unsigned int* text;
+  int x, ulen;
+
+  for (x = bucket[Bucket(address)]-1; x >= 0; x = cached[x].next-1)
+    {
+      if (cached[x].address == address)
+	{
+	  if (x != newest)
+	    {
+	      lru_unlink(x);
+	      lru_push(x);
+	    }
+
+	  *len = cached[x].len;
+	  return cached[x].text;
+	}
+    }
+
+  if (!abbrevs_watched)
+    watch_tables();
+
+  text = zscii_to_unicode(machine.memory + address, len);
+  if (address < machine.dynamic_ceiling)
+    zmachine_watch_memory(address, *len);
+
+  if (n_cached < CACHE_STRINGS)
+    x = n_cached++;
+  else
+    x = cache_evict();
+
+  for (ulen = 0; text[ulen] != 0; ulen++);
+
+  cached[x].address = address;
+  cached[x].len     = *len;
+  cached[x].text    = malloc(sizeof(unsigned int)*(ulen+1));
+  memcpy(cached[x].text, text, sizeof(unsigned int)*(ulen+1));
+
+  cached[x].next = bucket[Bucket(address)];
+  bucket[Bucket(address)] = x+1;
+  lru_push(x);
+
+  return cached[x].text;
+}
+
+#else
+
+unsigned int* zscii_decode_at(ZDWord address, int* len)
+{
+  return zscii_to_unicode(machine.memory + address, len);
+}
+
+void zscii_flush_cache(void)
+{
+}
+
+#endif
+
 /*
  * Pack a ZSCII string, suitable for comparing to a dictionary item
  *
@@ -422,7 +976,7 @@ static unsigned char zscii_table[256] =
 };
 
 /* Table that maps 8-bit characters to packed characters. Lower 6 bits are the characters, the other bits are the alphabet */
-static unsigned char* zscii = zscii_table;
+static ZSTATE unsigned char* zscii = zscii_table;
 
 void pack_zscii(unsigned int* string, int strlen, ZByte* packed, int packlen)
 {
@@ -563,8 +1117,8 @@ void zscii_install_alphabet(void)
 		table = Word(ZH_alphatable);
 		if (table)
 		{
-			static unsigned int** conv = NULL;
-			static unsigned char* zsc = NULL;
+			static ZSTATE unsigned int** conv = NULL;
+			static ZSTATE unsigned char* zsc = NULL;
 			ZByte* alpha;
 			int x, y;
 			int alphabet, character;
@@ -622,4 +1176,7 @@ void zscii_install_alphabet(void)
 		convert = convert_table;
 		zscii = zscii_table;
     }
+	
+	/* The fast path tables depend on the Unicode table too, so are rebuilt on first use */
+	fast_ready = 0;
 }
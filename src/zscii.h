@@ -27,12 +27,15 @@
 #include <ctype.h>
 
 #include "ztypes.h"
+#include "zmachine.h"
 
 #ifdef DEBUG
 extern char*		zscii_to_ascii        (ZByte* string, int* len);
 #endif
 
 extern unsigned int*	zscii_to_unicode      (ZByte* string, int* len);
+extern unsigned int*	zscii_decode_at       (ZDWord address, int* len);
+extern void		zscii_flush_cache     (void);
 extern int		zstrlen               (ZByte* string);
 extern void		pack_zscii            (unsigned int* string,
 					       int strlen,
@@ -40,7 +43,7 @@ extern void		pack_zscii            (unsigned int* string,
 					       int packlen);
 extern void		zscii_install_alphabet(void);
 
-extern int* zscii_unicode;
+extern ZSTATE int* zscii_unicode;
 
 static inline unsigned char zscii_get_char(unsigned int unichar) {
     /* Function that converts a unicode character to a ZSCII one */
@@ -0,0 +1,363 @@
+/*
+ * Differential test for the Z-string decoder, using real story files
+ *
+ * Decodes every string in each story with zscii_to_unicode and with the
+ * one-character-at-a-time decoder it replaced (kept in zscii.c as
+ * zscii_to_unicode_reference), and reports any that come out differently.
+ * The strings are the abbreviations, the object names, the dictionary
+ * words, and a string at the start of high memory and after every word
+ * there that ends a string: that covers all the text the game prints,
+ * plus plenty of code that decodes to nonsense but exercises the odd
+ * corners of the decoder (alphabet 2, 10-bit and Unicode characters,
+ * shifts at the end of a word...).
+ *
+ * Also times the two decoders on the high memory strings.
+ *
+ * Build it in src once configure has made ztypes.h:
+ *
+ *   gcc -O2 -I. -o zsciitest zsciitest.c
+ *   ./zsciitest story.z5 [story.z8 ...]
+ */
+
+#define ZSCII_REFERENCE
+#include "zscii.c"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <sys/time.h>
+
+#define ROUNDS  20
+#define PADDING 1024 /* Terminated words after the end of the story */
+
+ZSTATE ZMachine machine;
+
+static jmp_buf fatal_jump;
+
+/* Bad abbreviations are fatal to the interpreter; here they just end the string */
+void zmachine_fatal(char* format, ...)
+{
+  longjmp(fatal_jump, 1);
+}
+
+void zmachine_watch_memory(ZDWord address, int len)
+{
+}
+
+/***                           ----// 888 \\----                           ***/
+
+static int n_strings;
+static int n_failures;
+
+static int load_story(const char *filename)
+{
+  FILE  *f;
+  long   size;
+  int    x;
+  ZUWord table;
+
+  f = fopen(filename, "rb");
+  if (f == NULL)
+    return 0;
+
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  machine.memory = malloc(size + PADDING);
+  if (size < 64 || fread(machine.memory, 1, size, f) != (size_t)size)
+    {
+      fclose(f);
+      free(machine.memory);
+      return 0;
+    }
+  fclose(f);
+
+  /* Strings that run off the end of the story stop in the padding */
+  for (x=0; x<PADDING; x+=2)
+    {
+      machine.memory[size+x]   = 0x80;
+      machine.memory[size+x+1] = 0x00;
+    }
+
+  if (machine.memory[0] < 1 || machine.memory[0] > 8)
+    {
+      free(machine.memory);
+      return 0;
+    }
+
+  machine.header          = machine.memory;
+  machine.story_length    = size;
+  machine.dynamic_ceiling = Word(ZH_static);
+
+  zscii_install_alphabet();
+
+  /*
+   * The abbreviations are decoded up front, as zmachine.c does. All the
+   * addresses are filled in first, so an abbreviation that uses another
+   * (which the standard forbids) gets an empty string rather than
+   * recursing forever. Without a table, the decoders look in the header.
+   */
+  table = Word(ZH_abbrevs);
+  for (x=0; x<96; x++)
+    {
+      machine.abbrev[x]      = calloc(1, sizeof(int));
+      machine.abbrev_addr[x] = Word(table + x*2)<<1;
+    }
+
+  for (x=0; x<96; x++)
+    {
+      volatile int   n = x;
+      unsigned int*  word;
+      int            len, y;
+
+      if (table == 0 || machine.abbrev_addr[n] == 0 || setjmp(fatal_jump))
+	continue;
+
+      word = zscii_to_unicode_reference(machine.memory +
+					machine.abbrev_addr[n], &len);
+      for (y=0; word[y] != 0; y++);
+      machine.abbrev[n] = realloc(machine.abbrev[n], sizeof(int)*(y+1));
+      memcpy(machine.abbrev[n], word, sizeof(int)*(y+1));
+    }
+
+  return 1;
+}
+
+static void free_story(void)
+{
+  int x;
+
+  for (x=0; x<96; x++)
+    free(machine.abbrev[x]);
+  free(machine.memory);
+}
+
+/*
+ * Decodes the string at address with a decoder, returning a copy of the
+ * text (NULL if the decoder gave up on it) and the length of the Z-string
+ */
+static unsigned int* decode(unsigned int* (*decoder)(ZByte*, int*),
+			    ZDWord address, int *len)
+{
+  unsigned int* volatile copy = NULL;
+  unsigned int* text;
+  int n;
+
+  *len = -1;
+  if (setjmp(fatal_jump))
+    return NULL;
+
+  text = decoder(machine.memory + address, len);
+  for (n=0; text[n] != 0; n++);
+  copy = malloc(sizeof(int)*(n+1));
+  memcpy(copy, text, sizeof(int)*(n+1));
+
+  return copy;
+}
+
+static void check_string(const char *filename, const char *what,
+			 ZDWord address)
+{
+  unsigned int *expected, *actual;
+  int expected_len, actual_len;
+  int x, same;
+
+  if (address <= 0 || address >= machine.story_length)
+    return;
+
+  expected = decode(zscii_to_unicode_reference, address, &expected_len);
+  actual   = decode(zscii_to_unicode, address, &actual_len);
+
+  same = expected_len == actual_len;
+  if (same && expected != NULL && actual != NULL)
+    {
+      for (x=0; expected[x] != 0 && expected[x] == actual[x]; x++);
+      same = expected[x] == actual[x];
+    }
+  else if (expected == NULL || actual == NULL)
+    same = same && expected == actual;
+
+  n_strings++;
+  if (!same)
+    {
+      n_failures++;
+      if (n_failures <= 20)
+	printf("%s: %s at #%05x decodes differently\n",
+	       filename, what, (unsigned)address);
+    }
+
+  free(expected);
+  free(actual);
+}
+
+static void check_objects(const char *filename)
+{
+  int    version, defaults, entry, prop_offset;
+  ZDWord objs, obj, first_props;
+
+  version = machine.memory[0];
+  if (version <= 3)
+    {
+      defaults = 31; entry = 9; prop_offset = 7;
+    }
+  else
+    {
+      defaults = 63; entry = 14; prop_offset = 12;
+    }
+
+  objs = Word(ZH_objs);
+  if (objs == 0)
+    return;
+
+  /* The objects stop where the first property table starts */
+  first_props = machine.story_length;
+  for (obj = objs + defaults*2;
+       obj + entry <= machine.story_length && obj < first_props;
+       obj += entry)
+    {
+      ZDWord props;
+
+      props = Word(obj + prop_offset);
+      if (props == 0 || props >= machine.story_length)
+	break;
+      if (props < first_props)
+	first_props = props;
+
+      if (machine.memory[props] > 0)
+	check_string(filename, "object name", props+1);
+    }
+}
+
+static void check_dictionary(const char *filename)
+{
+  ZDWord dict, words;
+  int    entry_length, n_words, x;
+
+  dict = Word(ZH_dict);
+  if (dict == 0 || dict >= machine.story_length)
+    return;
+
+  words        = dict + 1 + machine.memory[dict];
+  entry_length = machine.memory[words];
+  n_words      = (short)Word(words+1);
+  if (n_words < 0)
+    n_words = -n_words;
+
+  for (x=0; x<n_words; x++)
+    check_string(filename, "dictionary word", words + 3 + x*entry_length);
+}
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+/* Times decoding the strings in high memory */
+static double time_decoder(unsigned int* (*decoder)(ZByte*, int*),
+			   ZDWord *starts, int n_starts, long *zwords)
+{
+  double       before;
+  volatile int round, x;
+  int          len;
+
+  *zwords = 0;
+
+  before = now();
+  for (round=0; round<ROUNDS; round++)
+    for (x=0; x<n_starts; x++)
+      {
+	if (setjmp(fatal_jump))
+	  continue;
+
+	decoder(machine.memory + starts[x], &len);
+	*zwords += len/2;
+      }
+
+  return (now() - before)/ROUNDS;
+}
+
+static void test(const char *filename, double *ref_total, double *new_total)
+{
+  ZDWord  address, high;
+  ZDWord* starts;
+  int     x, n_starts, failures;
+  long    zwords;
+  double  ref_time, new_time;
+
+  n_strings = 0;
+  failures  = n_failures;
+
+  if (Word(ZH_abbrevs) != 0)
+    for (x=0; x<96; x++)
+      check_string(filename, "abbreviation", machine.abbrev_addr[x]);
+
+  check_objects(filename);
+  check_dictionary(filename);
+
+  high = Word(ZH_base_high)&~1;
+  if (high == 0)
+    high = machine.dynamic_ceiling&~1;
+
+  starts   = malloc(sizeof(ZDWord)*((machine.story_length - high)/2 + 1));
+  n_starts = 0;
+  starts[n_starts++] = high;
+  for (address = high; address+2 < machine.story_length; address += 2)
+    {
+      if (machine.memory[address]&0x80)
+	starts[n_starts++] = address+2;
+    }
+
+  for (x=0; x<n_starts; x++)
+    check_string(filename, "string", starts[x]);
+
+  ref_time = time_decoder(zscii_to_unicode_reference, starts, n_starts, &zwords);
+  new_time = time_decoder(zscii_to_unicode, starts, n_starts, &zwords);
+
+  printf("%-24s %6i strings, %3i differ  %5.1f words/string  %6.1fns -> %6.1fns per string\n",
+	 filename, n_strings, n_failures - failures,
+	 (double)zwords/ROUNDS/n_starts,
+	 ref_time*1e9/n_starts, new_time*1e9/n_starts);
+
+  *ref_total += ref_time;
+  *new_total += new_time;
+
+  free(starts);
+}
+
+int main(int argc, char **argv)
+{
+  double ref_total, new_total;
+  int x;
+
+  if (argc < 2)
+    {
+      fprintf(stderr, "Usage: %s story-file ...\n", argv[0]);
+      return 1;
+    }
+
+  n_failures = 0;
+  ref_total = new_total = 0;
+
+  for (x=1; x<argc; x++)
+    {
+      if (!load_story(argv[x]))
+	{
+	  printf("%s: not a Z-Code story\n", argv[x]);
+	  continue;
+	}
+
+      test(argv[x], &ref_total, &new_total);
+      free_story();
+    }
+
+  if (new_total > 0)
+    printf("\nDecoding the high memory strings: %.1fus -> %.1fus (%.2fx)\n",
+	   ref_total*1e6, new_total*1e6, ref_total/new_total);
+
+  printf("\n%i failures\n", n_failures);
+  return n_failures != 0;
+}